@@ -0,0 +1,120 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "benchmark.h"
+#include "imageGenerator.h"
+#include "session.h"
+#include "virtualDisk.h"
+#include "btree.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <filesystem>
+
+class benchmarkTimer {
+public:
+	benchmarkTimer() {
+		m_start = std::chrono::steady_clock::now();
+	}
+	// Milliseconds since the last call (or construction)
+	double lap() {
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double, std::milli>(now - m_start).count();
+		m_start = now;
+		return elapsed;
+	}
+private:
+	std::chrono::steady_clock::time_point m_start;
+};
+
+struct sBenchmarkResult {
+	double m_sessionScan = 0;
+	double m_catalogRead = 0;
+	double m_pathResolution = 0;
+	double m_extraction = 0;
+	double m_diskBuild = 0;
+	int m_numFiles = 0;
+};
+
+static bool benchmarkImage(const std::string& imageFileName, bool cptp, const std::string& outputPath, sBenchmarkResult& result) {
+	benchmarkTimer timer;
+
+	tapeFile* fHandle = cptp ? (tapeFile*)new tapeFile_cptp() : (tapeFile*)new tapeFile_raw();
+	if (!fHandle->open(imageFileName.c_str()) || fHandle->readU16_BE() != 0x4454) {
+		delete fHandle;
+		return false;
+	}
+	std::vector<sSession> sessions;
+	if (!findSessions(fHandle, sessions)) {
+		delete fHandle;
+		return false;
+	}
+	result.m_sessionScan = timer.lap();
+
+	std::vector<std::optional<bTree>> catalogs;
+	for (int i = 0; i < sessions.size(); i++) {
+		catalogs.push_back(getCatalogSession(i, sessions, fHandle));
+	}
+	result.m_catalogRead = timer.lap();
+
+	std::vector<std::vector<bTree::sExtractJob>> jobs(sessions.size());
+	for (int i = 0; i < sessions.size(); i++) {
+		if (catalogs[i].has_value()) {
+			jobs[i] = catalogs[i]->getExtractJobs(nullptr);
+			result.m_numFiles += jobs[i].size();
+		}
+	}
+	result.m_pathResolution = timer.lap();
+
+	bTree::sDumpSettings dumpSettings;
+	dumpSettings.m_verbose = false;
+	for (int i = 0; i < sessions.size(); i++) {
+		bTree::extractJobs(fHandle, outputPath + "/session_" + std::to_string(i) + "_files/", jobs[i], dumpSettings);
+	}
+	result.m_extraction = timer.lap();
+
+	for (int i = 0; i < sessions.size(); i++) {
+		virtualDisk disk;
+		if (disk.open(fHandle, sessions, i)) {
+			disk.writeImage(outputPath + "/session_" + std::to_string(i) + ".dsk");
+		}
+	}
+	result.m_diskBuild = timer.lap();
+
+	delete fHandle;
+	return true;
+}
+
+int runBenchmark(const std::string& workPath, const std::vector<sBenchmarkConfig>& configs) {
+	std::filesystem::create_directories(workPath);
+
+	printf("%-6s %8s %8s %10s %10s %10s %10s %10s %10s\n", "format", "sessions", "files", "image MB", "scan ms", "catalog ms", "paths ms", "extract ms", "dsk ms");
+	for (int i = 0; i < configs.size(); i++) {
+		for (int cptp = 0; cptp < 2; cptp++) {
+			sGeneratorSettings settings;
+			settings.m_numSessions = configs[i].m_numSessions;
+			settings.m_numFilesPerSession = configs[i].m_numFilesPerSession;
+			settings.m_cptp = cptp != 0;
+
+			std::string imageFileName = workPath + "/bench" + (cptp ? ".cptp" : ".bin");
+			std::string outputPath = workPath + "/bench_output";
+			if (!generateImage(imageFileName, settings)) {
+				return -1;
+			}
+			std::filesystem::remove_all(outputPath);
+			std::filesystem::create_directories(outputPath);
+
+			sBenchmarkResult result;
+			if (!benchmarkImage(imageFileName, settings.m_cptp, outputPath, result)) {
+				printf("Failed to read back %s\n", imageFileName.c_str());
+				return -1;
+			}
+			double imageSize = std::filesystem::file_size(imageFileName) / (1024.0 * 1024.0);
+			printf("%-6s %8d %8d %10.1f %10.2f %10.2f %10.2f %10.2f %10.2f\n", cptp ? "cptp" : "raw", settings.m_numSessions, result.m_numFiles, imageSize,
+				result.m_sessionScan, result.m_catalogRead, result.m_pathResolution, result.m_extraction, result.m_diskBuild);
+
+			std::filesystem::remove_all(outputPath);
+			std::filesystem::remove(imageFileName);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct sBenchmarkConfig {
+	int m_numSessions;
+	int m_numFilesPerSession;
+};
+
+// Generates synthetic raw and .cptp images in workPath and times each stage on them:
+// session scan, catalog read, path resolution, extraction and .dsk build
+int runBenchmark(const std::string& workPath, const std::vector<sBenchmarkConfig>& configs);
@@ -5,8 +5,21 @@
 #include <assert.h>
 #include <filesystem>
 #include <array>
+#include <algorithm>
 
 #include "tapeFile.h"
+#include "pathFilter.h"
+#include "contentStore.h"
+#include "extractJournal.h"
+#include "checksumManifest.h"
+#include "hash.h"
+#include "progress.h"
+#include "forkReader.h"
+#include "sessionAddressMap.h"
+#include "tarWriter.h"
+#include "outputTree.h"
+#include "tapePass.h"
+#include "uringWriter.h"
 
 // https://developer.apple.com/library/archive/technotes/tn/tn1150.html#BTrees
 // https://github.com/libyal/libfshfs/blob/main/documentation/Hierarchical%20File%20System%20(HFS).asciidoc
@@ -181,6 +194,72 @@ std::string normalizeFilename(std::string& name) {
 	return name;
 }
 
+std::string macRomanToUTF8(const std::string& name) {
+	// Unicode code points of MacRoman 0x80-0xFF
+	static const uint16_t highCharacters[128] = {
+		0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1, 0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+		0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3, 0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+		0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF, 0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+		0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211, 0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+		0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB, 0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+		0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA, 0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
+		0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1, 0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+		0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC, 0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7,
+	};
+	std::string converted;
+	converted.reserve(name.size());
+	for (int i = 0; i < name.size(); i++) {
+		uint8_t character = name[i];
+		if (character < 0x80) {
+			converted += (char)character;
+			continue;
+		}
+		uint16_t codePoint = highCharacters[character - 0x80];
+		if (codePoint < 0x800) {
+			converted += (char)(0xC0 | (codePoint >> 6));
+		}
+		else {
+			converted += (char)(0xE0 | (codePoint >> 12));
+			converted += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		}
+		converted += (char)(0x80 | (codePoint & 0x3F));
+	}
+	return converted;
+}
+
+int64_t HFSTimeToUnixTime(uint32_t HFSTime) {
+	// HFS dates are seconds since 1904-01-01, in the local time of the Mac that wrote them
+	return (int64_t)HFSTime - 2082844800;
+}
+
+std::string formatHFSTime(uint32_t HFSTime) {
+	if (HFSTime == 0) {
+		return "";
+	}
+	int64_t time = HFSTimeToUnixTime(HFSTime);
+	int64_t days = time / 86400;
+	int64_t seconds = time % 86400;
+	if (seconds < 0) {
+		seconds += 86400;
+		days--;
+	}
+
+	// Days since 1970-01-01 to a civil date
+	int64_t shiftedDays = days + 719468;
+	int64_t era = (shiftedDays >= 0 ? shiftedDays : shiftedDays - 146096) / 146097;
+	int64_t dayOfEra = shiftedDays - era * 146097;
+	int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+	int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	int64_t shiftedMonth = (5 * dayOfYear + 2) / 153;
+	int day = (int)(dayOfYear - (153 * shiftedMonth + 2) / 5 + 1);
+	int month = (int)(shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+	int year = (int)(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d", year, month, day, (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+	return buffer;
+}
+
 std::string bTree::getFolderPath(uint32_t CNID) {
 	for (int i = 1; i < m_nodes[0].m_headerNode.totalNodes; i++) {
 		sNode& currentNode = m_nodes[i];
@@ -227,8 +306,30 @@ bool bTree::read(tapeFile* fHandle) {
 	return true;
 }
 
-void bTree::dump(tapeFile* fHandle, const std::string& outputPath) {
-	sNode& rootNode = m_nodes[m_nodes[0].m_headerNode.rootNode];
+bTree::sExtractJob bTree::makeExtractJob(sLeafNode& fileRecord, const std::string& folderPath, const sessionAddressMap* addressMap) {
+	sExtractJob newJob;
+	newJob.m_record = &fileRecord;
+	newJob.m_folderPath = folderPath;
+	newJob.m_name = fileRecord.getName();
+	newJob.m_tapeOffset = 0;
+	newJob.m_addressMap = addressMap;
+	if (fileRecord.m_FileRecord.m_dataForkBlockAllocatedSize) {
+		uint16_t extentStart = fileRecord.m_FileRecord.m_firstDataForkExtents[0] >> 16;
+		if (addressMap) {
+			// blocks not on the tape go last
+			int64_t tapeOffset = addressMap->getAllocationBlockTapeOffset(extentStart);
+			newJob.m_tapeOffset = tapeOffset == -1 ? UINT64_MAX : tapeOffset;
+		}
+		else {
+			newJob.m_tapeOffset = getAllocationBlockTapeOffset(extentStart);
+		}
+	}
+	return newJob;
+}
+
+std::vector<bTree::sExtractJob> bTree::getExtractJobs(const pathFilter* filter) {
+	// Resolve paths and filter on the catalog alone, no file data is read in this pass
+	std::vector<sExtractJob> jobs;
 
 	for (int i = 1; i < m_nodes[0].m_headerNode.totalNodes; i++) {
 		sNode& currentNode = m_nodes[i];
@@ -240,43 +341,249 @@ void bTree::dump(tapeFile* fHandle, const std::string& outputPath) {
 					// File
 					uint32_t parentCNID = leafNodeRecord.getParentCNID();
 					std::string name = leafNodeRecord.getName();
+					std::string folderPath = getFolderPath(parentCNID);
 
-					std::string gfolderPath = outputPath + getFolderPath(parentCNID);
-
-					if (leafNodeRecord.m_FileRecord.m_dataForkBlockAllocatedSize) {
-						std::filesystem::create_directories(gfolderPath.c_str());
-
-						std::string outputFileName = gfolderPath + "/" + normalizeFilename(name);
-						FILE* fOutput = fopen(outputFileName.c_str(), "wb+");
-						if (fOutput) {
-							uint32_t amountLeft = leafNodeRecord.m_FileRecord.m_dataForkBlockSize;
-							for (int i = 0; i < 3; i++) {
-								uint16_t extentStart = leafNodeRecord.m_FileRecord.m_firstDataForkExtents[i] >> 16;
-								uint16_t extentSize = leafNodeRecord.m_FileRecord.m_firstDataForkExtents[i] & 0xFFFF;
-
-								fHandle->seekToPosition((extentStart - 0x26) * 0x9800 + 0x1000);
-								for (int j = 0; j < extentSize; j++) {
-									std::array<uint8_t, 0x9800> buffer;
-									uint32_t sizeToWrite = std::min<uint32_t>(amountLeft, 0x9800);
-									fHandle->readBuffer(buffer.data(), sizeToWrite);
-									fwrite(buffer.data(), 1, sizeToWrite, fOutput);
-
-									amountLeft -= sizeToWrite;
-								}
-								if (amountLeft == 0) {
-									break;
-								}
-							}
-							//assert(amountLeft == 0);
-							fclose(fOutput);
-						}
+					if (filter && !filter->matches(folderPath + "/" + normalizeFilename(name))) {
+						continue;
 					}
 
-					printf("%s/%s 0x%08X/0x%08X\n", gfolderPath.c_str(), name.c_str(), leafNodeRecord.m_FileRecord.m_firstDataForkExtents[0], leafNodeRecord.m_FileRecord.m_firstResourceForkExtents[0]);
+					jobs.push_back(makeExtractJob(leafNodeRecord, folderPath, m_addressMap.get()));
 				}
 			}
 		}
 	}
+	return jobs;
+}
+
+void bTree::dump(tapeFile* fHandle, const std::string& outputPath, const sDumpSettings& settings) {
+	std::vector<sExtractJob> jobs = getExtractJobs(settings.m_filter);
+	extractJobs(fHandle, outputPath, jobs, settings);
+}
+
+static void writeTarEntry(tapeFile* fHandle, const std::string& entryName, sLeafNode& fileRecord, const sessionAddressMap* addressMap, const bTree::sDumpSettings& settings) {
+	uint32_t creationTime = fileRecord.m_FileRecord.m_creationTime;
+	uint32_t modificationTime = fileRecord.m_FileRecord.m_modificationTime;
+	std::optional<int64_t> entryCreationTime;
+	if (creationTime) {
+		entryCreationTime = HFSTimeToUnixTime(creationTime);
+	}
+
+	forkReader fork;
+	fork.open(fHandle, fileRecord, false, addressMap);
+	settings.m_tar->beginFile(macRomanToUTF8(entryName), fork.getSize(), modificationTime ? HFSTimeToUnixTime(modificationTime) : 0, entryCreationTime);
+	for (uint64_t offset = 0; offset < fork.getSize(); offset += 0x9800) {
+		std::array<uint8_t, 0x9800> buffer;
+		uint32_t sizeToWrite = (uint32_t)fork.read(offset, buffer.data(), buffer.size());
+		settings.m_tar->write(buffer.data(), sizeToWrite);
+		if (settings.m_progress) {
+			settings.m_progress->addBytes(sizeToWrite);
+		}
+	}
+	settings.m_tar->endFile();
+}
+
+// A data fork on its way to its output file or store object, checksummed while written, then journaled and listed
+// in the manifest. Fed by a forkReader, or by a tapePass when the whole tape is read in one go.
+class forkOutput : public tapePassSink {
+public:
+	forkOutput(const bTree::sExtractJob& job, const std::string& outputFileName, const bTree::sDumpSettings& settings, std::shared_ptr<outputTree> tree)
+		: m_job(job), m_outputFileName(outputFileName), m_settings(settings), m_tree(tree) {
+		// Same size and dates as a fork already in the store, a candidate until verifyKnown() checks its content
+		if (m_settings.m_store) {
+			const sLeafNode& record = *m_job.m_record;
+			m_objectPath = m_settings.m_store->findKnown(record.m_FileRecord.m_dataForkBlockSize, record.m_FileRecord.m_creationTime, record.m_FileRecord.m_modificationTime, &m_checksums);
+		}
+	}
+	bool needsData() const {
+		return m_objectPath.empty();
+	}
+	// Different files can share size and dates, the fork is hashed and only linked to the candidate object when the
+	// checksums match, otherwise it's stored like a new one
+	void verifyKnown(forkReader& fork) {
+		if (m_objectPath.empty()) {
+			return;
+		}
+		checksumStream checksum;
+		for (uint64_t offset = 0; offset < fork.getSize(); offset += 0x9800) {
+			std::array<uint8_t, 0x9800> buffer;
+			uint32_t sizeRead = (uint32_t)fork.read(offset, buffer.data(), buffer.size());
+			checksum.update(buffer.data(), sizeRead);
+		}
+		sChecksums checksums = checksum.digest();
+		if (checksums.m_xxh64 == m_checksums.m_xxh64 && checksums.m_crc32c == m_checksums.m_crc32c) {
+			m_settings.m_store->m_numSkippedWrites++;
+		}
+		else {
+			m_objectPath.clear();
+			m_checksums = sChecksums();
+		}
+	}
+
+	void write(uint64_t offset, const uint8_t* data, uint64_t size) override {
+		open();
+		if (m_output == nullptr) {
+			return;
+		}
+		m_checksum.update(data, size);
+		if (m_settings.m_store) {
+			m_settings.m_store->writeObject(data, size);
+		}
+		else if (m_settings.m_writer) {
+			m_settings.m_writer->write(m_output, offset, data, size);
+		}
+		else {
+			fwrite(data, 1, size, m_output);
+		}
+		if (m_settings.m_progress) {
+			m_settings.m_progress->addBytes(size);
+		}
+	}
+
+	void finish() override {
+		sLeafNode& record = *m_job.m_record;
+		uint32_t dataSize = record.m_FileRecord.m_dataForkBlockSize;
+		if (needsData()) {
+			open();
+		}
+		if (m_output && m_settings.m_writer && !m_settings.m_store) {
+			// Only journaled once its writes are done, an interrupted run writes it again
+			m_checksums = m_checksum.digest();
+			extractJournal* journal = m_settings.m_journal;
+			uint32_t id = record.m_FileRecord.m_id;
+			sChecksums checksums = m_checksums;
+			std::string outputFileName = m_outputFileName;
+			m_settings.m_writer->close(m_output, [journal, id, dataSize, checksums, outputFileName]() {
+				if (journal) {
+					journal->addEntry(id, extractJournal::FORK_DATA, dataSize, checksums, outputFileName);
+				}
+			});
+			m_output = nullptr;
+			if (m_settings.m_manifest) {
+				m_settings.m_manifest->addEntry(m_outputFileName, dataSize, m_checksums);
+			}
+			return;
+		}
+		if (m_output) {
+			m_checksums = m_checksum.digest();
+			if (m_settings.m_store) {
+				m_objectPath = m_settings.m_store->commitObject(dataSize, record.m_FileRecord.m_creationTime, record.m_FileRecord.m_modificationTime, m_checksums);
+			}
+			else {
+				fclose(m_output);
+			}
+			m_output = nullptr;
+		}
+		else if (m_settings.m_progress) {
+			m_settings.m_progress->addBytes(dataSize);
+		}
+		if (!m_objectPath.empty()) {
+			contentStore::linkObject(m_objectPath, m_outputFileName);
+		}
+
+		if (m_settings.m_journal) {
+			m_settings.m_journal->addEntry(record.m_FileRecord.m_id, extractJournal::FORK_DATA, dataSize, m_checksums, m_outputFileName);
+		}
+		if (m_settings.m_manifest) {
+			m_settings.m_manifest->addEntry(m_outputFileName, dataSize, m_checksums);
+		}
+	}
+
+private:
+	// Files are only opened once their first bytes arrive, so a pass doesn't hold every output open
+	void open() {
+		if (!m_opened) {
+			m_opened = true;
+			m_output = m_settings.m_store ? m_settings.m_store->beginObject() : m_tree->createFile(m_job.m_record->getParentCNID(), m_job.m_folderPath, m_job.m_name);
+		}
+	}
+
+	bTree::sExtractJob m_job;
+	std::string m_outputFileName;
+	bTree::sDumpSettings m_settings;
+	std::shared_ptr<outputTree> m_tree;
+	std::string m_objectPath;
+	checksumStream m_checksum;
+	sChecksums m_checksums;
+	FILE* m_output = nullptr;
+	bool m_opened = false;
+};
+
+void bTree::extractJobs(tapeFile* fHandle, const std::string& outputPath, std::vector<sExtractJob>& jobs, const sDumpSettings& settings, tapePass* pass) {
+	// The archive and the store take one file at a time, in order
+	assert(pass == nullptr || (settings.m_tar == nullptr && settings.m_store == nullptr));
+
+	// Read in tape order
+	std::stable_sort(jobs.begin(), jobs.end(), [](const sExtractJob& a, const sExtractJob& b) { return a.m_tapeOffset < b.m_tapeOffset; });
+
+	// Folders are created once and files opened relative to them
+	std::shared_ptr<outputTree> tree = std::make_shared<outputTree>();
+	tree->open(outputPath);
+
+	for (int jobIndex = 0; jobIndex < jobs.size(); jobIndex++) {
+		sExtractJob& job = jobs[jobIndex];
+		sLeafNode& leafNodeRecord = *job.m_record;
+		std::string gfolderPath = outputPath + job.m_folderPath;
+
+		if (leafNodeRecord.m_FileRecord.m_dataForkBlockAllocatedSize && settings.m_tar) {
+			// Streamed into the archive, no per file directory, open or close
+			writeTarEntry(fHandle, gfolderPath + "/" + normalizeFilename(job.m_name), leafNodeRecord, job.m_addressMap, settings);
+		}
+		else if (leafNodeRecord.m_FileRecord.m_dataForkBlockAllocatedSize) {
+			std::string outputFileName = gfolderPath + "/" + normalizeFilename(job.m_name);
+			uint32_t dataSize = leafNodeRecord.m_FileRecord.m_dataForkBlockSize;
+
+			// Already written by an interrupted run
+			if (settings.m_journal) {
+				if (const extractJournal::sEntry* journaled = settings.m_journal->findDone(outputFileName, dataSize)) {
+					settings.m_journal->m_numSkipped++;
+					if (settings.m_manifest) {
+						settings.m_manifest->addEntry(outputFileName, dataSize, journaled->m_checksums);
+					}
+					if (settings.m_progress) {
+						settings.m_progress->addBytes(dataSize);
+					}
+					continue;
+				}
+			}
+
+			uint32_t parentCNID = leafNodeRecord.getParentCNID();
+			if (!tree->createFolder(parentCNID, job.m_folderPath)) {
+				printf("Can't create folder %s\n", gfolderPath.c_str());
+				continue;
+			}
+
+			std::unique_ptr<forkOutput> output = std::make_unique<forkOutput>(job, outputFileName, settings, tree);
+			forkReader fork;
+			fork.open(fHandle, leafNodeRecord, false, job.m_addressMap);
+			output->verifyKnown(fork);
+			if (pass) {
+				// Written when the pass reaches its extents
+				int sinkIndex = pass->addSink(std::move(output));
+				for (int i = 0; i < fork.getExtents().size(); i++) {
+					const forkReader::sExtent& extent = fork.getExtents()[i];
+					pass->addRange(sinkIndex, extent.m_forkOffset, extent.m_tapeOffset, extent.m_size);
+				}
+			}
+			else {
+				for (uint64_t offset = 0; output->needsData() && offset < fork.getSize(); offset += 0x9800) {
+					std::array<uint8_t, 0x9800> buffer;
+					uint32_t sizeToWrite = (uint32_t)fork.read(offset, buffer.data(), buffer.size());
+					output->write(offset, buffer.data(), sizeToWrite);
+				}
+				output->finish();
+			}
+		}
+
+		if (settings.m_verbose) {
+			const char* format = "%s/%s 0x%08X/0x%08X\n";
+			if (settings.m_progress) {
+				settings.m_progress->message(format, gfolderPath.c_str(), job.m_name.c_str(), leafNodeRecord.m_FileRecord.m_firstDataForkExtents[0], leafNodeRecord.m_FileRecord.m_firstResourceForkExtents[0]);
+			}
+			else {
+				printf(format, gfolderPath.c_str(), job.m_name.c_str(), leafNodeRecord.m_FileRecord.m_firstDataForkExtents[0], leafNodeRecord.m_FileRecord.m_firstResourceForkExtents[0]);
+			}
+		}
+	}
 }
 
 void bTree::dumpLeafNodes(const std::string& outputFileName) {
@@ -4,8 +4,19 @@
 #include <stdint.h>
 #include <vector>
 #include <string>
+#include <memory>
 #include "tapeFile.h"
 
+class pathFilter;
+class contentStore;
+class extractJournal;
+class checksumManifest;
+class progressReporter;
+class tarWriter;
+class sessionAddressMap;
+class tapePass;
+class uringWriter;
+
 struct sLeafNode {
 	std::vector<uint8_t> m_key;
 	uint8_t m_type;
@@ -98,13 +109,48 @@ struct sNode {
 	sHeaderNode m_headerNode;
 };
 
+std::string normalizeFilename(std::string& name);
+// Catalog names are MacRoman
+std::string macRomanToUTF8(const std::string& name);
+int64_t HFSTimeToUnixTime(uint32_t HFSTime);
+// YYYY-MM-DDTHH:MM:SS, empty for a date that was never set
+std::string formatHFSTime(uint32_t HFSTime);
+// Reads the 512 byte node at the current position
+void readNode(tapeFile* fHandle, sNode& newNode);
+
 class bTree {
 public:
 	bool read(tapeFile* fHandle);
-	void dump(tapeFile* fHandle, const std::string& outputPath);
+	struct sDumpSettings {
+		const pathFilter* m_filter = nullptr;
+		contentStore* m_store = nullptr;
+		extractJournal* m_journal = nullptr;
+		checksumManifest* m_manifest = nullptr;
+		progressReporter* m_progress = nullptr;
+		tarWriter* m_tar = nullptr; // files go into the archive instead of the output folder
+		uringWriter* m_writer = nullptr; // output files written through io_uring (not with m_tar or m_store)
+		bool m_verbose = true; // one line per extracted file
+	};
+	void dump(tapeFile* fHandle, const std::string& outputPath, const sDumpSettings& settings);
+
+	// A file to extract, with its catalog path already resolved
+	struct sExtractJob {
+		sLeafNode* m_record;
+		std::string m_folderPath;
+		std::string m_name;
+		uint64_t m_tapeOffset;
+		const sessionAddressMap* m_addressMap; // nullptr for the default DeskTape geometry
+	};
+	// Every file record passing the filter (all of them without one)
+	std::vector<sExtractJob> getExtractJobs(const pathFilter* filter);
+	static sExtractJob makeExtractJob(sLeafNode& fileRecord, const std::string& folderPath, const sessionAddressMap* addressMap = nullptr);
+	// With a pass, the files are only registered to it and written when it runs (not with m_tar or m_store)
+	static void extractJobs(tapeFile* fHandle, const std::string& outputPath, std::vector<sExtractJob>& jobs, const sDumpSettings& settings, tapePass* pass = nullptr);
 	void dumpLeafNodes(const std::string& outputFileName);
 
 	std::vector<sNode> m_nodes;
+	// Allocation block to tape translation of the session this catalog was read from
+	std::shared_ptr<const sessionAddressMap> m_addressMap;
 
 	std::string getFolderPath(uint32_t CNID);
 
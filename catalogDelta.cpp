@@ -0,0 +1,215 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "catalogDelta.h"
+#include "pathFilter.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <algorithm>
+
+std::vector<sCatalogEntry> catalogDelta::buildSnapshot(bTree& catalog, int sessionIndex) {
+	std::vector<sCatalogEntry> snapshot;
+
+	for (int i = 1; i < catalog.m_nodes[0].m_headerNode.totalNodes; i++) {
+		sNode& currentNode = catalog.m_nodes[i];
+		if (currentNode.m_type == 0xFF) {
+			// leaf node
+			for (int j = 0; j < currentNode.m_leafNode.size(); j++) {
+				auto& leafNodeRecord = currentNode.m_leafNode[j];
+				if (leafNodeRecord.m_type == 1 || leafNodeRecord.m_type == 2) {
+					sCatalogEntry& newEntry = snapshot.emplace_back();
+					newEntry.m_CNID = leafNodeRecord.m_type == 1 ? leafNodeRecord.m_FolderRecord.m_id : leafNodeRecord.m_FileRecord.m_id;
+					newEntry.m_parentCNID = leafNodeRecord.getParentCNID();
+					newEntry.m_name = leafNodeRecord.getName();
+					newEntry.m_type = leafNodeRecord.m_type;
+					newEntry.m_record = &leafNodeRecord;
+					newEntry.m_addressMap = catalog.m_addressMap.get();
+					newEntry.m_sessionIndex = sessionIndex;
+				}
+			}
+		}
+	}
+
+	std::sort(snapshot.begin(), snapshot.end(), [](const sCatalogEntry& a, const sCatalogEntry& b) { return a.m_CNID < b.m_CNID; });
+	return snapshot;
+}
+
+const sCatalogEntry* catalogDelta::findEntry(const std::vector<sCatalogEntry>& snapshot, uint32_t CNID) {
+	auto entry = std::lower_bound(snapshot.begin(), snapshot.end(), CNID, [](const sCatalogEntry& a, uint32_t CNID) { return a.m_CNID < CNID; });
+	if (entry == snapshot.end() || entry->m_CNID != CNID) {
+		return nullptr;
+	}
+	return &(*entry);
+}
+
+std::string catalogDelta::getFolderPath(const std::vector<sCatalogEntry>& snapshot, uint32_t CNID) {
+	std::string path;
+	// bounded walk, a damaged catalog could loop
+	for (int depth = 0; depth < 256; depth++) {
+		const sCatalogEntry* folder = findEntry(snapshot, CNID);
+		if (folder == nullptr || folder->m_type != 1) {
+			return "_orphaned_" + (path.empty() ? path : "/" + path);
+		}
+		std::string name = folder->m_name;
+		name = normalizeFilename(name);
+		path = path.empty() ? name : name + "/" + path;
+		if (folder->m_parentCNID == 1) {
+			break;
+		}
+		CNID = folder->m_parentCNID;
+	}
+	return path;
+}
+
+bool catalogDelta::isModified(const sCatalogEntry& previous, const sCatalogEntry& current) {
+	if (current.m_type != previous.m_type) {
+		return true;
+	}
+	if (current.m_type == 1) {
+		return current.m_record->m_FolderRecord.m_modificationTime != previous.m_record->m_FolderRecord.m_modificationTime;
+	}
+	const auto& a = previous.m_record->m_FileRecord;
+	const auto& b = current.m_record->m_FileRecord;
+	if (a.m_dataForkBlockSize != b.m_dataForkBlockSize || a.m_resourceForkBlockSize != b.m_resourceForkBlockSize) {
+		return true;
+	}
+	if (a.m_modificationTime != b.m_modificationTime || a.m_creationTime != b.m_creationTime) {
+		return true;
+	}
+	for (int i = 0; i < 3; i++) {
+		if (a.m_firstDataForkExtents[i] != b.m_firstDataForkExtents[i] || a.m_firstResourceForkExtents[i] != b.m_firstResourceForkExtents[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<catalogDelta::sChange> catalogDelta::addSession(bTree& catalog, int sessionIndex) {
+	std::vector<sCatalogEntry> current = buildSnapshot(catalog, sessionIndex);
+
+	// Diff by CNID
+	std::vector<sChange> changes;
+	std::vector<const sCatalogEntry*> added;
+	std::vector<const sCatalogEntry*> deleted;
+	size_t previousIndex = 0;
+	size_t currentIndex = 0;
+	while (previousIndex < m_previous.size() || currentIndex < current.size()) {
+		if (currentIndex == current.size() || (previousIndex < m_previous.size() && m_previous[previousIndex].m_CNID < current[currentIndex].m_CNID)) {
+			deleted.push_back(&m_previous[previousIndex++]);
+		}
+		else if (previousIndex == m_previous.size() || current[currentIndex].m_CNID < m_previous[previousIndex].m_CNID) {
+			added.push_back(&current[currentIndex++]);
+		}
+		else {
+			const sCatalogEntry& previousEntry = m_previous[previousIndex++];
+			const sCatalogEntry& currentEntry = current[currentIndex++];
+			if (isModified(previousEntry, currentEntry)) {
+				changes.push_back({ CHANGE_MODIFIED, currentEntry, std::string() });
+			}
+			else if (previousEntry.m_parentCNID != currentEntry.m_parentCNID || previousEntry.m_name != currentEntry.m_name) {
+				changes.push_back({ CHANGE_MOVED, currentEntry, std::string() });
+			}
+		}
+	}
+
+	// Pair the remaining additions and deletions by parent+name, applications often save a new file over the old one
+	auto byParentAndName = [](const sCatalogEntry* a, const sCatalogEntry* b) {
+		if (a->m_parentCNID != b->m_parentCNID) {
+			return a->m_parentCNID < b->m_parentCNID;
+		}
+		return std::lexicographical_compare(a->m_name.begin(), a->m_name.end(), b->m_name.begin(), b->m_name.end(), [](char x, char y) { return tolower((uint8_t)x) < tolower((uint8_t)y); });
+	};
+	std::sort(added.begin(), added.end(), byParentAndName);
+	std::sort(deleted.begin(), deleted.end(), byParentAndName);
+	size_t addedIndex = 0;
+	size_t deletedIndex = 0;
+	while (addedIndex < added.size() || deletedIndex < deleted.size()) {
+		if (addedIndex == added.size() || (deletedIndex < deleted.size() && byParentAndName(deleted[deletedIndex], added[addedIndex]))) {
+			changes.push_back({ CHANGE_DELETED, *deleted[deletedIndex++], std::string() });
+		}
+		else if (deletedIndex == deleted.size() || byParentAndName(added[addedIndex], deleted[deletedIndex])) {
+			changes.push_back({ CHANGE_ADDED, *added[addedIndex++], std::string() });
+		}
+		else {
+			deletedIndex++;
+			changes.push_back({ CHANGE_REPLACED, *added[addedIndex++], std::string() });
+		}
+	}
+
+	for (int i = 0; i < changes.size(); i++) {
+		const std::vector<sCatalogEntry>& snapshot = changes[i].m_change == CHANGE_DELETED ? m_previous : current;
+		std::string name = changes[i].m_entry.m_name;
+		changes[i].m_path = getFolderPath(snapshot, changes[i].m_entry.m_parentCNID) + "/" + normalizeFilename(name);
+	}
+
+	// Newest wins merge, entries missing from this session were deleted by it (or before it)
+	std::vector<sCatalogEntry> merged;
+	merged.reserve(std::max(m_merged.size(), current.size()));
+	size_t mergedIndex = 0;
+	currentIndex = 0;
+	while (mergedIndex < m_merged.size() || currentIndex < current.size()) {
+		if (currentIndex == current.size() || (mergedIndex < m_merged.size() && m_merged[mergedIndex].m_CNID < current[currentIndex].m_CNID)) {
+			if (m_keepDeleted) {
+				merged.push_back(m_merged[mergedIndex]);
+			}
+			mergedIndex++;
+		}
+		else {
+			if (mergedIndex < m_merged.size() && m_merged[mergedIndex].m_CNID == current[currentIndex].m_CNID) {
+				mergedIndex++;
+			}
+			merged.push_back(current[currentIndex++]);
+		}
+	}
+	m_merged = std::move(merged);
+	m_previous = std::move(current);
+
+	return changes;
+}
+
+void catalogDelta::writeReport(const std::string& outputFileName, const std::vector<sChange>& changes) {
+	if (FILE* fOutput = fopen(outputFileName.c_str(), "w+")) {
+		for (int i = 0; i < changes.size(); i++) {
+			fprintf(fOutput, "%c 0x%08X %s%s\n", changes[i].m_change, changes[i].m_entry.m_CNID, changes[i].m_path.c_str(), changes[i].m_entry.m_type == 1 ? "/" : "");
+		}
+		fclose(fOutput);
+	}
+}
+
+std::vector<bTree::sExtractJob> catalogDelta::getMergedJobs(const pathFilter* filter) {
+	struct sMergedFile {
+		std::string m_path;
+		int m_sessionIndex;
+		bTree::sExtractJob m_job;
+	};
+	std::vector<sMergedFile> files;
+	for (int i = 0; i < m_merged.size(); i++) {
+		sCatalogEntry& entry = m_merged[i];
+		if (entry.m_type != 2) {
+			continue;
+		}
+		std::string folderPath = getFolderPath(m_merged, entry.m_parentCNID);
+		std::string name = entry.m_name;
+		std::string path = folderPath + "/" + normalizeFilename(name);
+		if (filter && !filter->matches(path)) {
+			continue;
+		}
+		files.push_back({ path, entry.m_sessionIndex, bTree::makeExtractJob(*entry.m_record, folderPath, entry.m_addressMap) });
+	}
+
+	// A replaced file keeps its old CNID in older sessions, the newest one owns the path
+	std::sort(files.begin(), files.end(), [](const sMergedFile& a, const sMergedFile& b) {
+		if (a.m_path != b.m_path) {
+			return a.m_path < b.m_path;
+		}
+		return a.m_sessionIndex > b.m_sessionIndex;
+	});
+	std::vector<bTree::sExtractJob> jobs;
+	for (int i = 0; i < files.size(); i++) {
+		if (i > 0 && files[i].m_path == files[i - 1].m_path) {
+			continue;
+		}
+		jobs.push_back(files[i].m_job);
+	}
+	return jobs;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+
+class pathFilter;
+
+// A folder or file record of one session's catalog
+struct sCatalogEntry {
+	uint32_t m_CNID;
+	uint32_t m_parentCNID;
+	std::string m_name;
+	uint8_t m_type; // 1 folder, 2 file
+	sLeafNode* m_record;
+	const sessionAddressMap* m_addressMap;
+	int m_sessionIndex;
+};
+
+// Diffs consecutive session catalogs and maintains a merged newest-wins view: the final state of the tape, or every
+// file ever backed up with m_keepDeleted.
+// Snapshots are kept sorted by CNID so diffs and merges are linear merge-joins.
+class catalogDelta {
+public:
+	enum eChange : char {
+		CHANGE_ADDED = 'A',
+		CHANGE_DELETED = 'D',
+		CHANGE_MODIFIED = 'M', // same CNID, different content or dates
+		CHANGE_MOVED = 'R', // same CNID, renamed or moved
+		CHANGE_REPLACED = 'P', // new CNID at the same parent+name
+	};
+	struct sChange {
+		eChange m_change;
+		sCatalogEntry m_entry; // the newest side, the old one for deletions
+		std::string m_path;
+	};
+
+	// Sessions must be added oldest first. Returns the changes against the previously added session
+	std::vector<sChange> addSession(bTree& catalog, int sessionIndex);
+	static void writeReport(const std::string& outputFileName, const std::vector<sChange>& changes);
+
+	// Every file of the last session (every file ever seen with m_keepDeleted), each from the newest session holding it
+	std::vector<bTree::sExtractJob> getMergedJobs(const pathFilter* filter);
+	size_t getNumMergedEntries() const {
+		return m_merged.size();
+	}
+
+private:
+	static std::vector<sCatalogEntry> buildSnapshot(bTree& catalog, int sessionIndex);
+	static const sCatalogEntry* findEntry(const std::vector<sCatalogEntry>& snapshot, uint32_t CNID);
+	static std::string getFolderPath(const std::vector<sCatalogEntry>& snapshot, uint32_t CNID);
+	static bool isModified(const sCatalogEntry& previous, const sCatalogEntry& current);
+
+public:
+	// Entries deleted by a later session stay in the merged view, set before the first addSession
+	bool m_keepDeleted = false;
+
+private:
+	std::vector<sCatalogEntry> m_previous;
+	std::vector<sCatalogEntry> m_merged;
+};
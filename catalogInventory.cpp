@@ -0,0 +1,137 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "catalogInventory.h"
+
+#include "btree.h"
+#include "catalogIterator.h"
+#include "stats.h"
+
+static const size_t OUTPUT_BUFFER_SIZE = 1024 * 1024;
+
+static std::string getFourCharCode(const uint8_t* code) {
+	if (code[0] == 0 && code[1] == 0 && code[2] == 0 && code[3] == 0) {
+		return "";
+	}
+	return macRomanToUTF8(std::string((const char*)code, 4));
+}
+
+static std::string toJSON(const std::string& string) {
+	return "\"" + escapeJSON(string) + "\"";
+}
+
+static std::string toJSONDate(uint32_t HFSTime) {
+	return HFSTime ? toJSON(formatHFSTime(HFSTime)) : "null";
+}
+
+static std::string toCSV(const std::string& string) {
+	if (string.find_first_of(",\"\r\n") == std::string::npos) {
+		return string;
+	}
+	std::string quoted = "\"";
+	for (int i = 0; i < string.size(); i++) {
+		if (string[i] == '"') {
+			quoted += '"';
+		}
+		quoted += string[i];
+	}
+	return quoted + "\"";
+}
+
+bool catalogInventory::parseFormat(const std::string& name, eFormat& format) {
+	if (name == "jsonl") {
+		format = FORMAT_JSONL;
+		return true;
+	}
+	if (name == "csv") {
+		format = FORMAT_CSV;
+		return true;
+	}
+	return false;
+}
+
+catalogInventory::~catalogInventory() {
+	close();
+}
+
+bool catalogInventory::open(const std::string& outputFileName, eFormat format) {
+	close();
+	m_format = format;
+	m_numEntries = 0;
+	m_file = fopen(outputFileName.c_str(), "w");
+	if (m_file == nullptr) {
+		return false;
+	}
+	// Hundreds of thousands of short lines, let stdio batch them
+	m_buffer.resize(OUTPUT_BUFFER_SIZE);
+	setvbuf(m_file, m_buffer.data(), _IOFBF, m_buffer.size());
+	if (m_format == FORMAT_CSV) {
+		fprintf(m_file, "session,kind,cnid,parent_cnid,path,valence,data_size,resource_size,type,creator,created,modified,backed_up\n");
+	}
+	return true;
+}
+
+void catalogInventory::close() {
+	if (m_file) {
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+bool catalogInventory::addSession(tapeFile* fHandle, uint64_t catalogPosition, int sessionIndex) {
+	if (m_file == nullptr) {
+		return false;
+	}
+
+	// Folder records only hold their parent, resolving paths needs all of them first
+	catalogFolderMap folders;
+	if (!folders.read(fHandle, catalogPosition)) {
+		return false;
+	}
+
+	catalogIterator iterator;
+	if (!iterator.open(fHandle, catalogPosition)) {
+		return false;
+	}
+	sLeafNode record;
+	while (iterator.next(record)) {
+		if (record.m_type != 1 && record.m_type != 2) {
+			// thread records
+			continue;
+		}
+		bool isFolder = record.m_type == 1;
+		uint32_t parentCNID = record.getParentCNID();
+		std::string name = record.getName();
+		normalizeFilename(name);
+		std::string path = macRomanToUTF8(folders.getPath(parentCNID, name));
+
+		uint32_t CNID = isFolder ? record.m_FolderRecord.m_id : record.m_FileRecord.m_id;
+		uint32_t creationTime = isFolder ? record.m_FolderRecord.m_creationTime : record.m_FileRecord.m_creationTime;
+		uint32_t modificationTime = isFolder ? record.m_FolderRecord.m_modificationTime : record.m_FileRecord.m_modificationTime;
+		uint32_t backupTime = isFolder ? record.m_FolderRecord.m_backupTime : record.m_FileRecord.m_backupTime;
+
+		if (m_format == FORMAT_JSONL) {
+			fprintf(m_file, "{\"session\":%d,\"kind\":\"%s\",\"cnid\":%u,\"parent_cnid\":%u,\"path\":%s,", sessionIndex, isFolder ? "folder" : "file", CNID, parentCNID, toJSON(path).c_str());
+			if (isFolder) {
+				fprintf(m_file, "\"valence\":%u,", record.m_FolderRecord.m_numEntries);
+			}
+			else {
+				fprintf(m_file, "\"data_size\":%u,\"resource_size\":%u,\"type\":%s,\"creator\":%s,", record.m_FileRecord.m_dataForkBlockSize, record.m_FileRecord.m_resourceForkBlockSize,
+					toJSON(getFourCharCode(&record.m_FileRecord.m_fileInfo[0])).c_str(), toJSON(getFourCharCode(&record.m_FileRecord.m_fileInfo[4])).c_str());
+			}
+			fprintf(m_file, "\"created\":%s,\"modified\":%s,\"backed_up\":%s}\n", toJSONDate(creationTime).c_str(), toJSONDate(modificationTime).c_str(), toJSONDate(backupTime).c_str());
+		}
+		else {
+			fprintf(m_file, "%d,%s,%u,%u,%s,", sessionIndex, isFolder ? "folder" : "file", CNID, parentCNID, toCSV(path).c_str());
+			if (isFolder) {
+				fprintf(m_file, "%u,,,,,", record.m_FolderRecord.m_numEntries);
+			}
+			else {
+				fprintf(m_file, ",%u,%u,%s,%s,", record.m_FileRecord.m_dataForkBlockSize, record.m_FileRecord.m_resourceForkBlockSize,
+					toCSV(getFourCharCode(&record.m_FileRecord.m_fileInfo[0])).c_str(), toCSV(getFourCharCode(&record.m_FileRecord.m_fileInfo[4])).c_str());
+			}
+			fprintf(m_file, "%s,%s,%s\n", formatHFSTime(creationTime).c_str(), formatHFSTime(modificationTime).c_str(), formatHFSTime(backupTime).c_str());
+		}
+		m_numEntries++;
+	}
+	return true;
+}
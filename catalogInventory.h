@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "tapeFile.h"
+
+// Every folder and file record of the session catalogs as JSONL or CSV (one line per record), without reading any file data.
+// Paths are catalog paths (Volume/Folder/File, as matched by --include), names are converted from MacRoman to UTF-8.
+class catalogInventory {
+public:
+	enum eFormat {
+		FORMAT_JSONL,
+		FORMAT_CSV,
+	};
+	static bool parseFormat(const std::string& name, eFormat& format);
+
+	~catalogInventory();
+	bool open(const std::string& outputFileName, eFormat format);
+	void close();
+
+	// Streams the catalog at catalogPosition twice: the folders to resolve paths, then every record
+	bool addSession(tapeFile* fHandle, uint64_t catalogPosition, int sessionIndex);
+
+	uint64_t m_numEntries = 0;
+
+private:
+	FILE* m_file = nullptr;
+	eFormat m_format = FORMAT_JSONL;
+	std::vector<char> m_buffer;
+};
@@ -0,0 +1,93 @@
+#include "catalogIterator.h"
+
+bool catalogIterator::open(tapeFile* fHandle, uint64_t catalogPosition) {
+	m_fHandle = fHandle;
+	m_catalogPosition = catalogPosition;
+	m_numVisitedNodes = 0;
+
+	sNode headerNode;
+	fHandle->seekToPosition(catalogPosition);
+	readNode(fHandle, headerNode);
+	if (headerNode.m_type != 1 || headerNode.m_headerNode.nodeSize != 0x200) {
+		return false;
+	}
+	m_header = headerNode.m_headerNode;
+
+	m_currentNode = sNode();
+	m_recordIndex = 0;
+	m_done = m_header.firstLeafNode == 0;
+	if (!m_done && !readLeaf(m_header.firstLeafNode)) {
+		m_done = true;
+		return false;
+	}
+	return true;
+}
+
+bool catalogIterator::readLeaf(uint32_t nodeIndex) {
+	// A broken chain could loop forever
+	if (nodeIndex >= m_header.totalNodes || ++m_numVisitedNodes > m_header.totalNodes) {
+		return false;
+	}
+	m_fHandle->seekToPosition(m_catalogPosition + (uint64_t)nodeIndex * m_header.nodeSize);
+	readNode(m_fHandle, m_currentNode);
+	m_recordIndex = 0;
+	return m_currentNode.m_type == 0xFF;
+}
+
+bool catalogIterator::next(sLeafNode& record) {
+	while (!m_done && m_recordIndex >= m_currentNode.m_leafNode.size()) {
+		if (m_currentNode.m_next == 0 || !readLeaf(m_currentNode.m_next)) {
+			m_done = true;
+		}
+	}
+	if (m_done) {
+		return false;
+	}
+	record = m_currentNode.m_leafNode[m_recordIndex++];
+	return true;
+}
+
+bool catalogFolderMap::read(tapeFile* fHandle, uint64_t catalogPosition) {
+	catalogIterator iterator;
+	if (!iterator.open(fHandle, catalogPosition)) {
+		return false;
+	}
+	sLeafNode record;
+	while (iterator.next(record)) {
+		if (record.m_type == 1) {
+			addFolder(record);
+		}
+	}
+	return true;
+}
+
+void catalogFolderMap::addFolder(sLeafNode& folderRecord) {
+	std::string name = folderRecord.getName();
+	sFolder& folder = m_folders[folderRecord.m_FolderRecord.m_id];
+	folder.m_parentCNID = folderRecord.getParentCNID();
+	folder.m_name = normalizeFilename(name);
+	folder.m_resolved = false;
+}
+
+const std::string& catalogFolderMap::getFolderPath(uint32_t CNID) {
+	static const std::string unknown;
+	auto folder = m_folders.find(CNID);
+	if (folder == m_folders.end()) {
+		return unknown;
+	}
+	if (!folder->second.m_resolved) {
+		// Marked first so a looping parent chain ends with an empty path instead of recursing forever
+		folder->second.m_resolved = true;
+		if (folder->second.m_parentCNID == 1) {
+			folder->second.m_path = folder->second.m_name;
+		}
+		else {
+			folder->second.m_path = getFolderPath(folder->second.m_parentCNID) + "/" + folder->second.m_name;
+		}
+	}
+	return folder->second.m_path;
+}
+
+std::string catalogFolderMap::getPath(uint32_t parentCNID, const std::string& name) {
+	return parentCNID == 1 ? name : getFolderPath(parentCNID) + "/" + name;
+}
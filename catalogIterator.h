@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "btree.h"
+#include "tapeFile.h"
+
+// Walks the catalog leaf records in key order by following the leaf chain, one node in memory at a time
+class catalogIterator {
+public:
+	// catalogPosition is the tape position of the header node (see getCatalogPosition)
+	bool open(tapeFile* fHandle, uint64_t catalogPosition);
+
+	// Returns false once every leaf record was returned
+	bool next(sLeafNode& record);
+
+	const sHeaderNode& getHeader() const {
+		return m_header;
+	}
+
+private:
+	bool readLeaf(uint32_t nodeIndex);
+
+	tapeFile* m_fHandle = nullptr;
+	uint64_t m_catalogPosition = 0;
+	sHeaderNode m_header;
+	sNode m_currentNode;
+	int m_recordIndex = 0;
+	uint32_t m_numVisitedNodes = 0;
+	bool m_done = true;
+};
+
+// Catalog paths of one session (Volume/Folder, names normalized and still MacRoman), from its folder records
+class catalogFolderMap {
+public:
+	// Streams the whole catalog once for its folder records
+	bool read(tapeFile* fHandle, uint64_t catalogPosition);
+	void addFolder(sLeafNode& folderRecord);
+
+	// Path of the record named name in the folder parentCNID
+	std::string getPath(uint32_t parentCNID, const std::string& name);
+
+private:
+	struct sFolder {
+		uint32_t m_parentCNID = 0;
+		std::string m_name;
+		std::string m_path;
+		bool m_resolved = false;
+	};
+	const std::string& getFolderPath(uint32_t CNID);
+
+	std::unordered_map<uint32_t, sFolder> m_folders;
+};
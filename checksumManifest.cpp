@@ -0,0 +1,129 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "checksumManifest.h"
+
+#include <inttypes.h>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <regex>
+#include <thread>
+#include <vector>
+
+checksumManifest::~checksumManifest() {
+	close();
+}
+
+bool checksumManifest::open(const std::string& manifestFileName, const std::string& basePath) {
+	close();
+	m_basePath = basePath;
+	m_file = fopen(manifestFileName.c_str(), "w");
+	return m_file != nullptr;
+}
+
+void checksumManifest::close() {
+	if (m_file) {
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+void checksumManifest::addEntry(const std::string& outputPath, uint64_t size, const sChecksums& checksums) {
+	if (m_file == nullptr) {
+		return;
+	}
+	size_t relativeStart = 0;
+	if (outputPath.compare(0, m_basePath.size(), m_basePath) == 0) {
+		relativeStart = m_basePath.size();
+	}
+	while (relativeStart < outputPath.size() && (outputPath[relativeStart] == '/' || outputPath[relativeStart] == '\\')) {
+		relativeStart++;
+	}
+	fprintf(m_file, "%08X %016" PRIX64 " %" PRIu64 " %s\n", checksums.m_crc32c, checksums.m_xxh64, size, outputPath.c_str() + relativeStart);
+}
+
+int checksumManifest::verify(const std::string& rootPath, int numThreads) {
+	struct sVerifyEntry {
+		std::filesystem::path m_path;
+		uint64_t m_size;
+		sChecksums m_checksums;
+	};
+	std::vector<sVerifyEntry> entries;
+
+	std::error_code error;
+	std::regex manifestPattern("(session_[0-9]+|merged)_manifest\\.txt");
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(rootPath, error)) {
+		if (!entry.is_regular_file() || !std::regex_match(entry.path().filename().string(), manifestPattern)) {
+			continue;
+		}
+		if (FILE* fManifest = fopen(entry.path().string().c_str(), "r")) {
+			char line[4096];
+			while (fgets(line, sizeof(line), fManifest)) {
+				sVerifyEntry newEntry;
+				int pathStart = 0;
+				if (sscanf(line, "%" SCNx32 " %" SCNx64 " %" SCNu64 " %n", &newEntry.m_checksums.m_crc32c, &newEntry.m_checksums.m_xxh64, &newEntry.m_size, &pathStart) != 3 || pathStart == 0) {
+					continue;
+				}
+				std::string relativePath = line + pathStart;
+				while (!relativePath.empty() && (relativePath.back() == '\n' || relativePath.back() == '\r')) {
+					relativePath.pop_back();
+				}
+				newEntry.m_path = entry.path().parent_path() / relativePath;
+				entries.push_back(newEntry);
+			}
+			fclose(fManifest);
+		}
+	}
+
+	printf("Verifying %d files with %d threads (CRC32C %s)\n", (int)entries.size(), numThreads, crc32c::isHardwareAccelerated() ? "SSE4.2" : "software");
+
+	std::atomic<size_t> nextEntry = 0;
+	std::atomic<int> numFailures = 0;
+	std::mutex printMutex;
+	auto worker = [&]() {
+		std::vector<uint8_t> buffer(0x100000);
+		while (true) {
+			size_t entryIndex = nextEntry++;
+			if (entryIndex >= entries.size()) {
+				break;
+			}
+			const sVerifyEntry& entry = entries[entryIndex];
+			const char* problem = nullptr;
+			if (FILE* fInput = fopen(entry.m_path.string().c_str(), "rb")) {
+				checksumStream checksum;
+				uint64_t size = 0;
+				while (size_t numRead = fread(buffer.data(), 1, buffer.size(), fInput)) {
+					checksum.update(buffer.data(), numRead);
+					size += numRead;
+				}
+				fclose(fInput);
+				sChecksums checksums = checksum.digest();
+				if (size != entry.m_size) {
+					problem = "size mismatch";
+				}
+				else if (checksums.m_crc32c != entry.m_checksums.m_crc32c || checksums.m_xxh64 != entry.m_checksums.m_xxh64) {
+					problem = "checksum mismatch";
+				}
+			}
+			else {
+				problem = "missing";
+			}
+			if (problem) {
+				numFailures++;
+				std::lock_guard<std::mutex> lock(printMutex);
+				printf("%s: %s\n", entry.m_path.string().c_str(), problem);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; i++) {
+		threads.emplace_back(worker);
+	}
+	for (int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	printf("%d/%d files failed verification\n", (int)numFailures, (int)entries.size());
+	return numFailures;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#include "hash.h"
+
+// Per-session list of the written outputs with their CRC32C and XXH64, paths relative to the tape output folder.
+// verify() checks an existing output tree against every manifest found under it.
+class checksumManifest {
+public:
+	~checksumManifest();
+	bool open(const std::string& manifestFileName, const std::string& basePath);
+	void close();
+	void addEntry(const std::string& outputPath, uint64_t size, const sChecksums& checksums);
+
+	// Returns the number of missing or corrupted outputs
+	static int verify(const std::string& rootPath, int numThreads);
+
+private:
+	FILE* m_file = nullptr;
+	std::string m_basePath;
+};
@@ -0,0 +1,123 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "contentStore.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <filesystem>
+#include <system_error>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+contentStore::~contentStore() {
+	if (m_index) {
+		fclose(m_index);
+	}
+}
+
+bool contentStore::open(const std::string& storePath) {
+	m_storePath = storePath;
+	std::error_code error;
+	std::filesystem::create_directories(m_storePath + "/objects", error);
+
+	std::string indexFileName = m_storePath + "/index.txt";
+	if (FILE* fIndex = fopen(indexFileName.c_str(), "r")) {
+		uint32_t size, creationTime, modificationTime;
+		sChecksums checksums;
+		while (fscanf(fIndex, "%" SCNu32 " %" SCNx32 " %" SCNx32 " %" SCNx64 " %" SCNx32 "\n", &size, &creationTime, &modificationTime, &checksums.m_xxh64, &checksums.m_crc32c) == 5) {
+			sKnownObject& knownObject = m_known[tKnownKey(size, creationTime, modificationTime)];
+			knownObject.m_path = getObjectPath(size, checksums.m_xxh64);
+			knownObject.m_checksums = checksums;
+			m_objectSizes.insert(size);
+		}
+		fclose(fIndex);
+	}
+
+	m_index = fopen(indexFileName.c_str(), "a");
+	return m_index != nullptr;
+}
+
+std::string contentStore::getObjectPath(uint64_t size, uint64_t hash) {
+	char name[64];
+	snprintf(name, sizeof(name), "%02X/%016" PRIX64 "-%" PRIu64, (uint32_t)(hash >> 56), hash, size);
+	return m_storePath + "/objects/" + name;
+}
+
+std::string contentStore::findKnown(uint32_t size, uint32_t creationTime, uint32_t modificationTime, sChecksums* checksums) {
+	// size prefilter, most forks on a new tape have a size we never stored
+	if (m_objectSizes.find(size) == m_objectSizes.end()) {
+		return std::string();
+	}
+	auto known = m_known.find(tKnownKey(size, creationTime, modificationTime));
+	if (known == m_known.end()) {
+		return std::string();
+	}
+	if (!std::filesystem::exists(known->second.m_path)) {
+		return std::string();
+	}
+	if (checksums) {
+		*checksums = known->second.m_checksums;
+	}
+	return known->second.m_path;
+}
+
+FILE* contentStore::beginObject() {
+	assert(m_pendingObject == nullptr);
+	// Unique per process and object, several runs and the daemon can share a store
+	char name[64];
+	snprintf(name, sizeof(name), "pending_%d_%u.tmp", (int)getpid(), m_numPendingObjects++);
+	m_pendingObjectPath = m_storePath + "/objects/" + name;
+	m_pendingObject = fopen(m_pendingObjectPath.c_str(), "wb");
+	return m_pendingObject;
+}
+
+void contentStore::writeObject(const void* data, size_t size) {
+	fwrite(data, 1, size, m_pendingObject);
+}
+
+std::string contentStore::commitObject(uint32_t size, uint32_t creationTime, uint32_t modificationTime, const sChecksums& checksums) {
+	fclose(m_pendingObject);
+	m_pendingObject = nullptr;
+
+	std::string objectPath = getObjectPath(size, checksums.m_xxh64);
+
+	std::error_code error;
+	if (m_objectSizes.count(size) && std::filesystem::exists(objectPath)) {
+		std::filesystem::remove(m_pendingObjectPath, error);
+		m_numDeduplicated++;
+	}
+	else {
+		std::filesystem::create_directories(std::filesystem::path(objectPath).parent_path(), error);
+		std::filesystem::rename(m_pendingObjectPath, objectPath, error);
+		if (error) {
+			// committed meanwhile by another process sharing the store
+			std::filesystem::remove(m_pendingObjectPath, error);
+		}
+		m_objectSizes.insert(size);
+	}
+
+	sKnownObject& knownObject = m_known[tKnownKey(size, creationTime, modificationTime)];
+	if (knownObject.m_path != objectPath) {
+		knownObject.m_path = objectPath;
+		knownObject.m_checksums = checksums;
+		fprintf(m_index, "%u %08X %08X %016" PRIX64 " %08X\n", size, creationTime, modificationTime, checksums.m_xxh64, checksums.m_crc32c);
+	}
+	return objectPath;
+}
+
+bool contentStore::linkObject(const std::string& objectPath, const std::string& outputFileName) {
+	std::error_code error;
+	std::filesystem::remove(outputFileName, error);
+	std::filesystem::create_hard_link(objectPath, outputFileName, error);
+	if (error) {
+		// store on another volume, fall back to a copy
+		error.clear();
+		std::filesystem::copy_file(objectPath, outputFileName, error);
+	}
+	return !error;
+}
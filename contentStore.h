@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include "hash.h"
+
+// Content addressed store shared between sessions and tapes.
+// Objects are named after their XXH64 and size, extracted trees hardlink to them.
+// index.txt remembers which catalog size+dates produced which object, a fork matching them is only hashed and linked
+// to that object when its checksums match, so known files are not written again.
+class contentStore {
+public:
+	~contentStore();
+	bool open(const std::string& storePath);
+
+	// Returns the object path for a fork already seen with the same size and dates, or an empty string. Only a
+	// candidate, the caller compares the fork checksums with the returned ones before linking to it
+	std::string findKnown(uint32_t size, uint32_t creationTime, uint32_t modificationTime, sChecksums* checksums = nullptr);
+
+	// Streams a new fork into the store, the caller checksums it while streaming. Returns the object path
+	FILE* beginObject();
+	void writeObject(const void* data, size_t size);
+	std::string commitObject(uint32_t size, uint32_t creationTime, uint32_t modificationTime, const sChecksums& checksums);
+
+	// Makes outputFileName point to the object content
+	static bool linkObject(const std::string& objectPath, const std::string& outputFileName);
+
+	uint64_t m_numDeduplicated = 0;
+	uint64_t m_numSkippedWrites = 0;
+
+private:
+	typedef std::tuple<uint32_t, uint32_t, uint32_t> tKnownKey;
+	struct sKnownObject {
+		std::string m_path;
+		sChecksums m_checksums;
+	};
+
+	std::string getObjectPath(uint64_t size, uint64_t hash);
+
+	std::string m_storePath;
+	FILE* m_index = nullptr;
+	std::map<tKnownKey, sKnownObject> m_known;
+	std::set<uint64_t> m_objectSizes;
+
+	FILE* m_pendingObject = nullptr;
+	std::string m_pendingObjectPath;
+	uint32_t m_numPendingObjects = 0;
+};
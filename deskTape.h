@@ -0,0 +1,16 @@
+#pragma once
+
+// Everything needed to read a DeskTape image from another program, as built by the deskTape library target:
+// - openTape() and tapeFile for raw and .cptp images
+// - findSessions() and getCatalogPosition() for the sessions of a tape and their catalog
+// - catalogIterator for the catalog records, one node in memory at a time
+// - sessionAddressMap for where each allocation block of a session is on the tape
+// - forkReader for positional reads of a file fork
+// - virtualDisk for the .dsk image of a session
+#include "tapeFile.h"
+#include "session.h"
+#include "btree.h"
+#include "catalogIterator.h"
+#include "sessionAddressMap.h"
+#include "forkReader.h"
+#include "virtualDisk.h"
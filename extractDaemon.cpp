@@ -0,0 +1,398 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "extractDaemon.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SIGPIPE is ignored instead
+#endif
+
+// How often the watcher, listener and main loop look for a stop request
+static const int STOP_CHECK_MS = 500;
+// Folder scan interval where there is no inotify
+static const int POLL_INTERVAL_MS = 2000;
+// Finished jobs kept for "status"
+static const size_t MAX_FINISHED_JOBS = 1000;
+
+static volatile sig_atomic_t s_stopSignal = 0;
+
+static void onStopSignal(int) {
+	s_stopSignal = 1;
+}
+
+static double getSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Hidden files and partial copies are not images
+static bool isImageName(const std::string& name) {
+	auto endsWith = [&](const char* suffix) {
+		size_t length = strlen(suffix);
+		return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+	};
+	return !name.empty() && name[0] != '.' && !endsWith(".part") && !endsWith(".tmp");
+}
+
+extractDaemon::extractDaemon(const std::string& outputRoot) : m_outputRoot(outputRoot) {
+}
+
+extractDaemon::~extractDaemon() {
+	stop();
+	for (int i = 0; i < m_threads.size(); i++) {
+		m_threads[i].join();
+	}
+#ifndef _WIN32
+	if (m_watchFd >= 0) {
+		close(m_watchFd);
+	}
+	if (m_listenFd >= 0) {
+		close(m_listenFd);
+		unlink(m_socketPath.c_str());
+	}
+#endif
+}
+
+bool extractDaemon::isStopping() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stopping;
+}
+
+void extractDaemon::stop() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wakeUp.notify_all();
+}
+
+uint64_t extractDaemon::addJob(const std::string& imagePath, const std::string& outputPath) {
+	sJob job;
+	job.m_imagePath = imagePath;
+	job.m_outputPath = outputPath.empty() ? m_outputRoot + "/" + std::filesystem::path(imagePath).filename().string() : outputPath;
+	job.m_state = JOB_QUEUED;
+	job.m_queueTime = getSeconds();
+	job.m_startTime = 0;
+	job.m_endTime = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// A file closed several times while being written is only run once at a time
+		for (int i = 0; i < m_jobs.size(); i++) {
+			if ((m_jobs[i].m_state == JOB_QUEUED || m_jobs[i].m_state == JOB_RUNNING) && m_jobs[i].m_imagePath == imagePath) {
+				return 0;
+			}
+		}
+		job.m_id = m_nextId++;
+		m_jobs.push_back(job);
+		printf("Job %llu queued: %s\n", (unsigned long long)job.m_id, imagePath.c_str());
+		fflush(stdout);
+	}
+	m_wakeUp.notify_one();
+	return job.m_id;
+}
+
+std::string extractDaemon::getStatus() {
+	static const char* stateNames[] = { "queued", "running", "done", "failed" };
+	std::lock_guard<std::mutex> lock(m_mutex);
+	double now = getSeconds();
+	std::string status;
+	for (int i = 0; i < m_jobs.size(); i++) {
+		const sJob& job = m_jobs[i];
+		double seconds = 0;
+		if (job.m_state == JOB_RUNNING) {
+			seconds = now - job.m_startTime;
+		}
+		else if (job.m_state != JOB_QUEUED) {
+			seconds = job.m_endTime - job.m_startTime;
+		}
+		char line[64];
+		snprintf(line, sizeof(line), "%llu %s %.1fs ", (unsigned long long)job.m_id, stateNames[job.m_state], seconds);
+		status += line + job.m_imagePath + " -> " + job.m_outputPath + "\n";
+	}
+	return status;
+}
+
+void extractDaemon::worker(int workerIndex) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_wakeUp.wait(lock, [&]() { return m_stopping || m_nextJob < m_jobs.size(); });
+		if (m_stopping) {
+			break;
+		}
+		sJob& job = m_jobs[m_nextJob++];
+		job.m_state = JOB_RUNNING;
+		job.m_startTime = getSeconds();
+		uint64_t id = job.m_id;
+		std::string imagePath = job.m_imagePath;
+		std::string outputPath = job.m_outputPath;
+		printf("Job %llu started on worker %d: %s -> %s\n", (unsigned long long)id, workerIndex, imagePath.c_str(), outputPath.c_str());
+		fflush(stdout);
+
+		lock.unlock();
+		bool success = m_jobFunction(workerIndex, imagePath, outputPath);
+		lock.lock();
+
+		// IDs are consecutive in m_jobs
+		sJob& finishedJob = m_jobs[id - m_jobs.front().m_id];
+		finishedJob.m_state = success ? JOB_DONE : JOB_FAILED;
+		finishedJob.m_endTime = getSeconds();
+		printf("Job %llu %s in %.1fs: %s\n", (unsigned long long)id, success ? "done" : "failed", finishedJob.m_endTime - finishedJob.m_startTime, imagePath.c_str());
+		fflush(stdout);
+
+		while (m_jobs.size() > MAX_FINISHED_JOBS && (m_jobs.front().m_state == JOB_DONE || m_jobs.front().m_state == JOB_FAILED)) {
+			m_jobs.pop_front();
+			m_nextJob--;
+		}
+	}
+}
+
+void extractDaemon::run(int numWorkers, const tJobFunction& jobFunction) {
+	m_jobFunction = jobFunction;
+	signal(SIGINT, onStopSignal);
+	signal(SIGTERM, onStopSignal);
+#ifndef _WIN32
+	signal(SIGPIPE, SIG_IGN); // a client closing early
+#endif
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < numWorkers; i++) {
+		workers.emplace_back(&extractDaemon::worker, this, i);
+	}
+	printf("Daemon running with %d workers\n", numWorkers);
+	fflush(stdout);
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stopping) {
+			m_wakeUp.wait_for(lock, std::chrono::milliseconds(STOP_CHECK_MS));
+			if (s_stopSignal) {
+				m_stopping = true;
+			}
+		}
+	}
+	m_wakeUp.notify_all();
+	printf("Stopping, waiting for running jobs\n");
+	fflush(stdout);
+	for (int i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_nextJob < m_jobs.size()) {
+		printf("%d queued jobs were not run\n", (int)(m_jobs.size() - m_nextJob));
+	}
+}
+
+bool extractDaemon::watchFolder(const std::string& watchPath) {
+	m_watchPath = watchPath;
+	if (!std::filesystem::is_directory(watchPath)) {
+		printf("Can't watch %s, not a folder\n", watchPath.c_str());
+		return false;
+	}
+#ifdef __linux__
+	// Watch before listing so nothing written in between is missed, the queue drops duplicates
+	m_watchFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (m_watchFd < 0 || inotify_add_watch(m_watchFd, watchPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		printf("Can't watch %s\n", watchPath.c_str());
+		return false;
+	}
+	for (const auto& entry : std::filesystem::directory_iterator(watchPath)) {
+		if (entry.is_regular_file() && isImageName(entry.path().filename().string())) {
+			addJob(entry.path().string());
+		}
+	}
+	m_threads.emplace_back(&extractDaemon::watchLoop, this);
+#else
+	m_threads.emplace_back(&extractDaemon::pollLoop, this);
+#endif
+	return true;
+}
+
+#ifdef __linux__
+void extractDaemon::watchLoop() {
+	alignas(inotify_event) char buffer[0x1000];
+	while (!isStopping()) {
+		pollfd watch = { m_watchFd, POLLIN, 0 };
+		if (poll(&watch, 1, STOP_CHECK_MS) <= 0) {
+			continue;
+		}
+		ssize_t size = read(m_watchFd, buffer, sizeof(buffer));
+		for (ssize_t offset = 0; offset < size; ) {
+			const inotify_event* event = (const inotify_event*)(buffer + offset);
+			if (event->len && !(event->mask & IN_ISDIR) && isImageName(event->name)) {
+				addJob(m_watchPath + "/" + event->name);
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+}
+#else
+void extractDaemon::watchLoop() {
+}
+#endif
+
+// Without inotify, files are queued once their size didn't change between two scans
+void extractDaemon::pollLoop() {
+	std::unordered_map<std::string, uintmax_t> pendingSizes;
+	std::unordered_map<std::string, uintmax_t> queuedSizes;
+	bool firstScan = true;
+	while (!isStopping()) {
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(m_watchPath, error)) {
+			std::string path = entry.path().string();
+			if (!entry.is_regular_file() || !isImageName(entry.path().filename().string())) {
+				continue;
+			}
+			uintmax_t size = entry.file_size(error);
+			auto queued = queuedSizes.find(path);
+			if (queued != queuedSizes.end() && queued->second == size) {
+				continue;
+			}
+			auto pending = pendingSizes.find(path);
+			if (firstScan || (pending != pendingSizes.end() && pending->second == size)) {
+				addJob(path);
+				queuedSizes[path] = size;
+				pendingSizes.erase(path);
+			}
+			else {
+				pendingSizes[path] = size;
+			}
+		}
+		firstScan = false;
+		for (int waited = 0; waited < POLL_INTERVAL_MS && !isStopping(); waited += STOP_CHECK_MS) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(STOP_CHECK_MS));
+		}
+	}
+}
+
+#ifdef _WIN32
+
+bool extractDaemon::listen(const std::string& socketPath) {
+	printf("The daemon socket isn't available on Windows, watch a folder instead\n");
+	return false;
+}
+
+void extractDaemon::socketLoop() {
+}
+
+void extractDaemon::handleClient(int client) {
+}
+
+#else
+
+bool extractDaemon::listen(const std::string& socketPath) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		printf("Socket path %s is too long\n", socketPath.c_str());
+		return false;
+	}
+	strcpy(address.sun_path, socketPath.c_str());
+
+	m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listenFd < 0) {
+		printf("Can't create a socket\n");
+		return false;
+	}
+	// Left behind by a daemon that didn't stop cleanly
+	unlink(socketPath.c_str());
+	if (bind(m_listenFd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(m_listenFd, 8) != 0) {
+		printf("Can't listen on %s\n", socketPath.c_str());
+		close(m_listenFd);
+		m_listenFd = -1;
+		return false;
+	}
+	m_socketPath = socketPath;
+	m_threads.emplace_back(&extractDaemon::socketLoop, this);
+	return true;
+}
+
+void extractDaemon::socketLoop() {
+	while (!isStopping()) {
+		pollfd listenPoll = { m_listenFd, POLLIN, 0 };
+		if (poll(&listenPoll, 1, STOP_CHECK_MS) <= 0) {
+			continue;
+		}
+		int client = accept(m_listenFd, nullptr, nullptr);
+		if (client < 0) {
+			continue;
+		}
+		handleClient(client);
+		close(client);
+	}
+}
+
+// Clients are served one at a time, commands are short
+void extractDaemon::handleClient(int client) {
+	std::string received;
+	while (!isStopping()) {
+		pollfd clientPoll = { client, POLLIN, 0 };
+		int ready = poll(&clientPoll, 1, STOP_CHECK_MS);
+		if (ready == 0) {
+			continue;
+		}
+		char buffer[0x400];
+		ssize_t size = ready > 0 ? recv(client, buffer, sizeof(buffer), 0) : -1;
+		if (size <= 0) {
+			return;
+		}
+		received.append(buffer, size);
+
+		size_t end;
+		while ((end = received.find('\n')) != std::string::npos) {
+			std::string line = received.substr(0, end);
+			received.erase(0, end + 1);
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+
+			std::string answer;
+			if (line.rfind("extract ", 0) == 0) {
+				std::string imagePath = line.substr(strlen("extract "));
+				std::string outputPath;
+				size_t tab = imagePath.find('\t');
+				if (tab != std::string::npos) {
+					outputPath = imagePath.substr(tab + 1);
+					imagePath = imagePath.substr(0, tab);
+				}
+				if (!std::filesystem::is_regular_file(imagePath)) {
+					answer = "error no image " + imagePath + "\n";
+				}
+				else if (uint64_t id = addJob(imagePath, outputPath)) {
+					answer = "ok " + std::to_string(id) + "\n";
+				}
+				else {
+					answer = "error already queued\n";
+				}
+			}
+			else if (line == "status") {
+				answer = getStatus() + "ok\n";
+			}
+			else if (line == "quit") {
+				answer = "ok\n";
+				stop();
+			}
+			else {
+				answer = "error unknown command\n";
+			}
+			if (send(client, answer.data(), answer.size(), MSG_NOSIGNAL) != (ssize_t)answer.size()) {
+				return;
+			}
+		}
+	}
+}
+
+#endif
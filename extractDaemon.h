@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+// Long running extraction for an ingest station: images dropped into a watched folder (inotify on Linux, polling
+// elsewhere) or sent over a local UNIX socket are queued and run by a pool of workers that lives as long as the
+// daemon, so whatever the job function keeps open (content store index, worker threads) stays warm between images.
+// Socket commands, one per line: "extract <image>[<tab><output folder>]", "status", "quit". Every answer ends
+// with a line starting with "ok" or "error".
+class extractDaemon {
+public:
+	// Runs on worker workerIndex, in [0, numWorkers), returns false when the job failed
+	typedef std::function<bool(int workerIndex, const std::string& imagePath, const std::string& outputPath)> tJobFunction;
+
+	enum eJobState {
+		JOB_QUEUED,
+		JOB_RUNNING,
+		JOB_DONE,
+		JOB_FAILED,
+	};
+	struct sJob {
+		uint64_t m_id;
+		std::string m_imagePath;
+		std::string m_outputPath;
+		eJobState m_state;
+		double m_queueTime;
+		double m_startTime;
+		double m_endTime;
+	};
+
+	// Images go to outputRoot/<image name> unless the socket command names another folder
+	extractDaemon(const std::string& outputRoot);
+	~extractDaemon();
+
+	// Queues the images already in watchPath, then every one written (closed) or moved into it
+	bool watchFolder(const std::string& watchPath);
+	// Not available on Windows
+	bool listen(const std::string& socketPath);
+	// Runs jobs until "quit", SIGINT or SIGTERM, then waits for the running ones
+	void run(int numWorkers, const tJobFunction& jobFunction);
+	void stop();
+
+	// Returns the job ID, 0 when the image is already queued or running
+	uint64_t addJob(const std::string& imagePath, const std::string& outputPath = "");
+	// One line per job still remembered
+	std::string getStatus();
+
+private:
+	bool isStopping();
+	void watchLoop();
+	void pollLoop();
+	void socketLoop();
+	void handleClient(int client);
+	void worker(int workerIndex);
+
+	std::string m_outputRoot;
+	std::string m_watchPath;
+	std::string m_socketPath;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+	std::deque<sJob> m_jobs; // in queue order, the oldest finished ones are forgotten
+	size_t m_nextJob = 0; // first queued job in m_jobs
+	uint64_t m_nextId = 1;
+	bool m_stopping = false;
+	tJobFunction m_jobFunction;
+
+	int m_watchFd = -1; // inotify
+	int m_listenFd = -1;
+	std::vector<std::thread> m_threads; // watcher and socket listener
+};
@@ -0,0 +1,107 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "extractJournal.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <filesystem>
+#include <system_error>
+
+extractJournal::~extractJournal() {
+	close();
+}
+
+bool extractJournal::open(const std::string& journalFileName, bool resume) {
+	close();
+	m_entries.clear();
+
+	if (resume) {
+		if (FILE* fJournal = fopen(journalFileName.c_str(), "r")) {
+			char line[4096];
+			while (fgets(line, sizeof(line), fJournal)) {
+				// CNID fork size xxh64 crc32c path
+				sEntry entry;
+				char fork;
+				int pathStart = 0;
+				if (sscanf(line, "%" SCNu32 "\t%c\t%" SCNu64 "\t%" SCNx64 "\t%" SCNx32 "\t%n", &entry.m_CNID, &fork, &entry.m_size, &entry.m_checksums.m_xxh64, &entry.m_checksums.m_crc32c, &pathStart) != 5 || pathStart == 0) {
+					continue; // torn last line
+				}
+				entry.m_fork = (eFork)fork;
+				entry.m_outputPath = line + pathStart;
+				if (entry.m_outputPath.empty() || entry.m_outputPath.back() != '\n') {
+					continue;
+				}
+				entry.m_outputPath.pop_back();
+				m_entries[entry.m_outputPath] = entry;
+			}
+			fclose(fJournal);
+		}
+	}
+
+	m_file = fopen(journalFileName.c_str(), resume ? "a" : "w");
+	return m_file != nullptr;
+}
+
+void extractJournal::close() {
+	if (m_file) {
+		flush();
+		fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+const extractJournal::sEntry* extractJournal::findDone(const std::string& outputPath, uint64_t expectedSize) const {
+	auto entry = m_entries.find(outputPath);
+	if (entry == m_entries.end()) {
+		return nullptr;
+	}
+	if (expectedSize != UINT64_MAX && entry->second.m_size != expectedSize) {
+		return nullptr;
+	}
+	std::error_code error;
+	uint64_t sizeOnDisk = std::filesystem::file_size(outputPath, error);
+	if (error || sizeOnDisk != entry->second.m_size) {
+		return nullptr;
+	}
+	// A torn or corrupted output can still have the right size, its content must match the journaled checksums
+	FILE* fOutput = fopen(outputPath.c_str(), "rb");
+	if (fOutput == nullptr) {
+		return nullptr;
+	}
+	checksumStream checksum;
+	std::vector<uint8_t> buffer(0x100000);
+	while (size_t numRead = fread(buffer.data(), 1, buffer.size(), fOutput)) {
+		checksum.update(buffer.data(), numRead);
+	}
+	fclose(fOutput);
+	sChecksums checksums = checksum.digest();
+	if (checksums.m_xxh64 != entry->second.m_checksums.m_xxh64 || checksums.m_crc32c != entry->second.m_checksums.m_crc32c) {
+		return nullptr;
+	}
+	return &entry->second;
+}
+
+void extractJournal::addEntry(uint32_t CNID, eFork fork, uint64_t size, const sChecksums& checksums, const std::string& outputPath) {
+	sEntry& entry = m_pending.emplace_back();
+	entry.m_CNID = CNID;
+	entry.m_fork = fork;
+	entry.m_size = size;
+	entry.m_checksums = checksums;
+	entry.m_outputPath = outputPath;
+	if (m_pending.size() >= s_batchSize) {
+		flush();
+	}
+}
+
+void extractJournal::flush() {
+	if (m_file == nullptr) {
+		return;
+	}
+	for (int i = 0; i < m_pending.size(); i++) {
+		sEntry& entry = m_pending[i];
+		fprintf(m_file, "%u\t%c\t%" PRIu64 "\t%016" PRIx64 "\t%08" PRIx32 "\t%s\n", entry.m_CNID, entry.m_fork, entry.m_size, entry.m_checksums.m_xxh64, entry.m_checksums.m_crc32c, entry.m_outputPath.c_str());
+		m_entries[entry.m_outputPath] = entry;
+	}
+	m_pending.clear();
+	fflush(m_file);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "hash.h"
+
+// Append-only record of the outputs already written for a tape (CNID, fork, size, checksums, path), so an interrupted run can resume.
+// Entries are buffered and flushed in batches, a crash only loses the last batch.
+class extractJournal {
+public:
+	enum eFork : char {
+		FORK_DATA = 'D',
+		FORK_RESOURCE = 'R',
+		FORK_IMAGE = 'I', // session .dsk and other whole outputs
+	};
+
+	struct sEntry {
+		uint32_t m_CNID;
+		eFork m_fork;
+		uint64_t m_size;
+		sChecksums m_checksums;
+		std::string m_outputPath;
+	};
+
+	~extractJournal();
+
+	// resume: keep and honour the previous entries, otherwise start a new journal
+	bool open(const std::string& journalFileName, bool resume);
+	void close();
+
+	// Returns the entry when the output was journaled and is still on disk with the journaled size and checksums
+	const sEntry* findDone(const std::string& outputPath, uint64_t expectedSize = UINT64_MAX) const;
+	void addEntry(uint32_t CNID, eFork fork, uint64_t size, const sChecksums& checksums, const std::string& outputPath);
+	void flush();
+
+	uint64_t m_numSkipped = 0;
+
+private:
+	static const int s_batchSize = 64;
+
+	FILE* m_file = nullptr;
+	std::unordered_map<std::string, sEntry> m_entries;
+	std::vector<sEntry> m_pending;
+};
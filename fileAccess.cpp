@@ -1,2 +1,240 @@
 #include "fileAccess.h"
 #include <assert.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef _WIN32
+
+bool positionalFile::open(const std::string& path, bool write) {
+	close();
+	HANDLE handle = CreateFileA(path.c_str(), write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, nullptr, write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	m_handle = handle;
+	return true;
+}
+
+bool positionalFile::openDirect(const std::string& path) {
+	close();
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	m_handle = handle;
+	return true;
+}
+
+void positionalFile::adviseSequential() {
+}
+
+void positionalFile::adviseDontNeed(int64_t offset, int64_t size) {
+}
+
+void positionalFile::close() {
+	if (m_handle) {
+		CloseHandle(m_handle);
+		m_handle = nullptr;
+	}
+}
+
+int64_t positionalFile::getSize() {
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_handle, &size)) {
+		return -1;
+	}
+	return size.QuadPart;
+}
+
+bool positionalFile::setSize(int64_t size) {
+	FILE_END_OF_FILE_INFO info;
+	info.EndOfFile.QuadPart = size;
+	return SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+}
+
+int64_t positionalFile::readAt(int64_t offset, void* output, int64_t size) {
+	int64_t total = 0;
+	while (total < size) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset + total);
+		overlapped.OffsetHigh = (DWORD)((offset + total) >> 32);
+		DWORD chunkSize = (DWORD)std::min<int64_t>(size - total, 0x40000000);
+		DWORD numBytesRead = 0;
+		if (!ReadFile(m_handle, (uint8_t*)output + total, chunkSize, &numBytesRead, &overlapped) || numBytesRead == 0) {
+			break;
+		}
+		total += numBytesRead;
+	}
+	return total;
+}
+
+int64_t positionalFile::writeAt(int64_t offset, const void* input, int64_t size) {
+	int64_t total = 0;
+	while (total < size) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset + total);
+		overlapped.OffsetHigh = (DWORD)((offset + total) >> 32);
+		DWORD chunkSize = (DWORD)std::min<int64_t>(size - total, 0x40000000);
+		DWORD numBytesWritten = 0;
+		if (!WriteFile(m_handle, (const uint8_t*)input + total, chunkSize, &numBytesWritten, &overlapped) || numBytesWritten == 0) {
+			break;
+		}
+		total += numBytesWritten;
+	}
+	return total;
+}
+
+bool mappedFile::open(const std::string& path) {
+	close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	// The mapping keeps the file open
+	CloseHandle(file);
+	if (mapping == nullptr) {
+		return false;
+	}
+	m_data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == nullptr) {
+		CloseHandle(mapping);
+		return false;
+	}
+	m_mapping = mapping;
+	m_size = size.QuadPart;
+	return true;
+}
+
+void mappedFile::close() {
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+		m_data = nullptr;
+	}
+	if (m_mapping) {
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	m_size = 0;
+}
+
+#else
+
+bool positionalFile::open(const std::string& path, bool write) {
+	close();
+	m_fd = ::open(path.c_str(), write ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+	return m_fd >= 0;
+}
+
+bool positionalFile::openDirect(const std::string& path) {
+	close();
+#if defined(O_DIRECT)
+	m_fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+#elif defined(F_NOCACHE)
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if (m_fd >= 0 && fcntl(m_fd, F_NOCACHE, 1) != 0) {
+		close();
+	}
+#endif
+	return m_fd >= 0;
+}
+
+void positionalFile::adviseSequential() {
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+void positionalFile::adviseDontNeed(int64_t offset, int64_t size) {
+#ifdef POSIX_FADV_DONTNEED
+	posix_fadvise(m_fd, offset, size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+void positionalFile::close() {
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+int64_t positionalFile::getSize() {
+	struct stat status;
+	if (fstat(m_fd, &status) != 0) {
+		return -1;
+	}
+	return status.st_size;
+}
+
+bool positionalFile::setSize(int64_t size) {
+	return ftruncate(m_fd, size) == 0;
+}
+
+int64_t positionalFile::readAt(int64_t offset, void* output, int64_t size) {
+	int64_t total = 0;
+	while (total < size) {
+		ssize_t numBytesRead = pread(m_fd, (uint8_t*)output + total, size - total, offset + total);
+		if (numBytesRead <= 0) {
+			break;
+		}
+		total += numBytesRead;
+	}
+	return total;
+}
+
+int64_t positionalFile::writeAt(int64_t offset, const void* input, int64_t size) {
+	int64_t total = 0;
+	while (total < size) {
+		ssize_t numBytesWritten = pwrite(m_fd, (const uint8_t*)input + total, size - total, offset + total);
+		if (numBytesWritten <= 0) {
+			break;
+		}
+		total += numBytesWritten;
+	}
+	return total;
+}
+
+bool mappedFile::open(const std::string& path) {
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat status;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &status) == 0 && status.st_size > 0) {
+		data = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	// The mapping keeps the file open
+	::close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	m_data = (const uint8_t*)data;
+	m_size = status.st_size;
+	return true;
+}
+
+void mappedFile::close() {
+	if (m_data) {
+		munmap((void*)m_data, m_size);
+		m_data = nullptr;
+	}
+	m_size = 0;
+}
+
+#endif
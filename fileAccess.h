@@ -1,6 +1,68 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
 
+// Offsets, sizes and buffers of reads from a file opened with openDirect must be multiples of this
+static const int64_t DIRECT_IO_ALIGNMENT = 0x1000;
 
+// Positional file access (pread/pwrite), one handle can be shared between threads
+class positionalFile {
+public:
+	~positionalFile() {
+		close();
+	}
+	bool open(const std::string& path, bool write);
+	// Read only, bypassing the page cache (O_DIRECT, F_NOCACHE or FILE_FLAG_NO_BUFFERING). Fails where unsupported
+	bool openDirect(const std::string& path);
+	void close();
+
+	// Page cache hints for files read once, no-ops where unsupported
+	void adviseSequential();
+	void adviseDontNeed(int64_t offset, int64_t size);
+
+	int64_t getSize();
+	bool setSize(int64_t size);
+
+	// Both return the number of bytes transferred, short only on end of file or error
+	int64_t readAt(int64_t offset, void* output, int64_t size);
+	int64_t writeAt(int64_t offset, const void* input, int64_t size);
+
+#ifndef _WIN32
+	int getDescriptor() const {
+		return m_fd;
+	}
+#endif
+
+private:
+#ifdef _WIN32
+	void* m_handle = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
+
+// Read only memory mapping of a whole file
+class mappedFile {
+public:
+	~mappedFile() {
+		close();
+	}
+	bool open(const std::string& path);
+	void close();
+
+	const uint8_t* getData() const {
+		return m_data;
+	}
+	int64_t getSize() const {
+		return m_size;
+	}
+
+private:
+	const uint8_t* m_data = nullptr;
+	int64_t m_size = 0;
+#ifdef _WIN32
+	void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,86 @@
+#include "forkReader.h"
+#include "sessionAddressMap.h"
+
+#include <string.h>
+#include <algorithm>
+
+static const uint32_t ALLOCATION_BLOCK_SIZE = 0x9800;
+
+uint64_t getAllocationBlockTapeOffset(uint16_t allocationBlock) {
+	return (uint64_t)(allocationBlock - 0x26) * ALLOCATION_BLOCK_SIZE + 0x1000;
+}
+
+bool forkReader::open(tapeFile* fHandle, const sLeafNode& fileRecord, bool resourceFork, const sessionAddressMap* addressMap) {
+	if (fileRecord.m_type != 2) {
+		return false;
+	}
+	m_fHandle = fHandle;
+	m_extents.clear();
+
+	const uint32_t* extents = resourceFork ? fileRecord.m_FileRecord.m_firstResourceForkExtents : fileRecord.m_FileRecord.m_firstDataForkExtents;
+	uint64_t logicalSize = resourceFork ? fileRecord.m_FileRecord.m_resourceForkBlockSize : fileRecord.m_FileRecord.m_dataForkBlockSize;
+	uint32_t blockSize = addressMap ? addressMap->getAllocationBlockSize() : ALLOCATION_BLOCK_SIZE;
+
+	// Only the 3 extents of the catalog record, the extents overflow file isn't read
+	uint64_t forkOffset = 0;
+	for (int i = 0; i < 3 && forkOffset < logicalSize; i++) {
+		uint16_t extentStart = extents[i] >> 16;
+		uint16_t extentSize = extents[i] & 0xFFFF;
+		if (extentSize == 0) {
+			break;
+		}
+		uint64_t size = std::min<uint64_t>((uint64_t)extentSize * blockSize, logicalSize - forkOffset);
+		if (addressMap == nullptr) {
+			sExtent extent;
+			extent.m_forkOffset = forkOffset;
+			extent.m_size = size;
+			extent.m_tapeOffset = getAllocationBlockTapeOffset(extentStart);
+			m_extents.push_back(extent);
+			forkOffset += size;
+			continue;
+		}
+		// One extent per address map range crossed
+		uint64_t volumeOffset = addressMap->getAllocationBlockOffset(extentStart);
+		while (size) {
+			uint64_t contiguousSize;
+			sExtent extent;
+			extent.m_forkOffset = forkOffset;
+			extent.m_tapeOffset = addressMap->getTapeOffset(volumeOffset, &contiguousSize);
+			extent.m_size = contiguousSize ? std::min(size, contiguousSize) : size;
+			m_extents.push_back(extent);
+			volumeOffset += extent.m_size;
+			forkOffset += extent.m_size;
+			size -= extent.m_size;
+		}
+	}
+	m_size = forkOffset;
+	return true;
+}
+
+uint64_t forkReader::read(uint64_t offset, uint8_t* output, uint64_t size) {
+	uint64_t totalRead = 0;
+	for (int i = 0; i < m_extents.size() && size > 0; i++) {
+		const sExtent& extent = m_extents[i];
+		if (offset >= extent.m_forkOffset + extent.m_size) {
+			continue;
+		}
+		uint64_t offsetInExtent = offset - extent.m_forkOffset;
+		uint64_t chunkSize = std::min(size, extent.m_size - offsetInExtent);
+		if (extent.m_tapeOffset == -1) {
+			memset(output, 0, chunkSize);
+		}
+		else {
+			m_fHandle->seekToPosition(extent.m_tapeOffset + offsetInExtent);
+			for (uint64_t done = 0; done < chunkSize; ) {
+				int readSize = (int)std::min<uint64_t>(chunkSize - done, 0x40000000);
+				m_fHandle->readBuffer(output + done, readSize);
+				done += readSize;
+			}
+		}
+		output += chunkSize;
+		offset += chunkSize;
+		size -= chunkSize;
+		totalRead += chunkSize;
+	}
+	return totalRead;
+}
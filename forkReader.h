@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "btree.h"
+#include "tapeFile.h"
+
+class sessionAddressMap;
+
+// Tape offset of an HFS allocation block (0x9800 bytes, the first one holding file data is 0x26)
+uint64_t getAllocationBlockTapeOffset(uint16_t allocationBlock);
+
+// Positional reads of a file fork straight from the tape, through the extents of its catalog record
+class forkReader {
+public:
+	// Extents are placed through the session address map when there is one, with the default geometry otherwise
+	bool open(tapeFile* fHandle, const sLeafNode& fileRecord, bool resourceFork = false, const sessionAddressMap* addressMap = nullptr);
+	uint64_t getSize() const {
+		return m_size;
+	}
+
+	// Returns the number of bytes read, short only at the end of the fork
+	uint64_t read(uint64_t offset, uint8_t* output, uint64_t size);
+
+	struct sExtent {
+		uint64_t m_forkOffset;
+		uint64_t m_size;
+		int64_t m_tapeOffset; // -1 for zeros, not on the tape
+	};
+	// In fork order
+	const std::vector<sExtent>& getExtents() const {
+		return m_extents;
+	}
+
+private:
+	tapeFile* m_fHandle = nullptr;
+	std::vector<sExtent> m_extents;
+	uint64_t m_size = 0;
+};
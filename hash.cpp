@@ -0,0 +1,224 @@
+#include "hash.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32C_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE42
+#else
+#include <cpuid.h>
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int amount) {
+	return (value << amount) | (value >> (64 - amount));
+}
+
+static inline uint64_t readU64_LE(const uint8_t* data) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--) {
+		value = (value << 8) | data[i];
+	}
+	return value;
+}
+
+static inline uint32_t readU32_LE(const uint8_t* data) {
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static inline uint64_t round(uint64_t accumulator, uint64_t lane) {
+	accumulator += lane * PRIME64_2;
+	accumulator = rotateLeft(accumulator, 31);
+	return accumulator * PRIME64_1;
+}
+
+static inline uint64_t mergeAccumulator(uint64_t accumulator, uint64_t value) {
+	accumulator ^= round(0, value);
+	return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+void xxHash64::reset(uint64_t seed) {
+	m_seed = seed;
+	m_accumulators[0] = seed + PRIME64_1 + PRIME64_2;
+	m_accumulators[1] = seed + PRIME64_2;
+	m_accumulators[2] = seed;
+	m_accumulators[3] = seed - PRIME64_1;
+	m_totalSize = 0;
+	m_pendingSize = 0;
+}
+
+void xxHash64::update(const void* data, size_t size) {
+	const uint8_t* input = (const uint8_t*)data;
+	m_totalSize += size;
+
+	if (m_pendingSize + size < 32) {
+		memcpy(m_pending + m_pendingSize, input, size);
+		m_pendingSize += size;
+		return;
+	}
+
+	if (m_pendingSize) {
+		uint32_t fill = 32 - m_pendingSize;
+		memcpy(m_pending + m_pendingSize, input, fill);
+		for (int i = 0; i < 4; i++) {
+			m_accumulators[i] = round(m_accumulators[i], readU64_LE(m_pending + i * 8));
+		}
+		input += fill;
+		size -= fill;
+		m_pendingSize = 0;
+	}
+
+	while (size >= 32) {
+		for (int i = 0; i < 4; i++) {
+			m_accumulators[i] = round(m_accumulators[i], readU64_LE(input + i * 8));
+		}
+		input += 32;
+		size -= 32;
+	}
+
+	memcpy(m_pending, input, size);
+	m_pendingSize = size;
+}
+
+uint64_t xxHash64::digest() const {
+	uint64_t hash;
+	if (m_totalSize >= 32) {
+		hash = rotateLeft(m_accumulators[0], 1) + rotateLeft(m_accumulators[1], 7) + rotateLeft(m_accumulators[2], 12) + rotateLeft(m_accumulators[3], 18);
+		for (int i = 0; i < 4; i++) {
+			hash = mergeAccumulator(hash, m_accumulators[i]);
+		}
+	}
+	else {
+		hash = m_seed + PRIME64_5;
+	}
+	hash += m_totalSize;
+
+	const uint8_t* input = m_pending;
+	uint32_t size = m_pendingSize;
+	while (size >= 8) {
+		hash ^= round(0, readU64_LE(input));
+		hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+		input += 8;
+		size -= 8;
+	}
+	if (size >= 4) {
+		hash ^= readU32_LE(input) * PRIME64_1;
+		hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+		input += 4;
+		size -= 4;
+	}
+	while (size > 0) {
+		hash ^= (*input) * PRIME64_5;
+		hash = rotateLeft(hash, 11) * PRIME64_1;
+		input++;
+		size--;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+// CRC32C, slicing-by-8 tables for the software path
+struct sCrc32cTables {
+	uint32_t m_table[8][256];
+	sCrc32cTables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for (int j = 0; j < 8; j++) {
+				crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+			}
+			m_table[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; i++) {
+			for (int j = 1; j < 8; j++) {
+				m_table[j][i] = (m_table[j - 1][i] >> 8) ^ m_table[0][m_table[j - 1][i] & 0xFF];
+			}
+		}
+	}
+};
+static const sCrc32cTables s_crc32cTables;
+
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t* data, size_t size) {
+	const uint32_t(*table)[256] = s_crc32cTables.m_table;
+	while (size >= 8) {
+		uint32_t low = (data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24)) ^ crc;
+		uint32_t high = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+		crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+			table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+		data += 8;
+		size -= 8;
+	}
+	while (size--) {
+		crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+	}
+	return crc;
+}
+
+#ifdef CRC32C_SSE42
+TARGET_SSE42 static uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t size) {
+	uint64_t crc64 = crc;
+	while (size >= 8) {
+		uint64_t value;
+		memcpy(&value, data, 8);
+		crc64 = _mm_crc32_u64(crc64, value);
+		data += 8;
+		size -= 8;
+	}
+	crc = (uint32_t)crc64;
+	while (size--) {
+		crc = _mm_crc32_u8(crc, *data++);
+	}
+	return crc;
+}
+
+static bool detectSSE42() {
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuid(registers, 1);
+	return (registers[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	return (ecx & bit_SSE4_2) != 0;
+#endif
+}
+static const bool s_hasSSE42 = detectSSE42();
+#endif
+
+bool crc32c::isHardwareAccelerated() {
+#ifdef CRC32C_SSE42
+	return s_hasSSE42;
+#else
+	return false;
+#endif
+}
+
+uint32_t crc32c::compute(uint32_t crc, const void* data, size_t size) {
+	crc = ~crc;
+#ifdef CRC32C_SSE42
+	if (s_hasSSE42) {
+		return ~crc32cHardware(crc, (const uint8_t*)data, size);
+	}
+#endif
+	return ~crc32cSoftware(crc, (const uint8_t*)data, size);
+}
+
+void crc32c::update(const void* data, size_t size) {
+	m_crc = compute(m_crc, data, size);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Streaming XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+class xxHash64 {
+public:
+	xxHash64(uint64_t seed = 0) {
+		reset(seed);
+	}
+	void reset(uint64_t seed = 0);
+	void update(const void* data, size_t size);
+	uint64_t digest() const;
+
+private:
+	uint64_t m_accumulators[4];
+	uint64_t m_seed;
+	uint64_t m_totalSize;
+	uint8_t m_pending[32];
+	uint32_t m_pendingSize;
+};
+
+// CRC32C (Castagnoli), uses the SSE4.2 crc32 instruction when the CPU has it
+class crc32c {
+public:
+	void reset() {
+		m_crc = 0;
+	}
+	void update(const void* data, size_t size);
+	uint32_t digest() const {
+		return m_crc;
+	}
+
+	static uint32_t compute(uint32_t crc, const void* data, size_t size);
+	static bool isHardwareAccelerated();
+
+private:
+	uint32_t m_crc = 0;
+};
+
+// Checksums recorded for every extracted output
+struct sChecksums {
+	uint32_t m_crc32c = 0;
+	uint64_t m_xxh64 = 0;
+};
+
+class checksumStream {
+public:
+	void reset() {
+		m_crc32c.reset();
+		m_xxh64.reset();
+	}
+	void update(const void* data, size_t size) {
+		m_crc32c.update(data, size);
+		m_xxh64.update(data, size);
+	}
+	sChecksums digest() const {
+		sChecksums checksums;
+		checksums.m_crc32c = m_crc32c.digest();
+		checksums.m_xxh64 = m_xxh64.digest();
+		return checksums;
+	}
+
+private:
+	crc32c m_crc32c;
+	xxHash64 m_xxh64;
+};
@@ -0,0 +1,494 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "imageGenerator.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <random>
+#include <algorithm>
+#include <tuple>
+
+static const uint32_t SECTOR_SIZE = 0x200;
+static const uint32_t BLOCK_SIZE = 0x9800; // allocation block size used by DeskTape volumes
+static const uint32_t SECTORS_PER_BLOCK = BLOCK_SIZE / SECTOR_SIZE;
+static const uint32_t FIRST_DATA_BLOCK = 0x26;
+static const uint32_t NUM_SYSTEM_SECTORS = 4 + 0x804;
+
+typedef std::vector<uint8_t> tBytes;
+
+static void appendU8(tBytes& output, uint8_t value) {
+	output.push_back(value);
+}
+
+static void appendU16_BE(tBytes& output, uint16_t value) {
+	output.push_back(value >> 8);
+	output.push_back(value & 0xFF);
+}
+
+static void appendU32_BE(tBytes& output, uint32_t value) {
+	appendU16_BE(output, value >> 16);
+	appendU16_BE(output, value & 0xFFFF);
+}
+
+static void appendZeros(tBytes& output, size_t size) {
+	output.insert(output.end(), size, 0);
+}
+
+static void appendString(tBytes& output, const std::string& string, size_t paddedSize) {
+	output.insert(output.end(), string.begin(), string.end());
+	appendZeros(output, paddedSize - string.size());
+}
+
+static void writeU16_BE(uint8_t* output, uint16_t value) {
+	output[0] = value >> 8;
+	output[1] = value & 0xFF;
+}
+
+static void writeU32_BE(uint8_t* output, uint32_t value) {
+	writeU16_BE(output, value >> 16);
+	writeU16_BE(output + 2, value & 0xFFFF);
+}
+
+// Tape offset of an allocation block, as bTree::makeExtractJob expects it
+static uint64_t getBlockTapeOffset(uint32_t block) {
+	return (uint64_t)(block - FIRST_DATA_BLOCK) * BLOCK_SIZE + 0x1000;
+}
+
+struct sGeneratorFolder {
+	uint32_t m_CNID;
+	uint32_t m_parentCNID;
+	std::string m_name;
+};
+
+struct sGeneratorFile {
+	uint32_t m_CNID;
+	uint32_t m_parentCNID;
+	std::string m_name;
+	uint32_t m_size;
+	uint32_t m_startBlock;
+	uint32_t m_numBlocks;
+	uint32_t m_creationTime;
+	uint32_t m_modificationTime;
+};
+
+struct sCatalogRecord {
+	uint32_t m_sortParent;
+	std::string m_sortName;
+	tBytes m_key;
+	tBytes m_data;
+};
+
+static tBytes makeCatalogKey(uint32_t parentCNID, const std::string& name) {
+	tBytes key;
+	appendU8(key, 6 + name.size());
+	appendU8(key, 0);
+	appendU32_BE(key, parentCNID);
+	appendU8(key, name.size());
+	key.insert(key.end(), name.begin(), name.end());
+	return key;
+}
+
+static std::string toLower(const std::string& name) {
+	std::string lower = name;
+	for (int i = 0; i < lower.size(); i++) {
+		lower[i] = tolower(lower[i]);
+	}
+	return lower;
+}
+
+// Lays out records into 512 byte nodes: node descriptor, records, offsets table at the end (last record first)
+static tBytes makeNode(uint32_t next, uint32_t previous, uint8_t type, uint8_t level, const std::vector<tBytes>& records) {
+	tBytes node;
+	appendU32_BE(node, next);
+	appendU32_BE(node, previous);
+	appendU8(node, type);
+	appendU8(node, level);
+	appendU16_BE(node, records.size());
+	appendU16_BE(node, 0);
+	std::vector<uint16_t> offsets;
+	for (int i = 0; i < records.size(); i++) {
+		offsets.push_back(node.size());
+		node.insert(node.end(), records[i].begin(), records[i].end());
+	}
+	offsets.push_back(node.size());
+	assert(node.size() + offsets.size() * 2 <= SECTOR_SIZE);
+	node.resize(SECTOR_SIZE);
+	for (int i = 0; i < offsets.size(); i++) {
+		writeU16_BE(&node[SECTOR_SIZE - 2 * (i + 1)], offsets[i]);
+	}
+	return node;
+}
+
+static tBytes buildCatalog(const std::vector<sGeneratorFolder>& folders, const std::vector<sGeneratorFile>& files) {
+	std::vector<sCatalogRecord> records;
+	for (int i = 0; i < folders.size(); i++) {
+		const sGeneratorFolder& folder = folders[i];
+		sCatalogRecord folderRecord;
+		folderRecord.m_sortParent = folder.m_parentCNID;
+		folderRecord.m_sortName = toLower(folder.m_name);
+		folderRecord.m_key = makeCatalogKey(folder.m_parentCNID, folder.m_name);
+		appendU8(folderRecord.m_data, 1);
+		appendU8(folderRecord.m_data, 0);
+		appendU16_BE(folderRecord.m_data, 0); // flags
+		appendU16_BE(folderRecord.m_data, 0); // valence
+		appendU32_BE(folderRecord.m_data, folder.m_CNID);
+		appendU32_BE(folderRecord.m_data, 0xA1000000); // creation
+		appendU32_BE(folderRecord.m_data, 0xA2000000); // modification
+		appendU32_BE(folderRecord.m_data, 0); // backup
+		appendZeros(folderRecord.m_data, 48);
+		records.push_back(folderRecord);
+
+		sCatalogRecord threadRecord;
+		threadRecord.m_sortParent = folder.m_CNID;
+		threadRecord.m_key = makeCatalogKey(folder.m_CNID, "");
+		appendU8(threadRecord.m_data, 3);
+		appendU8(threadRecord.m_data, 0);
+		appendZeros(threadRecord.m_data, 8);
+		appendU32_BE(threadRecord.m_data, folder.m_parentCNID);
+		appendU8(threadRecord.m_data, folder.m_name.size());
+		appendString(threadRecord.m_data, folder.m_name, 31);
+		records.push_back(threadRecord);
+	}
+	for (int i = 0; i < files.size(); i++) {
+		const sGeneratorFile& file = files[i];
+		sCatalogRecord fileRecord;
+		fileRecord.m_sortParent = file.m_parentCNID;
+		fileRecord.m_sortName = toLower(file.m_name);
+		fileRecord.m_key = makeCatalogKey(file.m_parentCNID, file.m_name);
+		tBytes& data = fileRecord.m_data;
+		appendU8(data, 2);
+		appendU8(data, 0);
+		appendU8(data, 0); // flags
+		appendU8(data, 0); // file type
+		appendString(data, "TEXTttxt", 16); // finder info
+		appendU32_BE(data, file.m_CNID);
+		appendU16_BE(data, 0); // data fork start block
+		appendU32_BE(data, file.m_size);
+		appendU32_BE(data, file.m_numBlocks * BLOCK_SIZE);
+		appendU16_BE(data, 0); // resource fork start block
+		appendU32_BE(data, 0);
+		appendU32_BE(data, 0);
+		appendU32_BE(data, file.m_creationTime);
+		appendU32_BE(data, file.m_modificationTime);
+		appendU32_BE(data, 0); // backup
+		appendZeros(data, 16); // extended finder info
+		appendU16_BE(data, 0); // clump size
+		appendU32_BE(data, file.m_numBlocks ? ((file.m_startBlock << 16) | file.m_numBlocks) : 0);
+		appendU32_BE(data, 0);
+		appendU32_BE(data, 0);
+		appendZeros(data, 12); // resource fork extents
+		appendU32_BE(data, 0);
+		assert(data.size() == 102);
+		records.push_back(fileRecord);
+	}
+	std::sort(records.begin(), records.end(), [](const sCatalogRecord& a, const sCatalogRecord& b) {
+		return std::tie(a.m_sortParent, a.m_sortName) < std::tie(b.m_sortParent, b.m_sortName);
+	});
+
+	// Pack the leaves
+	std::vector<std::vector<int>> leaves;
+	std::vector<int> currentLeaf;
+	int currentSize = 14;
+	for (int i = 0; i < records.size(); i++) {
+		int recordSize = records[i].m_key.size() + (records[i].m_key.size() & 1) + records[i].m_data.size();
+		if (currentSize + recordSize + 2 * (currentLeaf.size() + 2) > SECTOR_SIZE) {
+			leaves.push_back(currentLeaf);
+			currentLeaf.clear();
+			currentSize = 14;
+		}
+		currentLeaf.push_back(i);
+		currentSize += recordSize;
+	}
+	if (currentLeaf.size()) {
+		leaves.push_back(currentLeaf);
+	}
+
+	// Node 0 is the header, leaves are 1..N, index nodes follow
+	std::vector<tBytes> nodes;
+	uint32_t numLeaves = leaves.size();
+	for (uint32_t i = 0; i < numLeaves; i++) {
+		std::vector<tBytes> nodeRecords;
+		for (int j = 0; j < leaves[i].size(); j++) {
+			const sCatalogRecord& record = records[leaves[i][j]];
+			tBytes nodeRecord = record.m_key;
+			if (nodeRecord.size() & 1) {
+				appendU8(nodeRecord, 0);
+			}
+			nodeRecord.insert(nodeRecord.end(), record.m_data.begin(), record.m_data.end());
+			nodeRecords.push_back(nodeRecord);
+		}
+		uint32_t nodeIndex = i + 1;
+		nodes.push_back(makeNode(i + 1 < numLeaves ? nodeIndex + 1 : 0, i > 0 ? nodeIndex - 1 : 0, 0xFF, 1, nodeRecords));
+	}
+
+	uint32_t rootNode = 1;
+	uint16_t treeDepth = 1;
+	if (numLeaves > 1) {
+		// Index levels, 11 pointers per node
+		std::vector<std::pair<tBytes, uint32_t>> level;
+		for (uint32_t i = 0; i < numLeaves; i++) {
+			level.push_back({ records[leaves[i][0]].m_key, i + 1 });
+		}
+		uint32_t nextNodeIndex = numLeaves + 1;
+		uint8_t height = 2;
+		while (true) {
+			std::vector<std::pair<tBytes, uint32_t>> newLevel;
+			for (int i = 0; i < level.size(); i += 11) {
+				std::vector<tBytes> nodeRecords;
+				for (int j = i; j < std::min<int>(i + 11, level.size()); j++) {
+					tBytes nodeRecord;
+					appendU8(nodeRecord, 0x25);
+					nodeRecord.insert(nodeRecord.end(), level[j].first.begin() + 1, level[j].first.end());
+					nodeRecord.resize(0x26);
+					appendU32_BE(nodeRecord, level[j].second);
+					nodeRecords.push_back(nodeRecord);
+				}
+				nodes.push_back(makeNode(0, 0, 0, height, nodeRecords));
+				newLevel.push_back({ level[i].first, nextNodeIndex++ });
+			}
+			if (newLevel.size() == 1) {
+				rootNode = newLevel[0].second;
+				break;
+			}
+			level = newLevel;
+			height++;
+		}
+		treeDepth = height;
+	}
+
+	uint32_t numUsedNodes = 1 + nodes.size();
+	uint32_t totalNodes = ((numUsedNodes * SECTOR_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE) * SECTORS_PER_BLOCK;
+	std::vector<tBytes> headerRecords(3);
+	tBytes& headerRecord = headerRecords[0];
+	appendU16_BE(headerRecord, treeDepth);
+	appendU32_BE(headerRecord, rootNode);
+	appendU32_BE(headerRecord, records.size());
+	appendU32_BE(headerRecord, 1); // first leaf
+	appendU32_BE(headerRecord, numLeaves); // last leaf
+	appendU16_BE(headerRecord, SECTOR_SIZE);
+	appendU16_BE(headerRecord, 0x25);
+	appendU32_BE(headerRecord, totalNodes);
+	appendU32_BE(headerRecord, totalNodes - numUsedNodes);
+	appendU16_BE(headerRecord, 0);
+	appendU32_BE(headerRecord, BLOCK_SIZE);
+	appendU8(headerRecord, 0);
+	appendU8(headerRecord, 0);
+	appendU32_BE(headerRecord, 0);
+	appendZeros(headerRecord, 64);
+	appendZeros(headerRecords[1], 128); // user data record
+	headerRecords[2].resize(32, 0xFF); // map record
+
+	tBytes catalog = makeNode(0, 0, 1, 0, headerRecords);
+	for (int i = 0; i < nodes.size(); i++) {
+		catalog.insert(catalog.end(), nodes[i].begin(), nodes[i].end());
+	}
+	catalog.resize(totalNodes * SECTOR_SIZE);
+	return catalog;
+}
+
+static void appendPartitionMapEntry(uint8_t* output, uint32_t numEntries, uint32_t startSector, uint32_t numSectors, const std::string& name, const std::string& type) {
+	tBytes entry;
+	appendU16_BE(entry, 0x504D); // 'PM'
+	appendU16_BE(entry, 0);
+	appendU32_BE(entry, numEntries);
+	appendU32_BE(entry, startSector);
+	appendU32_BE(entry, numSectors);
+	appendString(entry, name, 32);
+	appendString(entry, type, 32);
+	memcpy(output, entry.data(), entry.size());
+}
+
+bool generateImage(const std::string& outputFileName, const sGeneratorSettings& settings, std::vector<sGeneratedFile>* files) {
+	std::mt19937 random(settings.m_seed);
+	const uint32_t fileSizes[] = { 0, 10, 511, 512, 0x9800, 0x9801, 50000, 200000 };
+
+	tBytes tape(SECTOR_SIZE * 16);
+	writeU16_BE(&tape[0], 0x4454); // 'DT'
+	writeU32_BE(&tape[2], 0x00010002);
+
+	std::vector<sGeneratorFolder> folders;
+	folders.push_back({ 2, 1, "SynthVol" });
+	std::vector<sGeneratorFile> catalogFiles;
+	uint32_t nextCNID = 16;
+	uint32_t nextBlock = FIRST_DATA_BLOCK;
+	uint32_t previousSession = 0;
+
+	for (int session = 0; session < settings.m_numSessions; session++) {
+		uint32_t folderCNID = nextCNID++;
+		folders.push_back({ folderCNID, 2, "Folder " + std::to_string(session) });
+		uint32_t subFolderCNID = nextCNID++;
+		folders.push_back({ subFolderCNID, folderCNID, "Sub" });
+		const uint32_t parents[] = { 2, folderCNID, subFolderCNID };
+
+		for (int i = 0; i < settings.m_numFilesPerSession; i++) {
+			sGeneratorFile file;
+			file.m_CNID = nextCNID++;
+			file.m_parentCNID = parents[random() % 3];
+			file.m_name = "file " + std::to_string(session) + "-" + std::to_string(i) + ".txt";
+			file.m_size = fileSizes[random() % 8];
+			file.m_numBlocks = (file.m_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+			file.m_creationTime = 0xB0000000 + file.m_CNID;
+			file.m_modificationTime = 0xB1000000 + file.m_CNID;
+
+			// File data goes after everything already on tape
+			while (getBlockTapeOffset(nextBlock) < tape.size()) {
+				nextBlock++;
+			}
+			file.m_startBlock = nextBlock;
+			nextBlock += file.m_numBlocks;
+			uint64_t dataOffset = getBlockTapeOffset(file.m_startBlock);
+			tape.resize(std::max<uint64_t>(tape.size(), dataOffset + file.m_numBlocks * BLOCK_SIZE));
+
+			// A random 64 byte pattern per file
+			uint8_t pattern[64];
+			for (int j = 0; j < sizeof(pattern); j++) {
+				pattern[j] = random() & 0xFF;
+			}
+			for (uint32_t j = 0; j < file.m_size; j++) {
+				tape[dataOffset + j] = pattern[j % sizeof(pattern)];
+			}
+			catalogFiles.push_back(file);
+		}
+
+		if (session >= 1 && catalogFiles.size() >= 4) {
+			catalogFiles.erase(catalogFiles.begin()); // deleted
+			catalogFiles[0].m_modificationTime++; // modified
+			catalogFiles[1].m_CNID = nextCNID++; // replaced
+			catalogFiles[2].m_name = "renamed " + std::to_string(session) + ".txt"; // renamed
+		}
+
+		// Session region: header, partition map, DT info, then the HFS volume system area
+		tape.resize((tape.size() + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE);
+		uint32_t sessionStart = tape.size() / SECTOR_SIZE;
+		tBytes region((2 + NUM_SYSTEM_SECTORS) * SECTOR_SIZE);
+
+		tBytes header;
+		appendU16_BE(header, 0x524D); // 'RM'
+		appendU16_BE(header, session);
+		appendU16_BE(header, session);
+		appendU16_BE(header, 0);
+		appendU16_BE(header, session == settings.m_numSessions - 1 ? 1 : 0);
+		appendU16_BE(header, 1); // numSpans
+		appendU32_BE(header, sessionStart + NUM_SYSTEM_SECTORS);
+		appendU32_BE(header, 0);
+		appendU32_BE(header, 0);
+		appendU16_BE(header, 0);
+		appendU16_BE(header, 0);
+		appendU32_BE(header, 0x20000);
+		appendString(header, "DT 2.0  ", 8);
+		appendU32_BE(header, previousSession);
+		appendU32_BE(header, sessionStart);
+		appendU32_BE(header, NUM_SYSTEM_SECTORS);
+		appendU32_BE(header, 0);
+		appendU32_BE(header, 0); // span 0
+		appendU32_BE(header, NUM_SYSTEM_SECTORS);
+		memcpy(region.data(), header.data(), header.size());
+
+		uint32_t numAllocationBlocks = std::max<uint32_t>(nextBlock + 4, 0x30);
+		appendPartitionMapEntry(&region[2 * SECTOR_SIZE], 3, 1, 3, "Apple", "Apple_partition_map");
+		appendPartitionMapEntry(&region[3 * SECTOR_SIZE], 3, 4, 1, "DTInfo", "Apple_Data");
+		appendPartitionMapEntry(&region[4 * SECTOR_SIZE], 3, 5, 4 + numAllocationBlocks * SECTORS_PER_BLOCK, "Vol", "Apple_HFS");
+		uint32_t startOfData = 4 + FIRST_DATA_BLOCK * SECTORS_PER_BLOCK + 2;
+		writeU32_BE(&region[5 * SECTOR_SIZE + 0x36], startOfData - 0xA);
+
+		if (numAllocationBlocks > 0xFFFF) {
+			printf("Session %d needs more than 65535 allocation blocks, use fewer files\n", session);
+			return false;
+		}
+
+		// Bitmap from sector 3, allocation block 0 (the extents file) right after it, then the catalog
+		const uint32_t HFSStart = 6 * SECTOR_SIZE;
+		uint32_t numBitmapSectors = (numAllocationBlocks + SECTOR_SIZE * 8 - 1) / (SECTOR_SIZE * 8);
+		uint32_t allocationBlockStart = 3 + numBitmapSectors;
+		tBytes catalog = buildCatalog(folders, catalogFiles);
+		uint32_t numCatalogBlocks = (catalog.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		if (allocationBlockStart + (1 + numCatalogBlocks) * SECTORS_PER_BLOCK > NUM_SYSTEM_SECTORS - 4) {
+			printf("Catalog of session %d doesn't fit in the system area, use fewer files per session\n", session);
+			return false;
+		}
+
+		tBytes MDB;
+		appendU16_BE(MDB, 0x4244); // 'BD'
+		appendU32_BE(MDB, 0xA0000000);
+		appendU32_BE(MDB, 0xA0000001 + session);
+		appendU16_BE(MDB, 0);
+		appendU16_BE(MDB, 0);
+		appendU16_BE(MDB, 3); // bitmap block
+		appendU16_BE(MDB, 0);
+		appendU16_BE(MDB, numAllocationBlocks);
+		appendU32_BE(MDB, BLOCK_SIZE);
+		appendU32_BE(MDB, BLOCK_SIZE);
+		appendU16_BE(MDB, allocationBlockStart);
+		appendU32_BE(MDB, nextCNID);
+		appendU16_BE(MDB, 0);
+		appendU8(MDB, 8);
+		appendString(MDB, "SynthVol", 27);
+		appendU32_BE(MDB, 0);
+		appendU16_BE(MDB, 0);
+		appendU32_BE(MDB, 0);
+		appendU32_BE(MDB, BLOCK_SIZE);
+		appendU32_BE(MDB, BLOCK_SIZE);
+		appendU16_BE(MDB, 0);
+		appendU32_BE(MDB, catalogFiles.size());
+		appendU32_BE(MDB, folders.size());
+		appendZeros(MDB, 32);
+		appendU16_BE(MDB, 0);
+		appendU32_BE(MDB, 0);
+		appendU32_BE(MDB, BLOCK_SIZE); // extents file: one block at 0
+		appendU32_BE(MDB, (0 << 16) | 1);
+		appendU32_BE(MDB, 0);
+		appendU32_BE(MDB, 0);
+		appendU32_BE(MDB, numCatalogBlocks * BLOCK_SIZE); // catalog file right after it
+		appendU32_BE(MDB, (1 << 16) | numCatalogBlocks);
+		appendU32_BE(MDB, 0);
+		appendU32_BE(MDB, 0);
+		memcpy(&region[HFSStart + 0x400], MDB.data(), MDB.size());
+
+		uint8_t* bitmap = &region[HFSStart + 3 * SECTOR_SIZE];
+		for (uint32_t block = 0; block < 1 + numCatalogBlocks; block++) {
+			bitmap[block / 8] |= 0x80 >> (block % 8);
+		}
+		for (int i = 0; i < catalogFiles.size(); i++) {
+			for (uint32_t block = catalogFiles[i].m_startBlock; block < catalogFiles[i].m_startBlock + catalogFiles[i].m_numBlocks; block++) {
+				bitmap[block / 8] |= 0x80 >> (block % 8);
+			}
+		}
+
+		memcpy(&region[HFSStart + (allocationBlockStart + SECTORS_PER_BLOCK) * SECTOR_SIZE], catalog.data(), catalog.size());
+		tape.insert(tape.end(), region.begin(), region.end());
+		previousSession = sessionStart;
+	}
+	appendZeros(tape, SECTOR_SIZE * 16);
+
+	FILE* fOutput = fopen(outputFileName.c_str(), "wb");
+	if (fOutput == nullptr) {
+		printf("Can't create %s\n", outputFileName.c_str());
+		return false;
+	}
+	if (settings.m_cptp) {
+		// 0x10 byte header, 0x11 byte trailer after each sector, 2 bytes at the end
+		uint8_t cptpHeader[0x10] = { 'C', 'P', 'T', 'P', 'H', 'D', 'R', '0' };
+		uint8_t trailer[0x11];
+		memset(trailer, 0xEE, sizeof(trailer));
+		fwrite(cptpHeader, 1, sizeof(cptpHeader), fOutput);
+		for (size_t i = 0; i < tape.size(); i += SECTOR_SIZE) {
+			fwrite(&tape[i], 1, SECTOR_SIZE, fOutput);
+			fwrite(trailer, 1, sizeof(trailer), fOutput);
+		}
+		uint8_t footer[2] = { 0, 0 };
+		fwrite(footer, 1, sizeof(footer), fOutput);
+	}
+	else {
+		fwrite(tape.data(), 1, tape.size(), fOutput);
+	}
+	fclose(fOutput);
+
+	if (files) {
+		files->clear();
+		for (int i = 0; i < catalogFiles.size(); i++) {
+			files->push_back({ catalogFiles[i].m_CNID, catalogFiles[i].m_parentCNID, catalogFiles[i].m_name, catalogFiles[i].m_size });
+		}
+	}
+	return true;
+}
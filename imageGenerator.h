@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Writes synthetic DeskTape images: 'DT' header, 'RM' sessions with a span and back-links, partition map,
+// HFS MDB and bitmap, a catalog B-tree (with index nodes when it needs more than one leaf) and the file data.
+// From the second session on, one file is deleted, one modified, one replaced and one renamed so session deltas have something to find.
+struct sGeneratorSettings {
+	int m_numSessions = 2;
+	int m_numFilesPerSession = 20;
+	uint32_t m_seed = 1;
+	bool m_cptp = false;
+};
+
+struct sGeneratedFile {
+	uint32_t m_CNID;
+	uint32_t m_parentCNID;
+	std::string m_name;
+	uint64_t m_size;
+};
+
+// files receives the files of the last session
+bool generateImage(const std::string& outputFileName, const sGeneratorSettings& settings, std::vector<sGeneratedFile>* files = nullptr);
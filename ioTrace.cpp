@@ -0,0 +1,216 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "ioTrace.h"
+
+#include <string.h>
+#include <algorithm>
+
+static const uint32_t TRACE_VERSION = 1;
+
+tapeFile_trace::tapeFile_trace(tapeFile* tape) : m_tape(tape) {
+	m_numSectors = tape->getNumSectors();
+	m_position = tape->tellPosition();
+	m_stages.push_back("");
+}
+
+tapeFile_trace::~tapeFile_trace() {
+	if (m_trace) {
+		flushPendingRead();
+		fclose(m_trace);
+	}
+	delete m_tape;
+}
+
+bool tapeFile_trace::openTrace(const std::string& traceFileName) {
+	m_trace = fopen(traceFileName.c_str(), "wb");
+	if (m_trace == nullptr) {
+		return false;
+	}
+	fwrite("DTTR", 1, 4, m_trace);
+	fwrite(&TRACE_VERSION, sizeof(TRACE_VERSION), 1, m_trace);
+	m_start = std::chrono::steady_clock::now();
+	return true;
+}
+
+uint64_t tapeFile_trace::getTime() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void tapeFile_trace::writeVarint(uint64_t value) {
+	do {
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		if (value) {
+			byte |= 0x80;
+		}
+		fputc(byte, m_trace);
+	} while (value);
+}
+
+void tapeFile_trace::writeRecordHeader(uint8_t type, uint64_t time) {
+	fputc(type, m_trace);
+	writeVarint(time - m_lastTime);
+	m_lastTime = time;
+}
+
+void tapeFile_trace::flushPendingRead() {
+	if (m_hasPendingRead) {
+		writeRecordHeader(m_pendingRead.m_type, m_pendingRead.m_time);
+		writeVarint(m_pendingRead.m_offset);
+		writeVarint(m_pendingRead.m_length);
+		m_hasPendingRead = false;
+	}
+}
+
+void tapeFile_trace::recordSeek(uint64_t position) {
+	// Seeking where we already are doesn't move the head
+	if (m_trace && position != m_position) {
+		flushPendingRead();
+		writeRecordHeader(TRACE_SEEK, getTime());
+		writeVarint(position);
+	}
+	m_position = position;
+}
+
+void tapeFile_trace::recordRead(uint8_t type, uint64_t offset, uint64_t length) {
+	m_position = offset + length;
+	if (m_trace == nullptr) {
+		return;
+	}
+	if (m_hasPendingRead && m_pendingRead.m_type == type && m_pendingRead.m_offset + m_pendingRead.m_length == offset) {
+		m_pendingRead.m_length += length;
+		return;
+	}
+	flushPendingRead();
+	m_pendingRead.m_type = type;
+	m_pendingRead.m_time = getTime();
+	m_pendingRead.m_offset = offset;
+	m_pendingRead.m_length = length;
+	m_hasPendingRead = true;
+}
+
+void tapeFile_trace::setStage(const char* name) {
+	m_tape->setStage(name);
+	if (m_trace == nullptr) {
+		return;
+	}
+	flushPendingRead();
+	uint16_t stageIndex = 0;
+	while (stageIndex < m_stages.size() && m_stages[stageIndex] != name) {
+		stageIndex++;
+	}
+	if (stageIndex == m_stages.size()) {
+		m_stages.push_back(name);
+	}
+	size_t nameLength = std::min<size_t>(strlen(name), 0xFF);
+	fputc(TRACE_STAGE, m_trace);
+	writeVarint(stageIndex);
+	writeVarint(nameLength);
+	fwrite(name, 1, nameLength, m_trace);
+}
+
+void tapeFile_trace::seekToSector(int sector) {
+	recordSeek((uint64_t)sector * 0x200);
+	m_tape->seekToSector(sector);
+}
+
+void tapeFile_trace::seekToPosition(uint64_t position) {
+	recordSeek(position);
+	m_tape->seekToPosition(position);
+}
+
+void tapeFile_trace::readBuffer(uint8_t* output, int size) {
+	recordRead(TRACE_READ_BUFFER, m_position, size);
+	m_tape->readBuffer(output, size);
+}
+
+uint8_t tapeFile_trace::readU8() {
+	recordRead(TRACE_READ_U8, m_position, 1);
+	return m_tape->readU8();
+}
+
+void tapeFile_trace::readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) {
+	recordSeek((uint64_t)sectorIndex * 0x200);
+	recordRead(TRACE_READ_SECTOR, (uint64_t)sectorIndex * 0x200, 0x200);
+	m_tape->readSector(sectorIndex, output);
+}
+
+void tapeFile_trace::readSectors(int64_t firstSector, int numSectors, uint8_t* output) {
+	recordSeek(firstSector * 0x200);
+	recordRead(TRACE_READ_SECTORS, firstSector * 0x200, (uint64_t)numSectors * 0x200);
+	m_tape->readSectors(firstSector, numSectors, output);
+}
+
+static bool readVarint(FILE* fInput, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int byte = fgetc(fInput);
+		if (byte == EOF) {
+			return false;
+		}
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool readTrace(const std::string& traceFileName, std::vector<sTraceEvent>& events, std::vector<std::string>& stages) {
+	FILE* fInput = fopen(traceFileName.c_str(), "rb");
+	if (fInput == nullptr) {
+		return false;
+	}
+	char magic[4];
+	uint32_t version;
+	if (fread(magic, 1, 4, fInput) != 4 || memcmp(magic, "DTTR", 4) || fread(&version, sizeof(version), 1, fInput) != 1 || version != TRACE_VERSION) {
+		fclose(fInput);
+		return false;
+	}
+
+	events.clear();
+	stages.assign(1, "");
+	uint16_t currentStage = 0;
+	uint64_t time = 0;
+	bool valid = true;
+	int type;
+	while ((type = fgetc(fInput)) != EOF) {
+		if (type == TRACE_STAGE) {
+			uint64_t stageIndex, nameLength;
+			if (!readVarint(fInput, stageIndex) || !readVarint(fInput, nameLength) || stageIndex > 0xFFFF) {
+				valid = false;
+				break;
+			}
+			std::string name(nameLength, '\0');
+			if (fread(&name[0], 1, nameLength, fInput) != nameLength) {
+				valid = false;
+				break;
+			}
+			if (stageIndex >= stages.size()) {
+				stages.resize(stageIndex + 1);
+			}
+			stages[stageIndex] = name;
+			currentStage = stageIndex;
+			continue;
+		}
+
+		sTraceEvent event;
+		event.m_type = type;
+		event.m_stage = currentStage;
+		event.m_length = 0;
+		uint64_t timeDelta;
+		if (!readVarint(fInput, timeDelta) || !readVarint(fInput, event.m_offset)) {
+			valid = false;
+			break;
+		}
+		time += timeDelta;
+		event.m_time = time;
+		if (type != TRACE_SEEK && !readVarint(fInput, event.m_length)) {
+			valid = false;
+			break;
+		}
+		events.push_back(event);
+	}
+	fclose(fInput);
+	return valid;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "tapeFile.h"
+
+// Binary I/O trace: "DTTR" + u32 version, then records of a type byte followed by LEB128 varints.
+//  TRACE_STAGE:  stage id, name length, name bytes (the stage of the following records)
+//  TRACE_SEEK:   time delta (us), tape offset
+//  TRACE_READ_*: time delta (us), tape offset, length
+// Offsets are tape positions (as tellPosition), independent of the image format.
+enum eTraceRecord : uint8_t {
+	TRACE_STAGE = 'T',
+	TRACE_SEEK = 'K',
+	TRACE_READ_U8 = 'u', // consecutive readU8 calls are merged into one record
+	TRACE_READ_BUFFER = 'b',
+	TRACE_READ_SECTOR = 's',
+	TRACE_READ_SECTORS = 'm',
+};
+
+struct sTraceEvent {
+	uint8_t m_type;
+	uint16_t m_stage;
+	uint64_t m_time; // us since the start of the trace
+	uint64_t m_offset;
+	uint64_t m_length; // 0 for seeks
+};
+
+// Records every access made through it, then forwards to the wrapped tape (which it owns)
+class tapeFile_trace : public tapeFile {
+public:
+	tapeFile_trace(tapeFile* tape);
+	virtual ~tapeFile_trace();
+	bool openTrace(const std::string& traceFileName);
+
+	bool open(const char* path) override {
+		return m_tape->open(path);
+	}
+	virtual void seekToSector(int sector) override;
+	virtual uint64_t tellPosition() override {
+		return m_tape->tellPosition();
+	}
+	virtual void seekToPosition(uint64_t position) override;
+	virtual void readBuffer(uint8_t* output, int size) override;
+	virtual uint8_t readU8() override;
+	virtual void readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) override;
+	virtual void readSectors(int64_t firstSector, int numSectors, uint8_t* output) override;
+	virtual void setStage(const char* name) override;
+	virtual const sIOStats& getIOStats() const override {
+		return m_tape->getIOStats();
+	}
+
+private:
+	void recordSeek(uint64_t position);
+	void recordRead(uint8_t type, uint64_t offset, uint64_t length);
+	void flushPendingRead();
+	void writeRecordHeader(uint8_t type, uint64_t time);
+	void writeVarint(uint64_t value);
+	uint64_t getTime();
+
+	tapeFile* m_tape;
+	FILE* m_trace = nullptr;
+	std::chrono::steady_clock::time_point m_start;
+	uint64_t m_lastTime = 0;
+	uint64_t m_position = 0;
+	std::vector<std::string> m_stages;
+
+	bool m_hasPendingRead = false;
+	sTraceEvent m_pendingRead;
+};
+
+bool readTrace(const std::string& traceFileName, std::vector<sTraceEvent>& events, std::vector<std::string>& stages);
@@ -0,0 +1,200 @@
+#include "ioUring.h"
+
+#ifdef HAS_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+#include <vector>
+
+ioUring::~ioUring() {
+	close();
+}
+
+bool ioUring::init(unsigned numEntries) {
+	close();
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = (int)syscall(__NR_io_uring_setup, numEntries, &params);
+	if (fd < 0) {
+		return false;
+	}
+	m_fd = fd;
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMapping) {
+		m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+	}
+	m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (m_sqRing == MAP_FAILED) {
+		m_sqRing = nullptr;
+		close();
+		return false;
+	}
+	if (singleMapping) {
+		m_cqRing = m_sqRing;
+	}
+	else {
+		m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if (m_cqRing == MAP_FAILED) {
+			m_cqRing = nullptr;
+			close();
+			return false;
+		}
+	}
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if (m_sqes == MAP_FAILED) {
+		m_sqes = nullptr;
+		close();
+		return false;
+	}
+
+	uint8_t* sqRing = (uint8_t*)m_sqRing;
+	m_sqHead = (unsigned*)(sqRing + params.sq_off.head);
+	m_sqTail = (unsigned*)(sqRing + params.sq_off.tail);
+	m_sqMask = (unsigned*)(sqRing + params.sq_off.ring_mask);
+	m_sqArray = (unsigned*)(sqRing + params.sq_off.array);
+	m_sqEntries = params.sq_entries;
+	uint8_t* cqRing = (uint8_t*)m_cqRing;
+	m_cqHead = (unsigned*)(cqRing + params.cq_off.head);
+	m_cqTail = (unsigned*)(cqRing + params.cq_off.tail);
+	m_cqMask = (unsigned*)(cqRing + params.cq_off.ring_mask);
+	m_cqes = cqRing + params.cq_off.cqes;
+	return true;
+}
+
+void ioUring::close() {
+	if (m_sqes) {
+		munmap(m_sqes, m_sqesSize);
+	}
+	if (m_cqRing && m_cqRing != m_sqRing) {
+		munmap(m_cqRing, m_cqRingSize);
+	}
+	if (m_sqRing) {
+		munmap(m_sqRing, m_sqRingSize);
+	}
+	m_sqes = m_cqRing = m_sqRing = nullptr;
+	if (m_fd != -1) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	m_fixedBuffers = false;
+	m_numQueued = 0;
+}
+
+bool ioUring::registerBuffers(uint8_t* const* buffers, size_t bufferSize, int numBuffers) {
+	std::vector<iovec> iovecs(numBuffers);
+	for (int i = 0; i < numBuffers; i++) {
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = bufferSize;
+	}
+	m_fixedBuffers = syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, iovecs.data(), numBuffers) == 0;
+	return m_fixedBuffers;
+}
+
+bool ioUring::queue(uint8_t opcode, int fd, const void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex) {
+	unsigned tail = *m_sqTail;
+	if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+		return false;
+	}
+	unsigned index = tail & *m_sqMask;
+	io_uring_sqe* sqe = (io_uring_sqe*)m_sqes + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buffer;
+	sqe->len = size;
+	sqe->off = fileOffset;
+	sqe->user_data = userData;
+	if (bufferIndex != -1 && m_fixedBuffers) {
+		sqe->opcode = opcode == IORING_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+		sqe->buf_index = (uint16_t)bufferIndex;
+	}
+	m_sqArray[index] = index;
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+	m_numQueued++;
+	return true;
+}
+
+bool ioUring::queueRead(int fd, void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex) {
+	return queue(IORING_OP_READ, fd, buffer, size, fileOffset, userData, bufferIndex);
+}
+
+bool ioUring::queueWrite(int fd, const void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex) {
+	return queue(IORING_OP_WRITE, fd, buffer, size, fileOffset, userData, bufferIndex);
+}
+
+bool ioUring::submit(unsigned minCompletions) {
+	while (true) {
+		int result = (int)syscall(__NR_io_uring_enter, m_fd, m_numQueued, minCompletions, minCompletions ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (result >= 0) {
+			m_numQueued -= std::min<unsigned>(result, m_numQueued);
+			if (m_numQueued == 0 || minCompletions == 0) {
+				return true;
+			}
+			// Partly submitted, the rest goes with the next call
+			continue;
+		}
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+}
+
+bool ioUring::getCompletion(uint64_t& userData, int& result) {
+	unsigned head = *m_cqHead;
+	if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+	const io_uring_cqe* cqe = (const io_uring_cqe*)m_cqes + (head & *m_cqMask);
+	userData = cqe->user_data;
+	result = cqe->res;
+	__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+#else
+
+ioUring::~ioUring() {
+}
+
+bool ioUring::init(unsigned numEntries) {
+	return false;
+}
+
+void ioUring::close() {
+}
+
+bool ioUring::registerBuffers(uint8_t* const* buffers, size_t bufferSize, int numBuffers) {
+	return false;
+}
+
+bool ioUring::queueRead(int fd, void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex) {
+	return false;
+}
+
+bool ioUring::queueWrite(int fd, const void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex) {
+	return false;
+}
+
+bool ioUring::submit(unsigned minCompletions) {
+	return false;
+}
+
+bool ioUring::getCompletion(uint64_t& userData, int& result) {
+	return false;
+}
+
+bool ioUring::queue(uint8_t opcode, int fd, const void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex) {
+	return false;
+}
+
+#endif
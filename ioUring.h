@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAS_IO_URING 1
+#endif
+#endif
+
+// Minimal io_uring (Linux 5.6+) through the raw system calls, no liburing: operations are queued in the shared
+// submission ring, submitted together by one io_uring_enter and reaped from the completion ring.
+// init() fails where io_uring isn't there (other systems, old kernels, seccomp) and callers keep their usual path.
+class ioUring {
+public:
+	~ioUring();
+	bool init(unsigned numEntries);
+	void close();
+	bool isOpen() const {
+		return m_fd != -1;
+	}
+
+	// Buffers of the fixed operations, reads and writes into them skip the per operation page pinning.
+	// Without them (RLIMIT_MEMLOCK too low) operations fall back to plain reads and writes
+	bool registerBuffers(uint8_t* const* buffers, size_t bufferSize, int numBuffers);
+
+	// bufferIndex is the registered buffer holding buffer, -1 for any memory. Returns false when the ring is full
+	bool queueRead(int fd, void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex = -1);
+	bool queueWrite(int fd, const void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex = -1);
+
+	// Submits everything queued in one system call and waits for at least minCompletions. Returns false on error
+	bool submit(unsigned minCompletions = 0);
+	// The oldest completion not reaped yet, result is the byte count or -errno. Returns false when there is none
+	bool getCompletion(uint64_t& userData, int& result);
+
+	unsigned getNumQueued() const {
+		return m_numQueued;
+	}
+
+private:
+	bool queue(uint8_t opcode, int fd, const void* buffer, uint32_t size, uint64_t fileOffset, uint64_t userData, int bufferIndex);
+
+	int m_fd = -1;
+	bool m_fixedBuffers = false;
+	unsigned m_numQueued = 0;
+
+	void* m_sqRing = nullptr;
+	size_t m_sqRingSize = 0;
+	void* m_cqRing = nullptr;
+	size_t m_cqRingSize = 0;
+	void* m_sqes = nullptr;
+	size_t m_sqesSize = 0;
+
+	unsigned* m_sqHead = nullptr;
+	unsigned* m_sqTail = nullptr;
+	unsigned* m_sqMask = nullptr;
+	unsigned* m_sqArray = nullptr;
+	unsigned m_sqEntries = 0;
+	unsigned* m_cqHead = nullptr;
+	unsigned* m_cqTail = nullptr;
+	unsigned* m_cqMask = nullptr;
+	void* m_cqes = nullptr;
+};
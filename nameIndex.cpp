@@ -0,0 +1,309 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "nameIndex.h"
+#include "btree.h"
+#include "catalogIterator.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <numeric>
+
+static char lowerASCII(char character) {
+	return character >= 'A' && character <= 'Z' ? character + ('a' - 'A') : character;
+}
+
+static std::string toLowerASCII(const char* string) {
+	std::string lower = string;
+	for (int i = 0; i < lower.size(); i++) {
+		lower[i] = lowerASCII(lower[i]);
+	}
+	return lower;
+}
+
+static uint32_t getTrigramKey(const char* text) {
+	return ((uint32_t)(uint8_t)text[0] << 16) | ((uint32_t)(uint8_t)text[1] << 8) | (uint8_t)text[2];
+}
+
+// Unique trigram keys of an already lowercased name
+static std::vector<uint32_t> getTrigramKeys(const std::string& lowerName) {
+	std::vector<uint32_t> keys;
+	for (size_t i = 0; i + 3 <= lowerName.size(); i++) {
+		keys.push_back(getTrigramKey(&lowerName[i]));
+	}
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	return keys;
+}
+
+// strcmp ignoring ASCII case, over at most maxLength characters
+static int compareNames(const char* a, const char* b, size_t maxLength = SIZE_MAX) {
+	for (size_t i = 0; i < maxLength; i++) {
+		uint8_t lowerA = lowerASCII(a[i]);
+		uint8_t lowerB = lowerASCII(b[i]);
+		if (lowerA != lowerB || lowerA == 0) {
+			return lowerA - lowerB;
+		}
+	}
+	return 0;
+}
+
+static bool containsName(const char* name, const std::string& lowerText) {
+	size_t length = strlen(name);
+	for (size_t i = 0; i + lowerText.size() <= length; i++) {
+		if (compareNames(name + i, lowerText.c_str(), lowerText.size()) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t nameIndexWriter::addString(const std::string& string) {
+	uint64_t offset = m_strings.size();
+	m_strings.append(string.c_str(), string.size() + 1);
+	return offset;
+}
+
+void nameIndexWriter::beginTape(const std::string& tapeName) {
+	m_tapes.push_back(addString(tapeName));
+	m_tapeEntries.clear();
+}
+
+bool nameIndexWriter::addSession(tapeFile* fHandle, uint64_t catalogPosition, int sessionIndex) {
+	if (m_tapes.empty()) {
+		return false;
+	}
+	catalogFolderMap folders;
+	if (!folders.read(fHandle, catalogPosition)) {
+		return false;
+	}
+	catalogIterator iterator;
+	if (!iterator.open(fHandle, catalogPosition)) {
+		return false;
+	}
+	sLeafNode record;
+	while (iterator.next(record)) {
+		if (record.m_type != 1 && record.m_type != 2) {
+			// thread records
+			continue;
+		}
+		bool isFolder = record.m_type == 1;
+		std::string name = record.getName();
+		normalizeFilename(name);
+		std::string path = macRomanToUTF8(folders.getPath(record.getParentCNID(), name));
+		uint64_t size = isFolder ? 0 : (uint64_t)record.m_FileRecord.m_dataForkBlockSize + record.m_FileRecord.m_resourceForkBlockSize;
+		uint32_t modificationTime = isFolder ? record.m_FolderRecord.m_modificationTime : record.m_FileRecord.m_modificationTime;
+
+		std::string key = path;
+		key += '\0';
+		key += (char)record.m_type;
+		key.append((const char*)&size, sizeof(size));
+		key.append((const char*)&modificationTime, sizeof(modificationTime));
+		auto known = m_tapeEntries.find(key);
+		if (known != m_tapeEntries.end()) {
+			m_entries[known->second].m_sessionIndex = sessionIndex;
+			continue;
+		}
+
+		sNameIndexEntry entry = {};
+		entry.m_pathOffset = addString(path);
+		entry.m_size = size;
+		entry.m_tapeIndex = (uint32_t)m_tapes.size() - 1;
+		entry.m_modificationTime = modificationTime;
+		entry.m_sessionIndex = sessionIndex;
+		entry.m_nameStart = (uint16_t)(path.size() - macRomanToUTF8(name).size());
+		entry.m_type = record.m_type;
+		m_tapeEntries[key] = (uint32_t)m_entries.size();
+		m_entries.push_back(entry);
+	}
+	return true;
+}
+
+bool nameIndexWriter::write(const std::string& fileName) {
+	const char* strings = m_strings.data();
+
+	std::vector<uint32_t> names(m_entries.size());
+	std::iota(names.begin(), names.end(), 0);
+	std::sort(names.begin(), names.end(), [&](uint32_t a, uint32_t b) {
+		return compareNames(strings + m_entries[a].m_pathOffset + m_entries[a].m_nameStart, strings + m_entries[b].m_pathOffset + m_entries[b].m_nameStart) < 0;
+	});
+
+	// Every (trigram, entry) pair sorted gives each trigram its posting list in entry order
+	std::vector<uint64_t> pairs;
+	for (uint32_t i = 0; i < m_entries.size(); i++) {
+		std::vector<uint32_t> keys = getTrigramKeys(toLowerASCII(strings + m_entries[i].m_pathOffset + m_entries[i].m_nameStart));
+		for (int j = 0; j < keys.size(); j++) {
+			pairs.push_back(((uint64_t)keys[j] << 32) | i);
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+	std::vector<sNameIndexTrigram> trigrams;
+	std::vector<uint32_t> postings(pairs.size());
+	for (size_t i = 0; i < pairs.size(); i++) {
+		uint32_t key = (uint32_t)(pairs[i] >> 32);
+		if (trigrams.empty() || trigrams.back().m_key != key) {
+			trigrams.push_back({ key, 0, i });
+		}
+		trigrams.back().m_numPostings++;
+		postings[i] = (uint32_t)pairs[i];
+	}
+	pairs = std::vector<uint64_t>();
+
+	sNameIndexHeader header = {};
+	memcpy(header.m_magic, NAME_INDEX_MAGIC, sizeof(header.m_magic));
+	header.m_version = NAME_INDEX_VERSION;
+	header.m_numTapes = (uint32_t)m_tapes.size();
+	header.m_numEntries = (uint32_t)m_entries.size();
+	header.m_numTrigrams = trigrams.size();
+	// Sections are 8 byte aligned
+	auto align = [](uint64_t offset) { return (offset + 7) & ~7ull; };
+	header.m_tapesOffset = align(sizeof(header));
+	header.m_entriesOffset = align(header.m_tapesOffset + m_tapes.size() * sizeof(uint64_t));
+	header.m_namesOffset = align(header.m_entriesOffset + m_entries.size() * sizeof(sNameIndexEntry));
+	header.m_trigramsOffset = align(header.m_namesOffset + names.size() * sizeof(uint32_t));
+	header.m_postingsOffset = align(header.m_trigramsOffset + trigrams.size() * sizeof(sNameIndexTrigram));
+	header.m_stringsOffset = align(header.m_postingsOffset + postings.size() * sizeof(uint32_t));
+	header.m_stringsSize = m_strings.size();
+
+	FILE* fOutput = fopen(fileName.c_str(), "wb");
+	if (fOutput == nullptr) {
+		return false;
+	}
+	auto writeSection = [&](uint64_t offset, const void* data, size_t size) {
+		_fseeki64(fOutput, offset, SEEK_SET);
+		return fwrite(data, 1, size, fOutput) == size;
+	};
+	bool success = writeSection(0, &header, sizeof(header))
+		&& writeSection(header.m_tapesOffset, m_tapes.data(), m_tapes.size() * sizeof(uint64_t))
+		&& writeSection(header.m_entriesOffset, m_entries.data(), m_entries.size() * sizeof(sNameIndexEntry))
+		&& writeSection(header.m_namesOffset, names.data(), names.size() * sizeof(uint32_t))
+		&& writeSection(header.m_trigramsOffset, trigrams.data(), trigrams.size() * sizeof(sNameIndexTrigram))
+		&& writeSection(header.m_postingsOffset, postings.data(), postings.size() * sizeof(uint32_t))
+		&& writeSection(header.m_stringsOffset, m_strings.data(), m_strings.size());
+	return fclose(fOutput) == 0 && success;
+}
+
+// count elements of elementSize at offset fit in size bytes, without overflowing
+static bool isSectionInside(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size) {
+	return offset <= size && count <= (size - offset) / elementSize;
+}
+
+bool nameIndex::open(const std::string& fileName) {
+	if (!m_file.open(fileName) || m_file.getSize() < (int64_t)sizeof(sNameIndexHeader)) {
+		return false;
+	}
+	const uint8_t* data = m_file.getData();
+	uint64_t size = m_file.getSize();
+	m_header = (const sNameIndexHeader*)data;
+	if (memcmp(m_header->m_magic, NAME_INDEX_MAGIC, sizeof(NAME_INDEX_MAGIC)) != 0 || m_header->m_version != NAME_INDEX_VERSION) {
+		return false;
+	}
+	// Every section inside the file, the postings up to the string pool
+	if (!isSectionInside(m_header->m_tapesOffset, m_header->m_numTapes, sizeof(uint64_t), size)
+		|| !isSectionInside(m_header->m_entriesOffset, m_header->m_numEntries, sizeof(sNameIndexEntry), size)
+		|| !isSectionInside(m_header->m_namesOffset, m_header->m_numEntries, sizeof(uint32_t), size)
+		|| !isSectionInside(m_header->m_trigramsOffset, m_header->m_numTrigrams, sizeof(sNameIndexTrigram), size)
+		|| m_header->m_postingsOffset > m_header->m_stringsOffset
+		|| !isSectionInside(m_header->m_stringsOffset, m_header->m_stringsSize, 1, size)) {
+		return false;
+	}
+	m_tapes = (const uint64_t*)(data + m_header->m_tapesOffset);
+	m_entries = (const sNameIndexEntry*)(data + m_header->m_entriesOffset);
+	m_names = (const uint32_t*)(data + m_header->m_namesOffset);
+	m_trigrams = (const sNameIndexTrigram*)(data + m_header->m_trigramsOffset);
+	m_postings = (const uint32_t*)(data + m_header->m_postingsOffset);
+	m_strings = (const char*)(data + m_header->m_stringsOffset);
+
+	// A truncated or stale index mustn't make a query read outside of the mapping: every string ends in the pool,
+	// and every offset and index stored in the sections points inside its target
+	uint64_t stringsSize = m_header->m_stringsSize;
+	uint64_t numPostings = (m_header->m_stringsOffset - m_header->m_postingsOffset) / sizeof(uint32_t);
+	if ((stringsSize && m_strings[stringsSize - 1] != 0) || (stringsSize == 0 && (m_header->m_numTapes || m_header->m_numEntries))) {
+		return false;
+	}
+	for (uint32_t i = 0; i < m_header->m_numTapes; i++) {
+		if (m_tapes[i] >= stringsSize) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < m_header->m_numEntries; i++) {
+		const sNameIndexEntry& entry = m_entries[i];
+		if (entry.m_pathOffset >= stringsSize || entry.m_nameStart >= stringsSize - entry.m_pathOffset || entry.m_tapeIndex >= m_header->m_numTapes || m_names[i] >= m_header->m_numEntries) {
+			return false;
+		}
+	}
+	for (uint64_t i = 0; i < m_header->m_numTrigrams; i++) {
+		const sNameIndexTrigram& trigram = m_trigrams[i];
+		if (trigram.m_firstPosting > numPostings || trigram.m_numPostings > numPostings - trigram.m_firstPosting) {
+			return false;
+		}
+	}
+	for (uint64_t i = 0; i < numPostings; i++) {
+		if (m_postings[i] >= m_header->m_numEntries) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const sNameIndexTrigram* nameIndex::findTrigram(uint32_t key) {
+	const sNameIndexTrigram* end = m_trigrams + m_header->m_numTrigrams;
+	const sNameIndexTrigram* found = std::lower_bound(m_trigrams, end, key, [](const sNameIndexTrigram& trigram, uint32_t key) { return trigram.m_key < key; });
+	return found != end && found->m_key == key ? found : nullptr;
+}
+
+std::vector<uint32_t> nameIndex::findSubstring(const std::string& text, size_t maxResults) {
+	std::vector<uint32_t> results;
+	std::string lowerText = toLowerASCII(text.c_str());
+	if (lowerText.size() < 3) {
+		// No trigram to narrow it down
+		for (uint32_t i = 0; i < m_header->m_numEntries && results.size() < maxResults; i++) {
+			if (containsName(getName(m_entries[i]), lowerText)) {
+				results.push_back(i);
+			}
+		}
+		return results;
+	}
+
+	// Candidates are the entries holding every trigram of the text, walked from the rarest trigram
+	std::vector<const sNameIndexTrigram*> trigrams;
+	std::vector<uint32_t> keys = getTrigramKeys(lowerText);
+	for (int i = 0; i < keys.size(); i++) {
+		const sNameIndexTrigram* trigram = findTrigram(keys[i]);
+		if (trigram == nullptr) {
+			return results;
+		}
+		trigrams.push_back(trigram);
+	}
+	std::sort(trigrams.begin(), trigrams.end(), [](const sNameIndexTrigram* a, const sNameIndexTrigram* b) { return a->m_numPostings < b->m_numPostings; });
+
+	const uint32_t* candidates = m_postings + trigrams[0]->m_firstPosting;
+	for (uint32_t i = 0; i < trigrams[0]->m_numPostings && results.size() < maxResults; i++) {
+		uint32_t entryIndex = candidates[i];
+		bool hasAll = true;
+		for (int j = 1; j < trigrams.size() && hasAll; j++) {
+			const uint32_t* postings = m_postings + trigrams[j]->m_firstPosting;
+			hasAll = std::binary_search(postings, postings + trigrams[j]->m_numPostings, entryIndex);
+		}
+		// The trigrams can be anywhere in the name, check they follow each other
+		if (hasAll && containsName(getName(m_entries[entryIndex]), lowerText)) {
+			results.push_back(entryIndex);
+		}
+	}
+	return results;
+}
+
+std::vector<uint32_t> nameIndex::findPrefix(const std::string& text, size_t maxResults) {
+	std::vector<uint32_t> results;
+	const uint32_t* end = m_names + m_header->m_numEntries;
+	const uint32_t* first = std::lower_bound(m_names, end, text, [&](uint32_t entryIndex, const std::string& text) {
+		return compareNames(getName(m_entries[entryIndex]), text.c_str(), text.size()) < 0;
+	});
+	for (const uint32_t* name = first; name != end && results.size() < maxResults; name++) {
+		if (compareNames(getName(m_entries[*name]), text.c_str(), text.size()) != 0) {
+			break;
+		}
+		results.push_back(*name);
+	}
+	return results;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "tapeFile.h"
+#include "fileAccess.h"
+
+// Cross-tape search index of catalog names, written once from the catalogs of many images and memory mapped to
+// answer queries without opening any of them. Layout, native byte order, offsets from the start of the file:
+//   sNameIndexHeader
+//   tape names: m_numTapes offsets into the string pool
+//   entries: m_numEntries sNameIndexEntry, in tape order
+//   names: m_numEntries entry indices ordered by name, for prefix searches
+//   trigrams: m_numTrigrams sNameIndexTrigram ordered by key, for substring searches
+//   postings: the entry indices of each trigram, ascending
+//   string pool: zero terminated UTF-8 strings
+// Names are compared ignoring the case of ASCII letters, like trigram keys are built.
+
+static const char NAME_INDEX_MAGIC[4] = { 'D', 'T', 'N', 'I' };
+static const uint32_t NAME_INDEX_VERSION = 1;
+
+struct sNameIndexHeader {
+	char m_magic[4];
+	uint32_t m_version;
+	uint32_t m_numTapes;
+	uint32_t m_numEntries;
+	uint64_t m_numTrigrams;
+	uint64_t m_tapesOffset;
+	uint64_t m_entriesOffset;
+	uint64_t m_namesOffset;
+	uint64_t m_trigramsOffset;
+	uint64_t m_postingsOffset;
+	uint64_t m_stringsOffset;
+	uint64_t m_stringsSize;
+};
+
+struct sNameIndexEntry {
+	uint64_t m_pathOffset; // catalog path (Volume/Folder/Name) in the string pool
+	uint64_t m_size; // data + resource fork, 0 for folders
+	uint32_t m_tapeIndex;
+	uint32_t m_modificationTime; // HFS
+	uint16_t m_sessionIndex; // newest session of the tape holding this version
+	uint16_t m_nameStart; // name offset in the path
+	uint8_t m_type; // 1 folder, 2 file
+	uint8_t m_reserved[3];
+};
+
+struct sNameIndexTrigram {
+	uint32_t m_key; // 3 lowercased bytes
+	uint32_t m_numPostings;
+	uint64_t m_firstPosting;
+};
+
+class nameIndexWriter {
+public:
+	void beginTape(const std::string& tapeName);
+	// Sessions of a tape must be added oldest first. A file or folder unchanged since an earlier session of the
+	// same tape (same path, size and date) keeps a single entry, pointing to the newest session holding it
+	bool addSession(tapeFile* fHandle, uint64_t catalogPosition, int sessionIndex);
+	bool write(const std::string& fileName);
+
+	uint64_t getNumEntries() const {
+		return m_entries.size();
+	}
+
+private:
+	uint64_t addString(const std::string& string);
+
+	std::vector<uint64_t> m_tapes;
+	std::vector<sNameIndexEntry> m_entries;
+	std::string m_strings;
+	std::unordered_map<std::string, uint32_t> m_tapeEntries; // path, type, size and date to entry, current tape only
+};
+
+class nameIndex {
+public:
+	bool open(const std::string& fileName);
+
+	// Entry indices whose name contains text (tape order) or starts with it (name order), at most maxResults
+	std::vector<uint32_t> findSubstring(const std::string& text, size_t maxResults);
+	std::vector<uint32_t> findPrefix(const std::string& text, size_t maxResults);
+
+	uint32_t getNumEntries() const {
+		return m_header->m_numEntries;
+	}
+	const sNameIndexEntry& getEntry(uint32_t entryIndex) const {
+		return m_entries[entryIndex];
+	}
+	const char* getPath(const sNameIndexEntry& entry) const {
+		return m_strings + entry.m_pathOffset;
+	}
+	const char* getName(const sNameIndexEntry& entry) const {
+		return m_strings + entry.m_pathOffset + entry.m_nameStart;
+	}
+	const char* getTapeName(uint32_t tapeIndex) const {
+		return m_strings + m_tapes[tapeIndex];
+	}
+
+private:
+	const sNameIndexTrigram* findTrigram(uint32_t key);
+
+	mappedFile m_file;
+	const sNameIndexHeader* m_header = nullptr;
+	const uint64_t* m_tapes = nullptr;
+	const sNameIndexEntry* m_entries = nullptr;
+	const uint32_t* m_names = nullptr;
+	const sNameIndexTrigram* m_trigrams = nullptr;
+	const uint32_t* m_postings = nullptr;
+	const char* m_strings = nullptr;
+};
@@ -0,0 +1,312 @@
+#define _CRT_SECURE_NO_WARNINGS
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+
+#include "nbdServer.h"
+#include "virtualDisk.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET tSocket;
+#define closeSocket closesocket
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+typedef int tSocket;
+#define INVALID_SOCKET -1
+#define closeSocket close
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SIGPIPE is ignored instead
+#endif
+
+// https://github.com/NetworkBlockDevice/nbd/blob/master/doc/proto.md
+static const uint64_t NBD_MAGIC = 0x4E42444D41474943; // "NBDMAGIC"
+static const uint64_t NBD_IHAVEOPT = 0x49484156454F5054; // "IHAVEOPT"
+static const uint64_t NBD_REPLY_MAGIC = 0x0003E889045565A9;
+static const uint32_t NBD_REQUEST_MAGIC = 0x25609513;
+static const uint32_t NBD_SIMPLE_REPLY_MAGIC = 0x67446698;
+
+static const uint16_t NBD_FLAG_FIXED_NEWSTYLE = 1;
+static const uint16_t NBD_FLAG_NO_ZEROES = 2;
+static const uint16_t NBD_FLAG_HAS_FLAGS = 1;
+static const uint16_t NBD_FLAG_READ_ONLY = 2;
+
+static const uint32_t NBD_OPT_EXPORT_NAME = 1;
+static const uint32_t NBD_OPT_ABORT = 2;
+static const uint32_t NBD_OPT_INFO = 6;
+static const uint32_t NBD_OPT_GO = 7;
+
+static const uint32_t NBD_REP_ACK = 1;
+static const uint32_t NBD_REP_INFO = 3;
+static const uint32_t NBD_REP_ERR_UNSUP = 0x80000001;
+
+static const uint16_t NBD_CMD_READ = 0;
+static const uint16_t NBD_CMD_WRITE = 1;
+static const uint16_t NBD_CMD_DISC = 2;
+static const uint16_t NBD_CMD_FLUSH = 3;
+
+static const uint32_t NBD_EPERM = 1;
+static const uint32_t NBD_EINVAL = 22;
+
+// Largest request payload and option data accepted, a client can't make the server allocate more
+static const uint32_t MAX_REQUEST_LENGTH = 32 * 1024 * 1024;
+static const uint32_t MAX_OPTION_LENGTH = 0x10000;
+// Write payloads are discarded through a buffer of this size
+static const uint32_t DRAIN_CHUNK_SIZE = 0x10000;
+
+class nbdConnection {
+public:
+	nbdConnection(tSocket socket, virtualDisk& disk) : m_socket(socket), m_disk(disk) {}
+	void run();
+
+private:
+	bool receive(void* data, size_t size) {
+		uint8_t* output = (uint8_t*)data;
+		while (size) {
+			int numReceived = recv(m_socket, (char*)output, (int)size, 0);
+			if (numReceived <= 0) {
+				return false;
+			}
+			output += numReceived;
+			size -= numReceived;
+		}
+		return true;
+	}
+	bool send(const void* data, size_t size) {
+		const uint8_t* input = (const uint8_t*)data;
+		while (size) {
+			int numSent = ::send(m_socket, (const char*)input, (int)size, MSG_NOSIGNAL);
+			if (numSent <= 0) {
+				return false;
+			}
+			input += numSent;
+			size -= numSent;
+		}
+		return true;
+	}
+	bool receiveU16(uint16_t& value) {
+		uint8_t data[2];
+		if (!receive(data, 2)) return false;
+		value = (data[0] << 8) | data[1];
+		return true;
+	}
+	bool receiveU32(uint32_t& value) {
+		uint8_t data[4];
+		if (!receive(data, 4)) return false;
+		value = ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+		return true;
+	}
+	bool receiveU64(uint64_t& value) {
+		uint32_t high, low;
+		if (!receiveU32(high) || !receiveU32(low)) return false;
+		value = ((uint64_t)high << 32) | low;
+		return true;
+	}
+	void putU16(std::vector<uint8_t>& output, uint16_t value) {
+		output.push_back(value >> 8);
+		output.push_back(value & 0xFF);
+	}
+	void putU32(std::vector<uint8_t>& output, uint32_t value) {
+		putU16(output, value >> 16);
+		putU16(output, value & 0xFFFF);
+	}
+	void putU64(std::vector<uint8_t>& output, uint64_t value) {
+		putU32(output, value >> 32);
+		putU32(output, value & 0xFFFFFFFF);
+	}
+
+	bool sendOptionReply(uint32_t option, uint32_t replyType, const std::vector<uint8_t>& data);
+	bool negotiate();
+	void transmit();
+
+	tSocket m_socket;
+	virtualDisk& m_disk;
+	bool m_noZeroes = false;
+};
+
+bool nbdConnection::sendOptionReply(uint32_t option, uint32_t replyType, const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> reply;
+	putU64(reply, NBD_REPLY_MAGIC);
+	putU32(reply, option);
+	putU32(reply, replyType);
+	putU32(reply, (uint32_t)data.size());
+	reply.insert(reply.end(), data.begin(), data.end());
+	return send(reply.data(), reply.size());
+}
+
+bool nbdConnection::negotiate() {
+	std::vector<uint8_t> greeting;
+	putU64(greeting, NBD_MAGIC);
+	putU64(greeting, NBD_IHAVEOPT);
+	putU16(greeting, NBD_FLAG_FIXED_NEWSTYLE | NBD_FLAG_NO_ZEROES);
+	if (!send(greeting.data(), greeting.size())) {
+		return false;
+	}
+
+	uint32_t clientFlags;
+	if (!receiveU32(clientFlags)) {
+		return false;
+	}
+	m_noZeroes = (clientFlags & NBD_FLAG_NO_ZEROES) != 0;
+
+	const uint16_t transmissionFlags = NBD_FLAG_HAS_FLAGS | NBD_FLAG_READ_ONLY;
+	while (true) {
+		uint64_t magic;
+		uint32_t option, length;
+		if (!receiveU64(magic) || magic != NBD_IHAVEOPT || !receiveU32(option) || !receiveU32(length) || length > MAX_OPTION_LENGTH) {
+			return false;
+		}
+		std::vector<uint8_t> optionData(length);
+		if (length && !receive(optionData.data(), length)) {
+			return false;
+		}
+
+		switch (option) {
+		case NBD_OPT_EXPORT_NAME:
+		{
+			// any export name gets the session
+			std::vector<uint8_t> reply;
+			putU64(reply, m_disk.getSize());
+			putU16(reply, transmissionFlags);
+			if (!m_noZeroes) {
+				reply.resize(reply.size() + 124, 0);
+			}
+			return send(reply.data(), reply.size());
+		}
+		case NBD_OPT_INFO:
+		case NBD_OPT_GO:
+		{
+			std::vector<uint8_t> info;
+			putU16(info, 0); // NBD_INFO_EXPORT
+			putU64(info, m_disk.getSize());
+			putU16(info, transmissionFlags);
+			if (!sendOptionReply(option, NBD_REP_INFO, info) || !sendOptionReply(option, NBD_REP_ACK, std::vector<uint8_t>())) {
+				return false;
+			}
+			if (option == NBD_OPT_GO) {
+				return true;
+			}
+			break;
+		}
+		case NBD_OPT_ABORT:
+			sendOptionReply(option, NBD_REP_ACK, std::vector<uint8_t>());
+			return false;
+		default:
+			if (!sendOptionReply(option, NBD_REP_ERR_UNSUP, std::vector<uint8_t>())) {
+				return false;
+			}
+			break;
+		}
+	}
+}
+
+void nbdConnection::transmit() {
+	std::vector<uint8_t> drainBuffer(DRAIN_CHUNK_SIZE);
+	while (true) {
+		uint32_t magic, length;
+		uint16_t flags, type;
+		uint64_t handle, offset;
+		if (!receiveU32(magic) || magic != NBD_REQUEST_MAGIC || !receiveU16(flags) || !receiveU16(type) || !receiveU64(handle) || !receiveU64(offset) || !receiveU32(length)) {
+			return;
+		}
+
+		uint32_t error = 0;
+		switch (type) {
+		case NBD_CMD_READ:
+			if (length > MAX_REQUEST_LENGTH || offset > m_disk.getSize() || length > m_disk.getSize() - offset) {
+				error = NBD_EINVAL;
+			}
+			break;
+		case NBD_CMD_WRITE:
+			// drain the payload, the disk is read-only
+			for (uint32_t drained = 0; drained < length;) {
+				uint32_t chunkSize = std::min<uint32_t>(length - drained, DRAIN_CHUNK_SIZE);
+				if (!receive(drainBuffer.data(), chunkSize)) {
+					return;
+				}
+				drained += chunkSize;
+			}
+			error = length > MAX_REQUEST_LENGTH ? NBD_EINVAL : NBD_EPERM;
+			break;
+		case NBD_CMD_DISC:
+			return;
+		case NBD_CMD_FLUSH:
+			break;
+		default:
+			error = NBD_EINVAL;
+			break;
+		}
+
+		std::vector<uint8_t> reply;
+		putU32(reply, NBD_SIMPLE_REPLY_MAGIC);
+		putU32(reply, error);
+		putU64(reply, handle);
+		if (type == NBD_CMD_READ && error == 0) {
+			size_t headerSize = reply.size();
+			reply.resize(headerSize + length);
+			m_disk.read(offset, reply.data() + headerSize, length);
+		}
+		if (!send(reply.data(), reply.size())) {
+			return;
+		}
+	}
+}
+
+void nbdConnection::run() {
+	if (negotiate()) {
+		transmit();
+	}
+}
+
+bool serveNBD(virtualDisk& disk, int port) {
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+		return false;
+	}
+#else
+	signal(SIGPIPE, SIG_IGN); // a client disconnecting during a reply
+#endif
+
+	tSocket listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenSocket == INVALID_SOCKET) {
+		return false;
+	}
+	int reuse = 1;
+	setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, 1) != 0) {
+		printf("Can't listen on 127.0.0.1:%d\n", port);
+		closeSocket(listenSocket);
+		return false;
+	}
+
+	printf("Serving %llu bytes on nbd://127.0.0.1:%d\n", (unsigned long long)disk.getSize(), port);
+	while (true) {
+		tSocket clientSocket = accept(listenSocket, nullptr, nullptr);
+		if (clientSocket == INVALID_SOCKET) {
+			continue;
+		}
+		int noDelay = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		nbdConnection connection(clientSocket, disk);
+		connection.run();
+		closeSocket(clientSocket);
+	}
+}
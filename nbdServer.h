@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+class virtualDisk;
+
+// Minimal read-only NBD server (fixed newstyle handshake) exposing a virtualDisk on 127.0.0.1.
+// Serves one client at a time until the process is killed, e.g. nbd-client 127.0.0.1 10809 /dev/nbd0 -N session
+bool serveNBD(virtualDisk& disk, int port);
@@ -0,0 +1,143 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "outputTree.h"
+
+#include <filesystem>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+outputTree::~outputTree() {
+	close();
+}
+
+void outputTree::open(const std::string& rootPath) {
+	close();
+	m_rootPath = rootPath;
+}
+
+#ifdef _WIN32
+
+// No openat, only the folder creation is cached
+void outputTree::close() {
+	m_createdPaths.clear();
+}
+
+bool outputTree::createPath(const std::string& folderPath) {
+	if (m_createdPaths.count(folderPath)) {
+		return true;
+	}
+	std::error_code error;
+	std::filesystem::create_directories(m_rootPath + "/" + folderPath, error);
+	if (error) {
+		return false;
+	}
+	m_createdPaths.insert(folderPath);
+	return true;
+}
+
+bool outputTree::createFolder(uint32_t CNID, const std::string& folderPath) {
+	return createPath(folderPath);
+}
+
+FILE* outputTree::createFile(uint32_t parentCNID, const std::string& folderPath, const std::string& name) {
+	if (!createPath(folderPath)) {
+		return nullptr;
+	}
+	return fopen((m_rootPath + "/" + folderPath + "/" + name).c_str(), "wb+");
+}
+
+#else
+
+// Directory handles kept open at once, the cache is emptied when full
+static const size_t MAX_OPEN_FOLDERS = 128;
+
+void outputTree::close() {
+	for (auto& folder : m_folders) {
+		::close(folder.second.m_fd);
+	}
+	m_folders.clear();
+	m_createdPaths.clear();
+	if (m_rootFd >= 0) {
+		::close(m_rootFd);
+		m_rootFd = -1;
+	}
+}
+
+bool outputTree::createPath(const std::string& folderPath) {
+	if (m_rootFd < 0) {
+		std::error_code error;
+		std::filesystem::create_directories(m_rootPath, error);
+		m_rootFd = ::open(m_rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (m_rootFd < 0) {
+			return false;
+		}
+	}
+	// Every component once, relative to the root
+	size_t end = 0;
+	while (!folderPath.empty() && end != std::string::npos) {
+		end = folderPath.find('/', end + 1);
+		std::string path = folderPath.substr(0, end);
+		if (m_createdPaths.insert(path).second && mkdirat(m_rootFd, path.c_str(), 0777) != 0 && errno != EEXIST) {
+			m_createdPaths.erase(path);
+			return false;
+		}
+	}
+	return true;
+}
+
+outputTree::sFolder* outputTree::getFolder(uint32_t CNID, const std::string& folderPath) {
+	auto found = m_folders.find(CNID);
+	if (found != m_folders.end()) {
+		if (found->second.m_path == folderPath) {
+			return &found->second;
+		}
+		// Not where this view of the catalog puts it
+		::close(found->second.m_fd);
+		m_folders.erase(found);
+	}
+
+	if (!createPath(folderPath)) {
+		return nullptr;
+	}
+	int fd = openat(m_rootFd, folderPath.empty() ? "." : folderPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return nullptr;
+	}
+	if (m_folders.size() >= MAX_OPEN_FOLDERS) {
+		for (auto& folder : m_folders) {
+			::close(folder.second.m_fd);
+		}
+		m_folders.clear();
+	}
+	sFolder& folder = m_folders[CNID];
+	folder.m_path = folderPath;
+	folder.m_fd = fd;
+	return &folder;
+}
+
+bool outputTree::createFolder(uint32_t CNID, const std::string& folderPath) {
+	return getFolder(CNID, folderPath) != nullptr;
+}
+
+FILE* outputTree::createFile(uint32_t parentCNID, const std::string& folderPath, const std::string& name) {
+	sFolder* folder = getFolder(parentCNID, folderPath);
+	if (folder == nullptr) {
+		return nullptr;
+	}
+	int fd = openat(folder->m_fd, name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		return nullptr;
+	}
+	FILE* file = fdopen(fd, "wb+");
+	if (file == nullptr) {
+		::close(fd);
+	}
+	return file;
+}
+
+#endif
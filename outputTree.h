@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Folders of an extracted tree, each created once (mkdirat) and kept open by CNID so files are opened relative
+// to their folder (openat) instead of create_directories and a full path fopen per file.
+// Folder paths are relative to the root, which is only created with the first folder.
+class outputTree {
+public:
+	~outputTree();
+	void open(const std::string& rootPath);
+	void close();
+
+	bool createFolder(uint32_t CNID, const std::string& folderPath);
+	// Creates the folder if needed, nullptr on failure
+	FILE* createFile(uint32_t parentCNID, const std::string& folderPath, const std::string& name);
+
+private:
+	struct sFolder {
+		std::string m_path;
+		int m_fd = -1;
+	};
+	sFolder* getFolder(uint32_t CNID, const std::string& folderPath);
+	bool createPath(const std::string& folderPath);
+
+	std::string m_rootPath;
+	std::unordered_set<std::string> m_createdPaths;
+	std::unordered_map<uint32_t, sFolder> m_folders;
+#ifndef _WIN32
+	int m_rootFd = -1;
+#endif
+};
@@ -0,0 +1,105 @@
+#include "pathFilter.h"
+
+#include <ctype.h>
+#include <stdint.h>
+
+static bool matchClass(const char*& pattern, char c) {
+	// pattern points after the '['
+	bool negate = false;
+	if (*pattern == '!' || *pattern == '^') {
+		negate = true;
+		pattern++;
+	}
+	bool found = false;
+	bool first = true;
+	while (*pattern && (first || *pattern != ']')) {
+		char low = tolower((uint8_t)*pattern);
+		char high = low;
+		if (pattern[1] == '-' && pattern[2] && pattern[2] != ']') {
+			high = tolower((uint8_t)pattern[2]);
+			pattern += 2;
+		}
+		if (low <= c && c <= high) {
+			found = true;
+		}
+		pattern++;
+		first = false;
+	}
+	if (*pattern == ']') {
+		pattern++;
+	}
+	return found != negate;
+}
+
+bool pathFilter::globMatch(const char* pattern, const char* path) {
+	while (*pattern) {
+		if (pattern[0] == '*' && pattern[1] == '*') {
+			// '**' spans path components, "**/" can also match nothing
+			pattern += 2;
+			if (*pattern == '/') {
+				if (globMatch(pattern + 1, path)) {
+					return true;
+				}
+			}
+			for (const char* p = path; ; p++) {
+				if (globMatch(pattern, p)) {
+					return true;
+				}
+				if (*p == 0) {
+					return false;
+				}
+			}
+		}
+		if (*pattern == '*') {
+			pattern++;
+			for (const char* p = path; ; p++) {
+				if (globMatch(pattern, p)) {
+					return true;
+				}
+				if (*p == 0 || *p == '/') {
+					return false;
+				}
+			}
+		}
+		if (*path == 0) {
+			return false;
+		}
+		char c = tolower((uint8_t)*path);
+		if (*pattern == '?') {
+			if (*path == '/') {
+				return false;
+			}
+			pattern++;
+		}
+		else if (*pattern == '[') {
+			pattern++;
+			if (!matchClass(pattern, c)) {
+				return false;
+			}
+		}
+		else {
+			if (tolower((uint8_t)*pattern) != c) {
+				return false;
+			}
+			pattern++;
+		}
+		path++;
+	}
+	return *path == 0;
+}
+
+bool pathFilter::matches(const std::string& path) const {
+	bool included = m_includes.empty();
+	for (int i = 0; i < m_includes.size() && !included; i++) {
+		included = globMatch(m_includes[i].c_str(), path.c_str());
+	}
+	if (!included) {
+		return false;
+	}
+	for (int i = 0; i < m_excludes.size(); i++) {
+		if (globMatch(m_excludes[i].c_str(), path.c_str())) {
+			return false;
+		}
+	}
+	return true;
+}
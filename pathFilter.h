@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Glob based include/exclude filter applied to resolved catalog paths ("Volume/Folder/File").
+// '*' matches within a path component, '**' across components, '?' a single character
+// and [...] a character class. Matching is case insensitive like HFS.
+class pathFilter {
+public:
+	void addInclude(const std::string& pattern) {
+		m_includes.push_back(pattern);
+	}
+	void addExclude(const std::string& pattern) {
+		m_excludes.push_back(pattern);
+	}
+	bool isEmpty() const {
+		return m_includes.empty() && m_excludes.empty();
+	}
+	bool matches(const std::string& path) const;
+
+	static bool globMatch(const char* pattern, const char* path);
+
+private:
+	std::vector<std::string> m_includes;
+	std::vector<std::string> m_excludes;
+};
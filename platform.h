@@ -0,0 +1,16 @@
+#pragma once
+
+// The sources use the MSVC CRT names for 64-bit file offsets and case insensitive compares, map them elsewhere
+#ifndef _MSC_VER
+#include <stdio.h>
+#include <strings.h>
+
+inline int fopen_s(FILE** file, const char* path, const char* mode) {
+	*file = fopen(path, mode);
+	return *file ? 0 : -1;
+}
+
+#define _ftelli64 ftello
+#define _fseeki64 fseeko
+#define _stricmp strcasecmp
+#endif
@@ -0,0 +1,159 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "progress.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+static double getSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string formatDuration(double seconds) {
+	if (seconds < 0 || seconds > 1e7) {
+		return "?";
+	}
+	int total = (int)seconds;
+	char buffer[32];
+	if (total >= 3600) {
+		snprintf(buffer, sizeof(buffer), "%d:%02d:%02d", total / 3600, (total / 60) % 60, total % 60);
+	}
+	else {
+		snprintf(buffer, sizeof(buffer), "%d:%02d", total / 60, total % 60);
+	}
+	return buffer;
+}
+
+void progressReporter::beginBatch(int numImages, uint64_t totalTapeBytes) {
+	m_isTTY = !m_lineMode && isatty(fileno(stdout)) != 0;
+	m_numImages = numImages;
+	m_imageIndex = 0;
+	m_batchTapeBytes = totalTapeBytes;
+	m_batchTapeBytesDone = 0;
+	m_batchStart = getSeconds();
+	m_running = true;
+	m_thread = std::thread(&progressReporter::run, this);
+}
+
+void progressReporter::endBatch() {
+	if (!m_running) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_wakeUp.notify_all();
+	m_thread.join();
+}
+
+void progressReporter::beginImage(const std::string& name, uint64_t tapeBytes) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_imageName = name;
+	m_stage.clear();
+	m_imageTapeBytes = tapeBytes;
+	m_imageTotal = 0;
+	m_imageDone = 0;
+	m_imageStart = getSeconds();
+}
+
+void progressReporter::setStage(const std::string& stage) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stage = stage;
+}
+
+void progressReporter::endImage() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	printStatus(true);
+	m_batchTapeBytesDone += m_imageTapeBytes;
+	m_imageIndex++;
+}
+
+void progressReporter::message(const char* format, ...) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	clearStatus();
+	va_list arguments;
+	va_start(arguments, format);
+	vprintf(format, arguments);
+	va_end(arguments);
+	fflush(stdout);
+}
+
+void progressReporter::run() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	double lastLog = getSeconds();
+	while (m_running) {
+		m_wakeUp.wait_for(lock, std::chrono::duration<double>(m_isTTY ? m_refreshInterval : 1.0));
+		if (!m_running || m_imageName.empty()) {
+			continue;
+		}
+		if (m_isTTY) {
+			printStatus(false);
+		}
+		else if (getSeconds() - lastLog >= m_logInterval) {
+			printStatus(false);
+			lastLog = getSeconds();
+		}
+	}
+	clearStatus();
+}
+
+// Called with m_mutex held
+void progressReporter::printStatus(bool final) {
+	double now = getSeconds();
+	uint64_t done = m_imageDone.load(std::memory_order_relaxed);
+	uint64_t total = std::max<uint64_t>(m_imageTotal.load(std::memory_order_relaxed), done);
+	double elapsed = std::max(now - m_imageStart, 0.001);
+	double rate = done / elapsed;
+	double imageFraction = total ? (double)done / total : 0;
+
+	char status[512];
+	int length = 0;
+	if (m_numImages > 1) {
+		double batchFraction = m_batchTapeBytes ? (m_batchTapeBytesDone + imageFraction * m_imageTapeBytes) / m_batchTapeBytes : 0;
+		double batchElapsed = now - m_batchStart;
+		length += snprintf(status + length, sizeof(status) - length, "[%d/%d %.0f%% ETA %s] ", m_imageIndex + 1, m_numImages, batchFraction * 100,
+			batchFraction > 0 ? formatDuration(batchElapsed * (1 - batchFraction) / batchFraction).c_str() : "?");
+	}
+	length += snprintf(status + length, sizeof(status) - length, "%s", m_imageName.c_str());
+	if (!m_stage.empty() && !final) {
+		length += snprintf(status + length, sizeof(status) - length, " %s", m_stage.c_str());
+	}
+	length += snprintf(status + length, sizeof(status) - length, ": %.1f/%.1f MB (%.0f%%) %.1f MB/s", done / 1048576.0, total / 1048576.0, imageFraction * 100, rate / 1048576.0);
+	if (final) {
+		length += snprintf(status + length, sizeof(status) - length, " in %s", formatDuration(elapsed).c_str());
+	}
+	else {
+		length += snprintf(status + length, sizeof(status) - length, " ETA %s", rate > 0 && total ? formatDuration((total - done) / rate).c_str() : "?");
+	}
+	length = std::min<int>(length, sizeof(status) - 1);
+
+	if (m_isTTY && !final) {
+		// Redraw in place, padding over a longer previous line
+		printf("\r%s%*s", status, (int)std::max<int64_t>((int64_t)m_statusLength - length, 0), "");
+		m_statusLength = length;
+	}
+	else {
+		clearStatus();
+		printf("%s\n", status);
+	}
+	fflush(stdout);
+}
+
+// Called with m_mutex held
+void progressReporter::clearStatus() {
+	if (m_statusLength) {
+		printf("\r%*s\r", (int)m_statusLength, "");
+		m_statusLength = 0;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Progress of a batch of tapes, printed from a timer thread: workers only bump atomic counters.
+// On a terminal the status line is redrawn in place, otherwise a full line is printed every m_logInterval seconds.
+class progressReporter {
+public:
+	~progressReporter() {
+		endBatch();
+	}
+
+	// totalTapeBytes is the size of every tape in the batch, it weights each image in the batch ETA
+	void beginBatch(int numImages, uint64_t totalTapeBytes);
+	void endBatch();
+
+	void beginImage(const std::string& name, uint64_t tapeBytes);
+	// Bytes this image will output, known once its catalogs are read
+	void setImageTotal(uint64_t totalBytes) {
+		m_imageTotal = totalBytes;
+	}
+	void setStage(const std::string& stage);
+	void addBytes(uint64_t numBytes) {
+		m_imageDone.fetch_add(numBytes, std::memory_order_relaxed);
+	}
+	void endImage();
+
+	// printf that doesn't get mixed with the status line
+	void message(const char* format, ...);
+
+	double m_refreshInterval = 0.5;
+	double m_logInterval = 10.0;
+	bool m_lineMode = false; // never redraw in place, for reporters sharing stdout
+
+private:
+	void run();
+	void printStatus(bool final);
+	void clearStatus();
+
+	bool m_isTTY = false;
+	bool m_running = false;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+
+	int m_numImages = 0;
+	int m_imageIndex = 0;
+	uint64_t m_batchTapeBytes = 0;
+	uint64_t m_batchTapeBytesDone = 0;
+	double m_batchStart = 0;
+
+	std::string m_imageName;
+	std::string m_stage;
+	uint64_t m_imageTapeBytes = 0;
+	std::atomic<uint64_t> m_imageTotal = 0;
+	std::atomic<uint64_t> m_imageDone = 0;
+	double m_imageStart = 0;
+	size_t m_statusLength = 0;
+};
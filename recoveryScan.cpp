@@ -0,0 +1,504 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "recoveryScan.h"
+#include "fileAccess.h"
+#include "forkReader.h"
+#include "pathFilter.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+static const int64_t CPTP_HEADER_SIZE = 0x10;
+static const int64_t CPTP_SECTOR_SIZE = 0x211;
+static const int64_t CPTP_FOOTER_SIZE = 0x2;
+static const int64_t SECTORS_PER_CHUNK = 0x800;
+static const int MAX_FOLDER_DEPTH = 64;
+
+static uint16_t getU16_BE(const uint8_t* data) {
+	return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static uint32_t getU32_BE(const uint8_t* data) {
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static bool isPrintable(const uint8_t* data, int size) {
+	for (int i = 0; i < size; i++) {
+		if (data[i] < 0x20 || data[i] > 0x7E) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Node descriptor in range and record offsets starting after it, increasing, and ending before the offset table
+static bool isPlausibleNode(const uint8_t* node) {
+	uint8_t type = node[8];
+	uint8_t level = node[9];
+	uint16_t numRecords = getU16_BE(node + 10);
+	if (getU16_BE(node + 12) != 0 || numRecords == 0 || 14 + 2 * (numRecords + 1) > 0x200) {
+		return false;
+	}
+	switch (type) {
+	case 0xFF: // leaf
+	case 0x00: // index
+		if (level < 1 || level > 8) {
+			return false;
+		}
+		break;
+	case 0x01: // header
+	case 0x02: // map
+		if (level != 0) {
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+
+	uint16_t offsetTableStart = 0x200 - 2 * (numRecords + 1);
+	uint16_t previousOffset = 0;
+	for (int i = 0; i <= numRecords; i++) {
+		uint16_t offset = getU16_BE(node + 0x200 - 2 * (i + 1));
+		if ((i == 0 && offset != 14) || (i > 0 && offset <= previousOffset) || offset > offsetTableStart) {
+			return false;
+		}
+		previousOffset = offset;
+	}
+	if (type == 0x01 && getU16_BE(node + 14 + 18) != 0x200) {
+		return false; // header node of a tree with another node size
+	}
+	return true;
+}
+
+// Every record of a leaf node has a catalog key and a known record type that fits before the next record,
+// so readNode can parse it without tripping on garbage
+static bool areLeafRecordsValid(const uint8_t* node) {
+	uint16_t numRecords = getU16_BE(node + 10);
+	for (int i = 0; i < numRecords; i++) {
+		uint16_t start = getU16_BE(node + 0x200 - 2 * (i + 1));
+		uint16_t end = getU16_BE(node + 0x200 - 2 * (i + 2));
+		uint8_t keySize = node[start];
+		if (keySize < 6 || keySize > 37 || start + 1 + keySize > end || node[start + 6] > keySize - 6) {
+			return false;
+		}
+		uint16_t data = (start + 1 + keySize + 1) & ~1;
+		if (data + 2 > end) {
+			return false;
+		}
+		uint16_t recordSize;
+		switch (node[data]) {
+		case 1: // FolderRecord
+			recordSize = 70;
+			break;
+		case 2: // FileRecord
+			recordSize = 102;
+			break;
+		case 3: // FolderThread
+		case 4: // FileThread
+			if (data + 15 > end) {
+				return false;
+			}
+			recordSize = 15 + node[data + 14];
+			break;
+		default:
+			return false;
+		}
+		if (node[data + 1] != 0 || data + recordSize > end) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// What one thread found in its chunks
+struct sScanResult {
+	std::vector<recoveryScan::sSessionHeader> m_sessionHeaders;
+	std::vector<recoveryScan::sPartitionEntry> m_partitionEntries;
+	std::vector<recoveryScan::sMasterDirectoryBlock> m_masterDirectoryBlocks;
+	uint64_t m_numLeafNodes = 0;
+	uint64_t m_numIndexNodes = 0;
+	uint64_t m_numHeaderNodes = 0;
+	uint64_t m_numMapNodes = 0;
+	std::vector<recoveryScan::sCatalogRecord> m_records;
+};
+
+// All signatures are at the start of a sector, so each sector is only checked at its first bytes
+static void scanSector(const uint8_t* sector, int64_t sectorIndex, sScanResult& result) {
+	switch (getU16_BE(sector)) {
+	case 0x524D: { // 'RM'
+		recoveryScan::sSessionHeader header;
+		header.m_sector = sectorIndex;
+		header.m_sessionID = getU16_BE(sector + 0x2);
+		header.m_numSpans = getU16_BE(sector + 0xA);
+		header.m_previousSession = getU32_BE(sector + 0x28);
+		header.m_currentSession = getU32_BE(sector + 0x2C);
+		header.m_numSystemSectors = getU32_BE(sector + 0x30);
+		if (0x38 + header.m_numSpans * 8 <= 0x200) {
+			result.m_sessionHeaders.push_back(header);
+			return;
+		}
+		break;
+	}
+	case 0x504D: { // 'PM'
+		recoveryScan::sPartitionEntry entry;
+		entry.m_sector = sectorIndex;
+		entry.m_numMapEntries = getU32_BE(sector + 0x4);
+		entry.m_partitionStart = getU32_BE(sector + 0x8);
+		entry.m_numPartitionSectors = getU32_BE(sector + 0xC);
+		const uint8_t* type = sector + 0x30;
+		int typeLength = (int)strnlen((const char*)type, 32);
+		if (getU16_BE(sector + 0x2) == 0 && entry.m_numMapEntries >= 1 && entry.m_numMapEntries <= 0x100 && typeLength > 0 && isPrintable(type, typeLength)) {
+			entry.m_type.assign((const char*)type, typeLength);
+			result.m_partitionEntries.push_back(entry);
+			return;
+		}
+		break;
+	}
+	case 0x4244: { // 'BD'
+		recoveryScan::sMasterDirectoryBlock mdb;
+		mdb.m_sector = sectorIndex;
+		mdb.m_numAllocationBlocks = getU16_BE(sector + 0x12);
+		mdb.m_allocationBlockSize = getU32_BE(sector + 0x14);
+		mdb.m_firstAllocationBlockSector = getU16_BE(sector + 0x1C);
+		mdb.m_numFreeAllocationBlocks = getU16_BE(sector + 0x22);
+		uint8_t nameLength = sector[0x24];
+		if (mdb.m_numAllocationBlocks > 0 && mdb.m_allocationBlockSize > 0 && mdb.m_allocationBlockSize % 0x200 == 0
+			&& mdb.m_firstAllocationBlockSector > 0 && mdb.m_numFreeAllocationBlocks <= mdb.m_numAllocationBlocks && nameLength <= 27) {
+			mdb.m_volumeName.assign((const char*)sector + 0x25, nameLength);
+			result.m_masterDirectoryBlocks.push_back(mdb);
+			return;
+		}
+		break;
+	}
+	}
+
+	if (!isPlausibleNode(sector)) {
+		return;
+	}
+	switch (sector[8]) {
+	case 0xFF:
+		if (areLeafRecordsValid(sector)) {
+			result.m_numLeafNodes++;
+			tapeFile_memory nodeData;
+			nodeData.assign(sector, 0x200);
+			sNode node;
+			readNode(&nodeData, node);
+			for (int i = 0; i < node.m_leafNode.size(); i++) {
+				result.m_records.push_back({ sectorIndex, node.m_leafNode[i], std::string() });
+			}
+		}
+		break;
+	case 0x00:
+		result.m_numIndexNodes++;
+		break;
+	case 0x01:
+		result.m_numHeaderNodes++;
+		break;
+	case 0x02:
+		result.m_numMapNodes++;
+		break;
+	}
+}
+
+bool recoveryScan::scan(const std::string& imagePath, int numThreads) {
+	positionalFile input;
+	if (!input.open(imagePath, false)) {
+		printf("Can't open %s\n", imagePath.c_str());
+		return false;
+	}
+	bool cptp = !_stricmp(std::filesystem::path(imagePath).extension().string().c_str(), ".cptp");
+	int64_t inputSize = input.getSize();
+	if (cptp) {
+		m_numSectors = std::max<int64_t>(inputSize - CPTP_HEADER_SIZE, 0) / CPTP_SECTOR_SIZE;
+		m_imageComplete = m_numSectors * CPTP_SECTOR_SIZE + CPTP_HEADER_SIZE + CPTP_FOOTER_SIZE == inputSize;
+	}
+	else {
+		m_numSectors = inputSize / 0x200;
+		m_imageComplete = m_numSectors * 0x200 == inputSize;
+	}
+
+	// Threads pull chunks of sectors and keep what they find to themselves until the end
+	int64_t numChunks = (m_numSectors + SECTORS_PER_CHUNK - 1) / SECTORS_PER_CHUNK;
+	std::atomic<int64_t> nextChunk = 0;
+	std::atomic<int64_t> numUnreadableSectors = 0;
+	std::mutex resultMutex;
+	sScanResult merged;
+	auto worker = [&]() {
+		int64_t fileSectorSize = cptp ? CPTP_SECTOR_SIZE : 0x200;
+		std::vector<uint8_t> inputBuffer(SECTORS_PER_CHUNK * fileSectorSize);
+		std::vector<uint8_t> sectorBuffer(SECTORS_PER_CHUNK * 0x200);
+		sScanResult result;
+		for (int64_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++) {
+			int64_t firstSector = chunk * SECTORS_PER_CHUNK;
+			int64_t chunkSectors = std::min(SECTORS_PER_CHUNK, m_numSectors - firstSector);
+			int64_t inputChunkSize = chunkSectors * fileSectorSize;
+			int64_t chunkOffset = cptp ? CPTP_HEADER_SIZE + firstSector * CPTP_SECTOR_SIZE : firstSector * 0x200;
+			int64_t numRead = std::max<int64_t>(input.readAt(chunkOffset, inputBuffer.data(), inputChunkSize), 0);
+			if (numRead < inputChunkSize) {
+				// Read error, what couldn't be read is zeros
+				numUnreadableSectors += (inputChunkSize - numRead + fileSectorSize - 1) / fileSectorSize;
+				memset(inputBuffer.data() + numRead, 0, inputChunkSize - numRead);
+			}
+			const uint8_t* sectors = inputBuffer.data();
+			if (cptp) {
+				for (int64_t i = 0; i < chunkSectors; i++) {
+					memcpy(&sectorBuffer[i * 0x200], &inputBuffer[i * CPTP_SECTOR_SIZE], 0x200);
+				}
+				sectors = sectorBuffer.data();
+			}
+			for (int64_t i = 0; i < chunkSectors; i++) {
+				scanSector(sectors + i * 0x200, firstSector + i, result);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(resultMutex);
+		merged.m_sessionHeaders.insert(merged.m_sessionHeaders.end(), result.m_sessionHeaders.begin(), result.m_sessionHeaders.end());
+		merged.m_partitionEntries.insert(merged.m_partitionEntries.end(), result.m_partitionEntries.begin(), result.m_partitionEntries.end());
+		merged.m_masterDirectoryBlocks.insert(merged.m_masterDirectoryBlocks.end(), result.m_masterDirectoryBlocks.begin(), result.m_masterDirectoryBlocks.end());
+		merged.m_records.insert(merged.m_records.end(), std::make_move_iterator(result.m_records.begin()), std::make_move_iterator(result.m_records.end()));
+		merged.m_numLeafNodes += result.m_numLeafNodes;
+		merged.m_numIndexNodes += result.m_numIndexNodes;
+		merged.m_numHeaderNodes += result.m_numHeaderNodes;
+		merged.m_numMapNodes += result.m_numMapNodes;
+	};
+
+	numThreads = (int)std::max<int64_t>(1, std::min<int64_t>(numThreads, numChunks));
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; i++) {
+		threads.emplace_back(worker);
+	}
+	for (int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	// Back in tape order
+	auto bySector = [](const auto& a, const auto& b) { return a.m_sector < b.m_sector; };
+	std::sort(merged.m_sessionHeaders.begin(), merged.m_sessionHeaders.end(), bySector);
+	std::sort(merged.m_partitionEntries.begin(), merged.m_partitionEntries.end(), bySector);
+	std::sort(merged.m_masterDirectoryBlocks.begin(), merged.m_masterDirectoryBlocks.end(), bySector);
+	std::stable_sort(merged.m_records.begin(), merged.m_records.end(), bySector);
+	m_sessionHeaders = std::move(merged.m_sessionHeaders);
+	m_partitionEntries = std::move(merged.m_partitionEntries);
+	m_masterDirectoryBlocks = std::move(merged.m_masterDirectoryBlocks);
+	m_records = std::move(merged.m_records);
+	m_numLeafNodes = merged.m_numLeafNodes;
+	m_numIndexNodes = merged.m_numIndexNodes;
+	m_numHeaderNodes = merged.m_numHeaderNodes;
+	m_numMapNodes = merged.m_numMapNodes;
+
+	if (numUnreadableSectors) {
+		printf("%lld sectors of %s couldn't be read\n", (long long)numUnreadableSectors, imagePath.c_str());
+	}
+	printf("Scanned %lld sectors with %d threads: %d session headers, %d partition entries, %d MDBs, %llu leaf nodes\n", (long long)m_numSectors, numThreads,
+		(int)m_sessionHeaders.size(), (int)m_partitionEntries.size(), (int)m_masterDirectoryBlocks.size(), (unsigned long long)m_numLeafNodes);
+	return true;
+}
+
+void recoveryScan::rebuildCatalog() {
+	// Records are in tape order, later copies replace earlier ones. Threads only name folders nothing else names
+	m_folders.clear();
+	std::unordered_map<uint32_t, size_t> files;
+	for (size_t i = 0; i < m_records.size(); i++) {
+		sLeafNode& record = m_records[i].m_record;
+		if (record.m_type == 1) {
+			m_folders[record.m_FolderRecord.m_id] = { record.getParentCNID(), record.getName(), false };
+		}
+		else if (record.m_type == 2) {
+			files[record.m_FileRecord.m_id] = i;
+		}
+	}
+	for (size_t i = 0; i < m_records.size(); i++) {
+		sLeafNode& record = m_records[i].m_record;
+		if (record.m_type == 3) {
+			auto found = m_folders.find(record.getParentCNID());
+			if (found == m_folders.end() || found->second.m_fromThread) {
+				m_folders[record.getParentCNID()] = { record.m_FolderOrFileThread.m_parentCNID, record.m_FolderOrFileThread.m_name, true };
+			}
+		}
+	}
+
+	m_files.clear();
+	for (auto& file : files) {
+		m_files.push_back(m_records[file.second]);
+	}
+	std::sort(m_files.begin(), m_files.end(), [](const sCatalogRecord& a, const sCatalogRecord& b) { return a.m_record.m_FileRecord.m_id < b.m_record.m_FileRecord.m_id; });
+	for (int i = 0; i < m_files.size(); i++) {
+		m_files[i].m_folderPath = getFolderPath(m_files[i].m_record.getParentCNID());
+	}
+}
+
+std::string recoveryScan::getFolderPath(uint32_t CNID) {
+	std::string path;
+	for (int depth = 0; depth < MAX_FOLDER_DEPTH && CNID != 1; depth++) {
+		std::string name;
+		auto found = m_folders.find(CNID);
+		if (found == m_folders.end()) {
+			// Every record of the folder is lost, its content is kept together under its CNID
+			name = "_lost_folder_" + std::to_string(CNID);
+			CNID = 1;
+		}
+		else {
+			name = found->second.m_name;
+			normalizeFilename(name);
+			if (name.empty()) {
+				name = "_unnamed_folder_" + std::to_string(CNID);
+			}
+			CNID = found->second.m_parentCNID;
+		}
+		path = path.empty() ? name : name + "/" + path;
+	}
+	return path;
+}
+
+bool recoveryScan::isInImage(const sLeafNode& fileRecord) {
+	uint64_t remaining = fileRecord.m_FileRecord.m_dataForkBlockSize;
+	for (int i = 0; i < 3 && remaining > 0; i++) {
+		uint16_t extentStart = fileRecord.m_FileRecord.m_firstDataForkExtents[i] >> 16;
+		uint16_t extentSize = fileRecord.m_FileRecord.m_firstDataForkExtents[i] & 0xFFFF;
+		if (extentSize == 0) {
+			break;
+		}
+		uint64_t size = std::min<uint64_t>((uint64_t)extentSize * 0x9800, remaining);
+		if (extentStart < 0x26 || getAllocationBlockTapeOffset(extentStart) + size > (uint64_t)m_numSectors * 0x200) {
+			return false;
+		}
+		remaining -= size;
+	}
+	return true;
+}
+
+bool recoveryScan::writeReport(const std::string& outputFileName) {
+	FILE* fOutput = fopen(outputFileName.c_str(), "w+");
+	if (fOutput == nullptr) {
+		return false;
+	}
+	fprintf(fOutput, "Sectors 0x%llX%s\n", (unsigned long long)m_numSectors, m_imageComplete ? "" : " (truncated image)");
+	fprintf(fOutput, "Catalog nodes: %llu leaf, %llu index, %llu header, %llu map\n", (unsigned long long)m_numLeafNodes, (unsigned long long)m_numIndexNodes,
+		(unsigned long long)m_numHeaderNodes, (unsigned long long)m_numMapNodes);
+	fprintf(fOutput, "Catalog records %llu, %llu folders and %llu files after merging\n", (unsigned long long)m_records.size(), (unsigned long long)m_folders.size(), (unsigned long long)m_files.size());
+
+	std::unordered_map<int64_t, const sPartitionEntry*> partitionEntries;
+	for (int i = 0; i < m_partitionEntries.size(); i++) {
+		partitionEntries[m_partitionEntries[i].m_sector] = &m_partitionEntries[i];
+	}
+	std::unordered_map<int64_t, const sMasterDirectoryBlock*> masterDirectoryBlocks;
+	for (int i = 0; i < m_masterDirectoryBlocks.size(); i++) {
+		masterDirectoryBlocks[m_masterDirectoryBlocks[i].m_sector] = &m_masterDirectoryBlocks[i];
+	}
+	std::unordered_map<int64_t, const sSessionHeader*> sessionHeaders;
+	for (int i = 0; i < m_sessionHeaders.size(); i++) {
+		sessionHeaders[m_sessionHeaders[i].m_sector] = &m_sessionHeaders[i];
+	}
+
+	// Each header with what findSessions and getHFSVolume would look for from it
+	fprintf(fOutput, "\nSession headers\n");
+	for (int i = 0; i < m_sessionHeaders.size(); i++) {
+		const sSessionHeader& header = m_sessionHeaders[i];
+		fprintf(fOutput, "0x%08llX ID 0x%04X spans %d system sectors 0x%08X", (long long)header.m_sector, header.m_sessionID, header.m_numSpans, header.m_numSystemSectors);
+		if (header.m_previousSession) {
+			int64_t previousSector = (int64_t)header.m_previousSession - ((int64_t)header.m_currentSession - header.m_sector);
+			fprintf(fOutput, ", previous 0x%08llX %s", (long long)previousSector, sessionHeaders.count(previousSector) ? "found" : "missing");
+		}
+		int64_t partitionTableStart = header.m_sector + 2;
+		auto partitionEntry = partitionEntries.find(partitionTableStart);
+		if (partitionEntry == partitionEntries.end()) {
+			fprintf(fOutput, ", no partition map\n");
+			continue;
+		}
+		for (uint32_t j = 0; j < partitionEntry->second->m_numMapEntries; j++) {
+			auto entry = partitionEntries.find(partitionTableStart + j);
+			if (entry == partitionEntries.end()) {
+				fprintf(fOutput, ", partition entry %u missing", j);
+				continue;
+			}
+			fprintf(fOutput, ", %s", entry->second->m_type.c_str());
+			if (entry->second->m_type == "Apple_HFS") {
+				auto mdb = masterDirectoryBlocks.find(partitionTableStart - 1 + entry->second->m_partitionStart + 2);
+				if (mdb != masterDirectoryBlocks.end()) {
+					fprintf(fOutput, " (MDB '%s')", mdb->second->m_volumeName.c_str());
+				}
+				else {
+					fprintf(fOutput, " (MDB missing)");
+				}
+			}
+		}
+		fprintf(fOutput, "\n");
+	}
+
+	fprintf(fOutput, "\nPartition entries\n");
+	for (int i = 0; i < m_partitionEntries.size(); i++) {
+		const sPartitionEntry& entry = m_partitionEntries[i];
+		fprintf(fOutput, "0x%08llX %s start 0x%08X sectors 0x%08X of %u entries\n", (long long)entry.m_sector, entry.m_type.c_str(), entry.m_partitionStart, entry.m_numPartitionSectors, entry.m_numMapEntries);
+	}
+
+	fprintf(fOutput, "\nMaster directory blocks\n");
+	for (int i = 0; i < m_masterDirectoryBlocks.size(); i++) {
+		const sMasterDirectoryBlock& mdb = m_masterDirectoryBlocks[i];
+		fprintf(fOutput, "0x%08llX '%s' %u allocation blocks of 0x%X from sector 0x%04X, %u free\n", (long long)mdb.m_sector, mdb.m_volumeName.c_str(), mdb.m_numAllocationBlocks,
+			mdb.m_allocationBlockSize, mdb.m_firstAllocationBlockSector, mdb.m_numFreeAllocationBlocks);
+	}
+	fclose(fOutput);
+	return true;
+}
+
+bool recoveryScan::writeCatalog(const std::string& outputFileName) {
+	FILE* fOutput = fopen(outputFileName.c_str(), "w+");
+	if (fOutput == nullptr) {
+		return false;
+	}
+	// CNID, node sector, path, fork sizes, then every extent as [first block,count]@tape offset
+	for (int i = 0; i < m_files.size(); i++) {
+		sLeafNode& record = m_files[i].m_record;
+		fprintf(fOutput, "0x%08X 0x%08llX %s/%s data 0x%X resource 0x%X", record.m_FileRecord.m_id, (long long)m_files[i].m_sector, m_files[i].m_folderPath.c_str(), record.getName().c_str(),
+			record.m_FileRecord.m_dataForkBlockSize, record.m_FileRecord.m_resourceForkBlockSize);
+		for (int fork = 0; fork < 2; fork++) {
+			const uint32_t* extents = fork ? record.m_FileRecord.m_firstResourceForkExtents : record.m_FileRecord.m_firstDataForkExtents;
+			for (int j = 0; j < 3 && (extents[j] & 0xFFFF); j++) {
+				uint16_t extentStart = extents[j] >> 16;
+				fprintf(fOutput, " %s[0x%04X,0x%04X]", fork ? "rsrc" : "data", extentStart, extents[j] & 0xFFFF);
+				if (extentStart >= 0x26) {
+					fprintf(fOutput, "@0x%llX", (unsigned long long)getAllocationBlockTapeOffset(extentStart));
+				}
+			}
+		}
+		fprintf(fOutput, "%s\n", isInImage(record) ? "" : " outside image");
+	}
+	fclose(fOutput);
+	return true;
+}
+
+std::vector<bTree::sExtractJob> recoveryScan::getExtractJobs(const pathFilter* filter) {
+	std::vector<bTree::sExtractJob> jobs;
+	// Deleted and replaced copies of a file have their own CNID but the same path, the newest one is written
+	std::unordered_map<std::string, int> pathToFile;
+	std::vector<int> jobFiles;
+	for (int i = 0; i < m_files.size(); i++) {
+		sLeafNode& record = m_files[i].m_record;
+		if (!isInImage(record)) {
+			continue;
+		}
+		std::string name = record.getName();
+		std::string path = m_files[i].m_folderPath + "/" + normalizeFilename(name);
+		if (filter && !filter->matches(path)) {
+			continue;
+		}
+		auto known = pathToFile.find(path);
+		if (known == pathToFile.end()) {
+			pathToFile[path] = (int)jobs.size();
+			jobs.push_back(bTree::makeExtractJob(record, m_files[i].m_folderPath));
+			jobFiles.push_back(i);
+		}
+		else if (m_files[i].m_sector > m_files[jobFiles[known->second]].m_sector) {
+			jobs[known->second] = bTree::makeExtractJob(record, m_files[i].m_folderPath);
+			jobFiles[known->second] = i;
+		}
+	}
+	return jobs;
+}
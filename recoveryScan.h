@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "btree.h"
+
+class pathFilter;
+
+// Recovery of tapes whose session chain or MDB is damaged: every sector of the image is checked on its own for
+// session headers ('RM'), partition map entries ('PM'), MDBs ('BD') and catalog B-tree nodes. The leaf records
+// of every node found are merged into a best-effort catalog, the newest copy (furthest on tape) of each CNID wins.
+class recoveryScan {
+public:
+	struct sSessionHeader {
+		int64_t m_sector;
+		uint16_t m_sessionID;
+		uint16_t m_numSpans;
+		uint32_t m_previousSession;
+		uint32_t m_currentSession;
+		uint32_t m_numSystemSectors;
+	};
+	struct sPartitionEntry {
+		int64_t m_sector;
+		uint32_t m_numMapEntries;
+		uint32_t m_partitionStart; // in sectors from the sector before the map
+		uint32_t m_numPartitionSectors;
+		std::string m_type;
+	};
+	struct sMasterDirectoryBlock {
+		int64_t m_sector;
+		uint16_t m_numAllocationBlocks;
+		uint32_t m_allocationBlockSize;
+		uint16_t m_firstAllocationBlockSector;
+		uint16_t m_numFreeAllocationBlocks;
+		std::string m_volumeName;
+	};
+	struct sCatalogRecord {
+		int64_t m_sector; // of the leaf node holding it
+		sLeafNode m_record;
+		std::string m_folderPath; // resolved by rebuildCatalog, files only
+	};
+
+	// Raw or .cptp (by extension), truncated images are scanned up to their last whole sector
+	bool scan(const std::string& imagePath, int numThreads);
+	// Keeps the newest folder and file records and resolves the file paths
+	void rebuildCatalog();
+
+	bool writeReport(const std::string& outputFileName);
+	// Catalog and extent map: one line per recovered file with its extents and where they are on tape
+	bool writeCatalog(const std::string& outputFileName);
+	// Recovered files whose data is inside the image, one per output path
+	std::vector<bTree::sExtractJob> getExtractJobs(const pathFilter* filter);
+
+	bool isImageComplete() const {
+		return m_imageComplete;
+	}
+
+	std::vector<sSessionHeader> m_sessionHeaders;
+	std::vector<sPartitionEntry> m_partitionEntries;
+	std::vector<sMasterDirectoryBlock> m_masterDirectoryBlocks;
+	uint64_t m_numLeafNodes = 0;
+	uint64_t m_numIndexNodes = 0;
+	uint64_t m_numHeaderNodes = 0;
+	uint64_t m_numMapNodes = 0;
+	std::vector<sCatalogRecord> m_records; // every leaf record found, in tape order
+	std::vector<sCatalogRecord> m_files; // newest copy of each file
+
+private:
+	struct sFolder {
+		uint32_t m_parentCNID;
+		std::string m_name;
+		bool m_fromThread; // only a thread record names it
+	};
+	std::string getFolderPath(uint32_t CNID);
+	bool isInImage(const sLeafNode& fileRecord);
+
+	int64_t m_numSectors = 0;
+	bool m_imageComplete = false;
+	std::unordered_map<uint32_t, sFolder> m_folders;
+};
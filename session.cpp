@@ -0,0 +1,330 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "session.h"
+#include "platform.h"
+#include "sessionAddressMap.h"
+#include "tapePass.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+
+bool findSessions(tapeFile* fHandle, std::vector<sSession>& sessions) {
+	// Look for last session
+	uint32_t archiveSize = fHandle->getNumSectors() * 0x200;
+	int32_t numSectors = archiveSize / 0x200;
+	int32_t lastSessionSector = -1;
+	for (uint32_t sector = numSectors - 1; sector >= 0; sector--) {
+		fHandle->seekToPosition(sector * 0x200);
+		if (fHandle->readU16_BE() == 0x524D) {
+			lastSessionSector = sector;
+			break;
+		}
+	}
+	if (lastSessionSector == -1) {
+		return false;
+	}
+
+	// Find all sessions
+	uint32_t currentSessionSector = lastSessionSector;
+	while (true) {
+		fHandle->seekToPosition(currentSessionSector * 0x200);
+		sSession newSession;
+		newSession.m_sessionStartSector = currentSessionSector;
+
+		newSession.m_magic = fHandle->readU16_BE();
+		if (newSession.m_magic != 0x524D)
+			break;
+		newSession.m_sessionID = fHandle->readU16_BE();
+		newSession.m_sessionID2 = fHandle->readU16_BE();
+		newSession.m_unk6 = fHandle->readU16_BE();
+		newSession.m_unk8 = fHandle->readU16_BE(); // 1 in last session?
+		newSession.m_numSpans = fHandle->readU16_BE();
+		newSession.m_unkC = fHandle->readU32_BE(); // some sector number to something, looks more or less like the end of current session
+		newSession.m_unk10 = fHandle->readU32_BE(); // the offset to remap file system sectors
+		newSession.m_unk14 = fHandle->readU32_BE();
+		newSession.m_unk18 = fHandle->readU16_BE();
+		newSession.m_unk1A = fHandle->readU16_BE();
+		newSession.m_unk1C = fHandle->readU32_BE();
+		for (int i = 0; i < 8; i++) {
+			newSession.m_TDVersionName[i] = fHandle->readU8();
+		}
+		newSession.m_previousSession = fHandle->readU32_BE();
+		newSession.m_currentSession = fHandle->readU32_BE();
+		newSession.m_numSystemSectors = fHandle->readU32_BE(); // directory size required for mounting
+		newSession.m_unk34 = fHandle->readU32_BE();
+		for (int i = 0; i < newSession.m_numSpans; i++) {
+			auto& newSpan = newSession.m_spans.emplace_back();
+			newSpan.m0 = fHandle->readU32_BE(); // in-disk offset (-0x60)
+			newSpan.m4 = fHandle->readU32_BE(); // size in sectors
+		}
+		sessions.insert(sessions.begin(), newSession);
+
+		if (newSession.m_previousSession == 0) {
+			break;
+		}
+		currentSessionSector = newSession.m_previousSession - (newSession.m_currentSession - newSession.m_sessionStartSector);
+	}
+
+	return true;
+}
+
+bool findPartition(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle, const char* partitionType, int64_t& firstSector, uint32_t& numSectors) {
+	fHandle->seekToPosition(sessions[sessionIndex].m_sessionStartSector * 0x200);
+	uint64_t sessionStart = fHandle->tellPosition();
+	if (fHandle->readU16_BE() == 0x524D) {
+		fHandle->seekToPosition(sessionStart + 0x400);
+		uint64_t partitionTableStart = fHandle->tellPosition() / 0x200;
+
+		int partitionMapIndex = 0;
+		while (true)
+		{
+			fHandle->seekToPosition((partitionTableStart + partitionMapIndex) * 0x200);
+			uint16_t pmSig = fHandle->readU16_BE(); assert(pmSig == 0x504D); // signature 
+			fHandle->readU16_BE(); // padding
+			uint32_t pmMapBlkCnt = fHandle->readU32_BE(); /* partition blocks count */
+			uint32_t pmPyPartStart = fHandle->readU32_BE(); /* physical block start of partition */
+			uint32_t pmPartBlkCnt = fHandle->readU32_BE(); /* physical block count of partition */
+			std::string pmPartName = fHandle->readString(32); // partition name
+			std::string pmPartType = fHandle->readString(32); // partition type
+
+			if (pmPartType == partitionType) {
+				firstSector = partitionTableStart - 1 + pmPyPartStart;
+				numSectors = pmPartBlkCnt;
+				return true;
+			}
+			partitionMapIndex++;
+			if (partitionMapIndex >= pmMapBlkCnt) {
+				return false;
+			}
+		}
+	}
+
+	return false;
+}
+
+std::vector<uint8_t> getDTDiskInfo(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle, uint32_t maxSectors) {
+	int64_t firstSector;
+	uint32_t numSectors;
+	if (!findPartition(sessionIndex, sessions, fHandle, "Apple_Data", firstSector, numSectors)) {
+		return std::vector<uint8_t>();
+	}
+	std::vector<uint8_t> data;
+	data.resize(std::min(numSectors, maxSectors) * 0x200);
+	fHandle->readSectors(firstSector, data.size() / 0x200, data.data());
+	return data;
+}
+
+int64_t getHFSStartSector(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
+	int64_t firstSector;
+	uint32_t numSectors;
+	if (!findPartition(sessionIndex, sessions, fHandle, "Apple_HFS", firstSector, numSectors)) {
+		return -1;
+	}
+	return firstSector;
+}
+
+void copySectors(tapeFile* fHandle, int64_t firstSector, int64_t numSectors, FILE* fOutput) {
+	// bounded window, large reads
+	const int64_t windowSectors = 0x200;
+	std::vector<uint8_t> window(std::min(numSectors, windowSectors) * 0x200);
+	while (numSectors > 0) {
+		int chunkSectors = (int)std::min(numSectors, windowSectors);
+		fHandle->readSectors(firstSector, chunkSectors, window.data());
+		fwrite(window.data(), 0x200, chunkSectors, fOutput);
+		firstSector += chunkSectors;
+		numSectors -= chunkSectors;
+	}
+}
+
+bool dumpSystemSectors(sSession& session, tapeFile* fHandle, const std::string& outputFileName) {
+	FILE* fOutput = fopen(outputFileName.c_str(), "wb+");
+	if (fOutput == nullptr) {
+		return false;
+	}
+
+	// Spans are consecutive on tape from the session start + 2, each one lands at its in-disk position
+	int64_t currentSector = session.m_sessionStartSector + 2;
+	int64_t endOfOutput = 0;
+	for (int j = 0; j < session.m_spans.size(); j++) {
+		int64_t destination = session.m_spans[j].m0;
+		int64_t numSectors = std::min<int64_t>(session.m_spans[j].m4, std::max<int64_t>((int64_t)session.m_numSystemSectors - destination, 0));
+		_fseeki64(fOutput, destination * 0x200, SEEK_SET);
+		copySectors(fHandle, currentSector, numSectors, fOutput);
+		currentSector += session.m_spans[j].m4;
+		endOfOutput = std::max(endOfOutput, destination + numSectors);
+	}
+
+	// sectors not covered by any span are zeros
+	if (endOfOutput < session.m_numSystemSectors) {
+		_fseeki64(fOutput, (int64_t)session.m_numSystemSectors * 0x200 - 1, SEEK_SET);
+		fputc(0, fOutput);
+	}
+	fclose(fOutput);
+	return true;
+}
+
+void addSystemSectorsToPass(sSession& session, tapePass& pass, int sinkIndex) {
+	int64_t currentSector = session.m_sessionStartSector + 2;
+	for (int j = 0; j < session.m_spans.size(); j++) {
+		int64_t destination = session.m_spans[j].m0;
+		int64_t numSectors = std::min<int64_t>(session.m_spans[j].m4, std::max<int64_t>((int64_t)session.m_numSystemSectors - destination, 0));
+		pass.addRange(sinkIndex, destination * 0x200, currentSector * 0x200, numSectors * 0x200);
+		currentSector += session.m_spans[j].m4;
+	}
+}
+
+std::optional<sHFSVolume> getHFSVolume(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
+	int64_t HFS_Start = getHFSStartSector(sessionIndex, sessions, fHandle);
+	if(HFS_Start == -1)
+		return std::optional<sHFSVolume>();
+
+	fHandle->seekToSector(HFS_Start);
+
+	// read HFS boot block
+	uint64_t bootBlockPosition = fHandle->tellPosition();
+	{
+		uint16_t bootBlockSignature = fHandle->readU16_BE();
+
+		// boot block can be null if disk is non-bootable (some tapes have been somehow set as bootable)
+		if (bootBlockSignature == 0x4C4B)
+		{
+			uint32_t bootCodeEntryPoint = fHandle->readU32_BE(); assert(bootCodeEntryPoint == 0x60000086);
+			uint16_t bootBlocksVersionNumber = fHandle->readU16_BE(); assert(bootBlocksVersionNumber == 0x4418);
+			uint16_t pageFlags = fHandle->readU16_BE();
+			std::string systemFilename = fHandle->readPascalFixedString(15);
+			std::string finderFilename = fHandle->readPascalFixedString(15);
+			std::string debugger1Filename = fHandle->readPascalFixedString(15);
+			std::string debugger2Filename = fHandle->readPascalFixedString(15);
+			std::string startupScreenFilename = fHandle->readPascalFixedString(15);
+			std::string startupProgramFilename = fHandle->readPascalFixedString(15);
+			std::string scrapFilename = fHandle->readPascalFixedString(15);
+
+			uint16_t numAllocatedFileControlBlocks = fHandle->readU16_BE();
+			uint16_t numMaxEventQueueElements = fHandle->readU16_BE();
+			uint32_t systemHeap128K = fHandle->readU32_BE();
+			uint32_t systemHeap256K = fHandle->readU32_BE();
+			uint32_t systemHeapOther = fHandle->readU32_BE();
+			fHandle->readU16_BE();
+			uint32_t systemHeapSpace = fHandle->readU32_BE();
+			uint32_t fractionHeapFree = fHandle->readU32_BE();
+		}
+	}
+	// read the MDB (Master Directory Block)
+	fHandle->seekToPosition(bootBlockPosition + 0x400);
+	{
+		uint16_t signature = fHandle->readU16_BE();
+		assert(signature == 0x4244);
+		{
+			uint32_t volumeCreationTime = fHandle->readU32_BE();
+			uint32_t volumeModificationTime = fHandle->readU32_BE();
+			uint16_t volumeAttributeFlags = fHandle->readU16_BE();
+			uint16_t numFilesInRoot = fHandle->readU16_BE();
+			uint16_t volumeBitmapBlockNumber = fHandle->readU16_BE();
+			uint16_t startOfNextAllocationSearch = fHandle->readU16_BE();
+			uint16_t numAllocationBlocks = fHandle->readU16_BE();
+			uint32_t allocationBlockSize = fHandle->readU32_BE();
+			uint32_t defaultClump = fHandle->readU32_BE();
+			uint16_t extentsStartBlockNumber = fHandle->readU16_BE();
+			uint32_t nextAvailableCatalogNodeIdentifier = fHandle->readU32_BE();
+			uint16_t numUnusedAllocationBlocks = fHandle->readU16_BE();
+			std::string volumeName = fHandle->readPascalFixedString(27);
+			uint32_t lastBackupTime = fHandle->readU32_BE();
+			uint16_t backupSequenceNumber = fHandle->readU16_BE();
+			uint32_t volumeWriteCount = fHandle->readU32_BE();
+			uint32_t clumpSizeForExtentsFile = fHandle->readU32_BE();
+			uint32_t clumpSizeForCatalogFile = fHandle->readU32_BE();
+			uint16_t numSubDirInRoot = fHandle->readU16_BE();
+			uint32_t totalNumberOfFiles = fHandle->readU32_BE();
+			uint32_t totalNumberOfFolders = fHandle->readU32_BE();
+			fHandle->skip(32); // skip the finder information
+			uint16_t embeddedVolumeSignature = fHandle->readU16_BE();
+			uint32_t embeddedVolumeDescriptor = fHandle->readU32_BE();
+			uint32_t extentsFileSize = fHandle->readU32_BE();
+			uint32_t extentsFileRecord0 = fHandle->readU32_BE();
+			uint32_t extentsFileRecord1 = fHandle->readU32_BE();
+			uint32_t extentsFileRecord2 = fHandle->readU32_BE();
+			uint32_t catalogFileSize = fHandle->readU32_BE();
+			uint32_t catalogFileRecord0 = fHandle->readU32_BE();
+			uint32_t catalogFileRecord1 = fHandle->readU32_BE();
+			uint32_t catalogFileRecord2 = fHandle->readU32_BE();
+
+			sHFSVolume volume;
+			volume.m_bootBlockPosition = bootBlockPosition;
+			volume.m_allocationBlockSize = allocationBlockSize;
+			volume.m_numAllocationBlocks = numAllocationBlocks;
+			volume.m_numFreeAllocationBlocks = numUnusedAllocationBlocks;
+			volume.m_firstAllocationBlockSector = extentsStartBlockNumber; // the extents file is the first allocation block
+
+			// read the volume bitmap block
+			{
+				assert(volumeBitmapBlockNumber == 3);
+				fHandle->seekToPosition(bootBlockPosition + 0x200 * volumeBitmapBlockNumber);
+
+				int numBytes = (numAllocationBlocks / 8);
+				if (numAllocationBlocks % 8) numBytes++;
+
+				std::vector<uint8_t> volumeBitmap;
+				volumeBitmap.resize(numBytes);
+
+				fHandle->readBuffer(volumeBitmap.data(), numBytes);
+				volume.m_bitmap.assign(volumeBitmap, numAllocationBlocks);
+
+				// For consistency
+				int numSectors = numBytes / 512;
+				if (numBytes % 512) numSectors++;
+				assert(volumeBitmapBlockNumber + numSectors == extentsStartBlockNumber);
+			}
+
+			// Read extents
+			{
+				fHandle->seekToPosition(bootBlockPosition + 0x200 * extentsStartBlockNumber);
+				// skip extends
+				bTree extends;
+				//extends.read(fHandle);
+				//extends.dump(outputPath);
+			}
+
+			// Read catalog
+			{
+				// Seek over extends and to catalog
+				fHandle->seekToPosition(bootBlockPosition + 0x200 * extentsStartBlockNumber);
+				assert(((extentsFileRecord0 >> 16) & 0xFFFF) == 0);
+				fHandle->skip(allocationBlockSize * (extentsFileRecord0 & 0xFFFF));
+
+				// make sure there was no extra extents records
+				assert((extentsFileRecord1 & 0xFFFF) == 0);
+				assert((extentsFileRecord2 & 0xFFFF) == 0);
+
+				volume.m_catalogPosition = fHandle->tellPosition();
+				return volume;
+			}
+		}
+
+	}
+}
+
+std::optional<uint64_t> getCatalogPosition(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
+	std::optional<sHFSVolume> volume = getHFSVolume(sessionIndex, sessions, fHandle);
+	if (!volume.has_value()) {
+		return std::optional<uint64_t>();
+	}
+	return volume->m_catalogPosition;
+}
+
+std::optional<bTree> getCatalogSession(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
+	std::optional<sHFSVolume> volume = getHFSVolume(sessionIndex, sessions, fHandle);
+	if (!volume.has_value()) {
+		return std::optional<bTree>();
+	}
+	fHandle->seekToPosition(volume->m_catalogPosition);
+	bTree catalogFile;
+	catalogFile.read(fHandle);
+	// Without a map (no DT disk info) files are read with the default geometry
+	std::shared_ptr<sessionAddressMap> addressMap = std::make_shared<sessionAddressMap>();
+	if (addressMap->build(fHandle, sessions, sessionIndex, *volume)) {
+		catalogFile.m_addressMap = addressMap;
+	}
+	return catalogFile;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "tapeFile.h"
+#include "volumeBitmap.h"
+
+class tapePass;
+
+struct sSession {
+	uint32_t m_sessionStartSector;
+
+	uint16_t m_magic; // always 0x524D 'RM'
+	uint16_t m_sessionID;
+	uint16_t m_sessionID2;
+	uint16_t m_unk6;
+	uint16_t m_unk8;
+	uint16_t m_numSpans;
+	uint32_t m_unkC;
+	uint32_t m_unk10;
+	uint32_t m_unk14;
+	uint16_t m_unk18; // \ Those are related to the 4 bytes at start of archive offset 4
+	uint16_t m_unk1A; // /
+	uint32_t m_unk1C; // always 0x20000
+	std::array<uint8_t, 8> m_TDVersionName;
+	uint32_t m_previousSession;
+	uint32_t m_currentSession;
+	uint32_t m_numSystemSectors;
+	uint32_t m_unk34;
+
+	struct sPan {
+		uint32_t m0;
+		uint32_t m4;
+	};
+	std::vector<sPan> m_spans;
+
+};
+
+// Walks the session back-chain from the last 'RM' header, sessions are returned oldest first
+bool findSessions(tapeFile* fHandle, std::vector<sSession>& sessions);
+
+bool findPartition(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle, const char* partitionType, int64_t& firstSector, uint32_t& numSectors);
+std::vector<uint8_t> getDTDiskInfo(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle, uint32_t maxSectors = UINT32_MAX);
+int64_t getHFSStartSector(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle);
+// What the MDB of a session's HFS volume says about its layout
+struct sHFSVolume {
+	uint64_t m_bootBlockPosition; // tape position of the HFS partition
+	uint32_t m_allocationBlockSize;
+	uint16_t m_numAllocationBlocks;
+	uint16_t m_numFreeAllocationBlocks;
+	uint16_t m_firstAllocationBlockSector; // in 0x200 sectors from the partition start
+	volumeBitmap m_bitmap;
+	uint64_t m_catalogPosition; // tape position of the catalog B-tree header node
+
+	uint64_t getAllocatedBytes() const {
+		return (uint64_t)m_bitmap.countAllocated() * m_allocationBlockSize;
+	}
+};
+std::optional<sHFSVolume> getHFSVolume(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle);
+
+// Tape position of the catalog B-tree header node, read from the MDB
+std::optional<uint64_t> getCatalogPosition(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle);
+std::optional<bTree> getCatalogSession(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle);
+
+// Streams sectors to a file through a small window
+void copySectors(tapeFile* fHandle, int64_t firstSector, int64_t numSectors, FILE* fOutput);
+// Writes the m_numSystemSectors sectors rebuilt from the session spans, without holding them in memory
+bool dumpSystemSectors(sSession& session, tapeFile* fHandle, const std::string& outputFileName);
+// The same sectors registered to a positional sink of a pass, at their offset in the system sectors file
+void addSystemSectorsToPass(sSession& session, tapePass& pass, int sinkIndex);
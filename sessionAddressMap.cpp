@@ -0,0 +1,100 @@
+#include "sessionAddressMap.h"
+
+#include <algorithm>
+
+void sessionAddressMap::addRange(uint64_t size, int64_t tapeOffset) {
+	if (size == 0) {
+		return;
+	}
+	if (!m_ranges.empty()) {
+		// coalesce contiguous ranges
+		sRange& lastRange = m_ranges.back();
+		bool bothZero = lastRange.m_tapeOffset == -1 && tapeOffset == -1;
+		bool contiguous = lastRange.m_tapeOffset != -1 && tapeOffset == lastRange.m_tapeOffset + (int64_t)lastRange.m_size;
+		if (bothZero || contiguous) {
+			lastRange.m_size += size;
+			m_size += size;
+			return;
+		}
+	}
+	sRange& newRange = m_ranges.emplace_back();
+	newRange.m_volumeOffset = m_size;
+	newRange.m_size = size;
+	newRange.m_tapeOffset = tapeOffset;
+	m_size += size;
+}
+
+bool sessionAddressMap::build(tapeFile* fHandle, std::vector<sSession>& sessions, int sessionIndex, const sHFSVolume& volume) {
+	m_ranges.clear();
+	m_size = 0;
+	m_dataRange = -1;
+	m_firstBlockOffset = (uint64_t)volume.m_firstAllocationBlockSector * 0x200;
+	m_blockSize = volume.m_allocationBlockSize;
+
+	sSession& session = sessions[sessionIndex];
+	std::vector<uint8_t> DTDiskInfo = getDTDiskInfo(sessionIndex, sessions, fHandle, 1);
+	if (DTDiskInfo.size() < 0x3A || m_blockSize == 0) {
+		return false;
+	}
+	uint32_t startOfData = ((DTDiskInfo[0x36] << 24) | (DTDiskInfo[0x37] << 16) | (DTDiskInfo[0x38] << 8) | DTDiskInfo[0x39]) + 0xA;
+
+	// Spans copy consecutive tape sectors (from the session start + 2) to their in-volume position, later spans win
+	const int64_t numSystemAreaSectors = 0x100800 / 0x200;
+	int64_t HFSFirstSystemSector = (int64_t)(volume.m_bootBlockPosition / 0x200) - (session.m_sessionStartSector + 2);
+	std::vector<int64_t> systemAreaSources(numSystemAreaSectors, -1);
+	int64_t tapeSector = session.m_sessionStartSector + 2;
+	for (int j = 0; j < session.m_spans.size(); j++) {
+		int64_t spanStart = session.m_spans[j].m0;
+		int64_t spanEnd = spanStart + session.m_spans[j].m4;
+		int64_t first = std::max<int64_t>(spanStart, HFSFirstSystemSector);
+		int64_t last = std::min<int64_t>(spanEnd, HFSFirstSystemSector + numSystemAreaSectors);
+		for (int64_t k = first; k < last; k++) {
+			systemAreaSources[k - HFSFirstSystemSector] = tapeSector + (k - spanStart);
+		}
+		tapeSector += session.m_spans[j].m4;
+	}
+	for (int64_t k = 0; k < numSystemAreaSectors; k++) {
+		addRange(0x200, systemAreaSources[k] == -1 ? -1 : systemAreaSources[k] * 0x200);
+	}
+
+	// Zeros up to the start of data, then the data region straight from the tape
+	m_dataOffset = m_size;
+	if (numSystemAreaSectors <= startOfData) {
+		addRange((startOfData - numSystemAreaSectors) * 0x200, -1);
+		m_dataOffset = m_size;
+
+		int64_t startSector = (0xA - ((int64_t)session.m_currentSession - session.m_sessionStartSector));
+		int64_t endSector = startSector + session.m_currentSession;
+		int64_t firstTapeSector = std::max<int64_t>(startSector, 0);
+		int64_t lastTapeSector = std::min<int64_t>(endSector, fHandle->getNumSectors());
+		addRange((firstTapeSector - startSector) * 0x200, -1);
+		if (lastTapeSector > firstTapeSector) {
+			// never coalesced, the zeros before it are a different range
+			m_dataRange = (int)m_ranges.size();
+			addRange((lastTapeSector - firstTapeSector) * 0x200, firstTapeSector * 0x200);
+		}
+		addRange((endSector - std::max(lastTapeSector, firstTapeSector)) * 0x200, -1);
+	}
+	return true;
+}
+
+int64_t sessionAddressMap::getTapeOffset(uint64_t volumeOffset, uint64_t* contiguousSize) const {
+	const sRange* range = nullptr;
+	if (m_dataRange != -1 && volumeOffset >= m_ranges[m_dataRange].m_volumeOffset && volumeOffset - m_ranges[m_dataRange].m_volumeOffset < m_ranges[m_dataRange].m_size) {
+		range = &m_ranges[m_dataRange];
+	}
+	else if (volumeOffset < m_size) {
+		range = &*(std::upper_bound(m_ranges.begin(), m_ranges.end(), volumeOffset, [](uint64_t offset, const sRange& range) { return offset < range.m_volumeOffset; }) - 1);
+	}
+	else {
+		if (contiguousSize) {
+			*contiguousSize = 0;
+		}
+		return -1;
+	}
+	uint64_t offsetInRange = volumeOffset - range->m_volumeOffset;
+	if (contiguousSize) {
+		*contiguousSize = range->m_size - offsetInRange;
+	}
+	return range->m_tapeOffset == -1 ? -1 : range->m_tapeOffset + (int64_t)offsetInRange;
+}
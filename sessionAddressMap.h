@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "session.h"
+
+// Where every byte of a session's HFS volume (the session_N.dsk image) is on the tape, built once per session.
+// The volume starts with 0x100800 bytes of system sectors copied from the tape by the session spans, then zeros up
+// to the start of data given by the DT disk info, then the data region read straight from the tape, shifted by the
+// session position. Allocation blocks are placed from the MDB (first block sector and block size).
+class sessionAddressMap {
+public:
+	struct sRange {
+		uint64_t m_volumeOffset;
+		uint64_t m_size;
+		int64_t m_tapeOffset; // -1 for zeros
+	};
+
+	bool build(tapeFile* fHandle, std::vector<sSession>& sessions, int sessionIndex, const sHFSVolume& volume);
+
+	// Tape offset of a volume byte, -1 when it reads as zeros. contiguousSize receives how many bytes from there on
+	// keep the same translation (0 past the end of the volume). The data region is looked up in constant time.
+	int64_t getTapeOffset(uint64_t volumeOffset, uint64_t* contiguousSize = nullptr) const;
+
+	uint64_t getAllocationBlockOffset(uint32_t allocationBlock) const {
+		return m_firstBlockOffset + (uint64_t)allocationBlock * m_blockSize;
+	}
+	int64_t getAllocationBlockTapeOffset(uint32_t allocationBlock) const {
+		return getTapeOffset(getAllocationBlockOffset(allocationBlock));
+	}
+	uint32_t getAllocationBlockSize() const {
+		return m_blockSize;
+	}
+
+	// Ranges in volume order, contiguous ones coalesced
+	const std::vector<sRange>& getRanges() const {
+		return m_ranges;
+	}
+	uint64_t getSize() const {
+		return m_size;
+	}
+	// Volume offset where the data region starts, the end of the volume when it has none
+	uint64_t getDataOffset() const {
+		return m_dataOffset;
+	}
+
+private:
+	void addRange(uint64_t size, int64_t tapeOffset);
+
+	std::vector<sRange> m_ranges;
+	uint64_t m_size = 0;
+	uint64_t m_dataOffset = 0;
+	uint64_t m_firstBlockOffset = 0;
+	uint32_t m_blockSize = 0;
+	int m_dataRange = -1; // the range read straight from the tape
+};
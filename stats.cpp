@@ -0,0 +1,206 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static std::atomic<uint64_t> s_allocatedBytes = 0;
+static std::atomic<uint64_t> s_peakAllocatedBytes = 0;
+
+// Every block carries its size in front of it, 16 bytes keeps the returned pointer aligned for any type
+static const size_t ALLOCATION_HEADER_SIZE = 16;
+
+void* operator new(size_t size) {
+	void* block = malloc(size + ALLOCATION_HEADER_SIZE);
+	if (block == nullptr) {
+		throw std::bad_alloc();
+	}
+	*(size_t*)block = size;
+	uint64_t allocated = s_allocatedBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	uint64_t peak = s_peakAllocatedBytes.load(std::memory_order_relaxed);
+	while (allocated > peak && !s_peakAllocatedBytes.compare_exchange_weak(peak, allocated, std::memory_order_relaxed)) {
+	}
+	return (uint8_t*)block + ALLOCATION_HEADER_SIZE;
+}
+
+// Released by the operator delete below as well (std::stable_sort's temporary buffer), so it carries the header too
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return operator new(size);
+	}
+	catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* pointer) noexcept {
+	if (pointer == nullptr) {
+		return;
+	}
+	void* block = (uint8_t*)pointer - ALLOCATION_HEADER_SIZE;
+	s_allocatedBytes.fetch_sub(*(size_t*)block, std::memory_order_relaxed);
+	free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	operator delete(pointer);
+}
+
+uint64_t getAllocatedBytes() {
+	return s_allocatedBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t getPeakAllocatedBytes() {
+	return s_peakAllocatedBytes.load(std::memory_order_relaxed);
+}
+
+void resetPeakAllocatedBytes() {
+	s_peakAllocatedBytes.store(s_allocatedBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+double getProcessCPUTime() {
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+	uint64_t kernel = ((uint64_t)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime;
+	uint64_t user = ((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+	return (kernel + user) / 10000.0; // 100ns units
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+#endif
+}
+
+static double getWallTime() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void stageStats::open(tapeFile* fHandle) {
+	m_fHandle = fHandle;
+	m_stages.clear();
+	m_totalIO = sIOStats();
+	m_wallStart = getWallTime();
+	m_CPUStart = getProcessCPUTime();
+	m_peakAllocatedBytes = getAllocatedBytes();
+}
+
+void stageStats::beginStage(const char* name, int sessionIndex) {
+	m_current = sStageStats();
+	m_current.m_name = name;
+	m_current.m_sessionIndex = sessionIndex;
+	m_currentIOStart = m_fHandle->getIOStats();
+	m_fHandle->setStage(sessionIndex == -1 ? name : (std::string(name) + "[" + std::to_string(sessionIndex) + "]").c_str());
+	resetPeakAllocatedBytes();
+	m_currentWallStart = getWallTime();
+	m_currentCPUStart = getProcessCPUTime();
+}
+
+void stageStats::endStage() {
+	m_current.m_wallTime = getWallTime() - m_currentWallStart;
+	m_current.m_CPUTime = getProcessCPUTime() - m_currentCPUStart;
+	m_current.m_peakAllocatedBytes = getPeakAllocatedBytes();
+	const sIOStats& io = m_fHandle->getIOStats();
+	m_current.m_io.m_bytesRead = io.m_bytesRead - m_currentIOStart.m_bytesRead;
+	m_current.m_io.m_readCalls = io.m_readCalls - m_currentIOStart.m_readCalls;
+	m_current.m_io.m_seeks = io.m_seeks - m_currentIOStart.m_seeks;
+	m_current.m_io.m_seekDistance = io.m_seekDistance - m_currentIOStart.m_seekDistance;
+	m_peakAllocatedBytes = std::max(m_peakAllocatedBytes, m_current.m_peakAllocatedBytes);
+	m_stages.push_back(m_current);
+	m_totalIO = io;
+}
+
+void stageStats::close() {
+	if (m_fHandle) {
+		m_totalIO = m_fHandle->getIOStats();
+		m_fHandle = nullptr;
+	}
+}
+
+std::string escapeJSON(const std::string& string) {
+	std::string escaped;
+	for (int i = 0; i < string.size(); i++) {
+		unsigned char character = string[i];
+		if (character == '"' || character == '\\') {
+			escaped += '\\';
+			escaped += character;
+		}
+		else if (character < 0x20) {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", character);
+			escaped += buffer;
+		}
+		else {
+			escaped += character;
+		}
+	}
+	return escaped;
+}
+
+static void writeStageJSON(FILE* fOutput, const char* indent, const char* name, const sStageStats& stage) {
+	fprintf(fOutput, "%s{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"peak_allocated_bytes\": %llu, \"bytes_read\": %llu, \"read_calls\": %llu, \"seeks\": %llu, \"seek_distance\": %llu}",
+		indent, escapeJSON(name).c_str(), stage.m_wallTime, stage.m_CPUTime, (unsigned long long)stage.m_peakAllocatedBytes,
+		(unsigned long long)stage.m_io.m_bytesRead, (unsigned long long)stage.m_io.m_readCalls, (unsigned long long)stage.m_io.m_seeks, (unsigned long long)stage.m_io.m_seekDistance);
+}
+
+bool stageStats::writeJSON(const std::string& outputFileName, const std::string& imageName) const {
+	FILE* fOutput = fopen(outputFileName.c_str(), "w");
+	if (fOutput == nullptr) {
+		return false;
+	}
+
+	sStageStats total;
+	total.m_wallTime = getWallTime() - m_wallStart;
+	total.m_CPUTime = getProcessCPUTime() - m_CPUStart;
+	total.m_peakAllocatedBytes = m_peakAllocatedBytes;
+	total.m_io = m_fHandle ? m_fHandle->getIOStats() : m_totalIO;
+
+	fprintf(fOutput, "{\n\t\"image\": \"%s\",\n", escapeJSON(imageName).c_str());
+	writeStageJSON(fOutput, "\t\"total\": ", "total", total);
+	fprintf(fOutput, ",\n\t\"stages\": [");
+	bool first = true;
+	for (int i = 0; i < m_stages.size(); i++) {
+		if (m_stages[i].m_sessionIndex == -1) {
+			fprintf(fOutput, first ? "\n" : ",\n");
+			writeStageJSON(fOutput, "\t\t", m_stages[i].m_name.c_str(), m_stages[i]);
+			first = false;
+		}
+	}
+	fprintf(fOutput, "\n\t],\n\t\"sessions\": [");
+
+	// Session stages are grouped by session, in the order they ran
+	int lastSession = -1;
+	for (int i = 0; i < m_stages.size(); i++) {
+		int sessionIndex = m_stages[i].m_sessionIndex;
+		if (sessionIndex == -1 || sessionIndex <= lastSession) {
+			continue;
+		}
+		fprintf(fOutput, "%s\n\t\t{\"session\": %d, \"stages\": [", lastSession == -1 ? "" : ",", sessionIndex);
+		bool firstInSession = true;
+		for (int j = i; j < m_stages.size(); j++) {
+			if (m_stages[j].m_sessionIndex == sessionIndex) {
+				fprintf(fOutput, firstInSession ? "\n" : ",\n");
+				writeStageJSON(fOutput, "\t\t\t", m_stages[j].m_name.c_str(), m_stages[j]);
+				firstInSession = false;
+			}
+		}
+		fprintf(fOutput, "\n\t\t]}");
+		lastSession = sessionIndex;
+	}
+	fprintf(fOutput, "\n\t]\n}\n");
+	fclose(fOutput);
+	return true;
+}
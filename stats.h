@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "tapeFile.h"
+
+// Process wide heap accounting, fed by the global operator new/delete in stats.cpp
+uint64_t getAllocatedBytes();
+uint64_t getPeakAllocatedBytes();
+void resetPeakAllocatedBytes();
+
+// Milliseconds of CPU used by the process (all threads)
+double getProcessCPUTime();
+
+// Escapes quotes, backslashes and control characters for a JSON string
+std::string escapeJSON(const std::string& string);
+
+struct sStageStats {
+	std::string m_name;
+	int m_sessionIndex = -1; // -1 for stages covering the whole image
+	double m_wallTime = 0;
+	double m_CPUTime = 0;
+	uint64_t m_peakAllocatedBytes = 0;
+	sIOStats m_io;
+};
+
+// Wall/CPU time, peak heap and tape I/O of each stage of one image. Stages don't nest.
+class stageStats {
+public:
+	void open(tapeFile* fHandle);
+	void beginStage(const char* name, int sessionIndex = -1);
+	void endStage();
+	// Takes the final I/O of the image, the tape can be closed afterwards
+	void close();
+
+	bool writeJSON(const std::string& outputFileName, const std::string& imageName) const;
+
+private:
+	tapeFile* m_fHandle = nullptr;
+	std::vector<sStageStats> m_stages;
+	sStageStats m_current;
+	sIOStats m_currentIOStart;
+	sIOStats m_totalIO;
+	double m_currentWallStart = 0;
+	double m_currentCPUStart = 0;
+	double m_wallStart = 0;
+	double m_CPUStart = 0;
+	uint64_t m_peakAllocatedBytes = 0;
+};
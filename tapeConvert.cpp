@@ -0,0 +1,97 @@
+#include "tapeConvert.h"
+#include "fileAccess.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+static const int64_t CPTP_HEADER_SIZE = 0x10;
+static const int64_t CPTP_SECTOR_SIZE = 0x211;
+static const int64_t CPTP_TRAILER_SIZE = CPTP_SECTOR_SIZE - 0x200;
+static const int64_t CPTP_FOOTER_SIZE = 0x2;
+static const int64_t SECTORS_PER_CHUNK = 0x800;
+
+bool convertCptpToRaw(const std::string& inputFileName, const std::string& outputFileName, const std::string& trailerFileName, int numThreads) {
+	positionalFile input;
+	if (!input.open(inputFileName, false)) {
+		printf("Can't open %s\n", inputFileName.c_str());
+		return false;
+	}
+	int64_t inputSize = input.getSize();
+	int64_t numSectors = (inputSize - CPTP_HEADER_SIZE - CPTP_FOOTER_SIZE) / CPTP_SECTOR_SIZE;
+	if (inputSize < CPTP_HEADER_SIZE + CPTP_FOOTER_SIZE || numSectors * CPTP_SECTOR_SIZE + CPTP_HEADER_SIZE + CPTP_FOOTER_SIZE != inputSize) {
+		printf("%s is not a .cptp image\n", inputFileName.c_str());
+		return false;
+	}
+
+	positionalFile output;
+	if (!output.open(outputFileName, true) || !output.setSize(numSectors * 0x200)) {
+		printf("Can't create %s\n", outputFileName.c_str());
+		return false;
+	}
+	positionalFile trailers;
+	bool keepTrailers = !trailerFileName.empty();
+	if (keepTrailers) {
+		uint8_t header[CPTP_HEADER_SIZE];
+		uint8_t footer[CPTP_FOOTER_SIZE];
+		if (!trailers.open(trailerFileName, true)
+			|| input.readAt(0, header, CPTP_HEADER_SIZE) != CPTP_HEADER_SIZE
+			|| input.readAt(inputSize - CPTP_FOOTER_SIZE, footer, CPTP_FOOTER_SIZE) != CPTP_FOOTER_SIZE
+			|| trailers.writeAt(0, header, CPTP_HEADER_SIZE) != CPTP_HEADER_SIZE
+			|| trailers.writeAt(CPTP_HEADER_SIZE + numSectors * CPTP_TRAILER_SIZE, footer, CPTP_FOOTER_SIZE) != CPTP_FOOTER_SIZE) {
+			printf("Can't create %s\n", trailerFileName.c_str());
+			return false;
+		}
+	}
+
+	// Threads pull chunks of sectors, every chunk has its own place in each file so no locking is needed
+	int64_t numChunks = (numSectors + SECTORS_PER_CHUNK - 1) / SECTORS_PER_CHUNK;
+	std::atomic<int64_t> nextChunk = 0;
+	std::atomic<bool> failed = false;
+	auto worker = [&]() {
+		std::vector<uint8_t> inputBuffer(SECTORS_PER_CHUNK * CPTP_SECTOR_SIZE);
+		std::vector<uint8_t> sectorBuffer(SECTORS_PER_CHUNK * 0x200);
+		std::vector<uint8_t> trailerBuffer(SECTORS_PER_CHUNK * CPTP_TRAILER_SIZE);
+		for (int64_t chunk = nextChunk++; chunk < numChunks && !failed; chunk = nextChunk++) {
+			int64_t firstSector = chunk * SECTORS_PER_CHUNK;
+			int64_t chunkSectors = std::min(SECTORS_PER_CHUNK, numSectors - firstSector);
+			int64_t inputChunkSize = chunkSectors * CPTP_SECTOR_SIZE;
+			if (input.readAt(CPTP_HEADER_SIZE + firstSector * CPTP_SECTOR_SIZE, inputBuffer.data(), inputChunkSize) != inputChunkSize) {
+				failed = true;
+				break;
+			}
+			for (int64_t i = 0; i < chunkSectors; i++) {
+				memcpy(&sectorBuffer[i * 0x200], &inputBuffer[i * CPTP_SECTOR_SIZE], 0x200);
+				memcpy(&trailerBuffer[i * CPTP_TRAILER_SIZE], &inputBuffer[i * CPTP_SECTOR_SIZE + 0x200], CPTP_TRAILER_SIZE);
+			}
+			if (output.writeAt(firstSector * 0x200, sectorBuffer.data(), chunkSectors * 0x200) != chunkSectors * 0x200) {
+				failed = true;
+				break;
+			}
+			if (keepTrailers && trailers.writeAt(CPTP_HEADER_SIZE + firstSector * CPTP_TRAILER_SIZE, trailerBuffer.data(), chunkSectors * CPTP_TRAILER_SIZE) != chunkSectors * CPTP_TRAILER_SIZE) {
+				failed = true;
+				break;
+			}
+		}
+	};
+
+	numThreads = (int)std::max<int64_t>(1, std::min<int64_t>(numThreads, numChunks));
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; i++) {
+		threads.emplace_back(worker);
+	}
+	for (int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	if (failed) {
+		printf("Failed to convert %s\n", inputFileName.c_str());
+		return false;
+	}
+	printf("Converted %lld sectors with %d threads\n", (long long)numSectors, numThreads);
+	return true;
+}
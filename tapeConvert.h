@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+// Turns a .cptp into a raw image: the 0x10 byte header and the 0x11 byte trailer after every sector are stripped.
+// When trailerFileName is set, everything stripped (header, trailers, end of file) is kept there in file order.
+bool convertCptpToRaw(const std::string& inputFileName, const std::string& outputFileName, const std::string& trailerFileName, int numThreads);
@@ -4,233 +4,155 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <array>
 #include <regex>
 #include <filesystem>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <algorithm>
 
 #include "btree.h"
 #include "fileAccess.h"
-
-struct sSession {
-	uint32_t m_sessionStartSector;
-
-	uint16_t m_magic; // always 0x524D 'RM'
-	uint16_t m_sessionID;
-	uint16_t m_sessionID2;
-	uint16_t m_unk6;
-	uint16_t m_unk8;
-	uint16_t m_numSpans;
-	uint32_t m_unkC;
-	uint32_t m_unk10;
-	uint32_t m_unk14;
-	uint16_t m_unk18; // \ Those are related to the 4 bytes at start of archive offset 4
-	uint16_t m_unk1A; // /
-	uint32_t m_unk1C; // always 0x20000
-	std::array<uint8_t, 8> m_TDVersionName;
-	uint32_t m_previousSession;
-	uint32_t m_currentSession;
-	uint32_t m_numSystemSectors;
-	uint32_t m_unk34;
-
-	struct sPan {
-		uint32_t m0;
-		uint32_t m4;
-	};
-	std::vector<sPan> m_spans;
-
+#include "pathFilter.h"
+#include "contentStore.h"
+#include "extractJournal.h"
+#include "checksumManifest.h"
+#include "catalogDelta.h"
+#include "session.h"
+#include "virtualDisk.h"
+#include "nbdServer.h"
+#include "hash.h"
+#include "tapeConvert.h"
+#include "imageGenerator.h"
+#include "benchmark.h"
+#include "stats.h"
+#include "progress.h"
+#include "ioTrace.h"
+#include "traceReplay.h"
+#include "catalogInventory.h"
+#include "tarWriter.h"
+#include "recoveryScan.h"
+#include "extractDaemon.h"
+#include "nameIndex.h"
+#include "tapePass.h"
+#include "uringWriter.h"
+#include "platform.h"
+
+struct sOptions {
+	std::vector<std::string> m_positional;
+	bool m_extractFiles = false;
+	pathFilter m_filter;
+	std::string m_storePath;
+	bool m_resume = false;
+	bool m_verify = false;
+	bool m_merged = false;
+	bool m_keepDeleted = false; // merged view of every file ever backed up, not only the final state
+	std::string m_statsFormat;
+	bool m_verbose = false;
+	bool m_trace = false;
+	std::string m_listFormat; // catalog inventory only, no outputs but the list
+	std::string m_tarPath; // extracted files go into this archive, "-" for stdout
+	bool m_directIO = false;
+	bool m_uring = false; // io_uring reads ahead and batched output writes
+	bool m_keepFreeBlocks = false; // .dsk data region with the content of unallocated blocks
+	std::string m_socketPath; // daemon only
+	int m_numJobs = 0; // daemon workers, 0 for the default
+	bool m_prefix = false; // query by name prefix instead of substring
 };
 
-std::vector<uint8_t> getDTDiskInfo(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
-	fHandle->seekToPosition(sessions[sessionIndex].m_sessionStartSector * 0x200);
-	uint64_t sessionStart = fHandle->tellPosition();
-	if (fHandle->readU16_BE() == 0x524D) {
-		fHandle->seekToPosition(sessionStart + 0x400);
-		uint64_t partitionTableStart = fHandle->tellPosition() / 0x200;
-
-		int partitionMapIndex = 0;
-		while (true)
-		{
-			fHandle->seekToPosition((partitionTableStart + partitionMapIndex) * 0x200);
-			uint16_t pmSig = fHandle->readU16_BE(); assert(pmSig == 0x504D); // signature 
-			fHandle->readU16_BE(); // padding
-			uint32_t pmMapBlkCnt = fHandle->readU32_BE(); /* partition blocks count */
-			uint32_t pmPyPartStart = fHandle->readU32_BE(); /* physical block start of partition */
-			uint32_t pmPartBlkCnt = fHandle->readU32_BE(); /* physical block count of partition */
-			std::string pmPartName = fHandle->readString(32); // partition name
-			std::string pmPartType = fHandle->readString(32); // partition type
-
-			if (pmPartType == "Apple_Data") {
-				std::vector<uint8_t> data;
-				data.resize(pmPartBlkCnt * 0x200);
-				fHandle->seekToSector(partitionTableStart - 1 + pmPyPartStart);
-				fHandle->readBuffer(data.data(), data.size());
-				return data;
-			}
-			partitionMapIndex++;
-			if (partitionMapIndex >= pmMapBlkCnt) {
-				return std::vector<uint8_t>();
-			}
+bool parseOptions(int argc, char** argv, sOptions& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		if (argument.rfind("--", 0) != 0) {
+			options.m_positional.push_back(argument);
 		}
-	}
-
-	return std::vector<uint8_t>();
-}
-
-int64_t getHFSStartSector(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
-	fHandle->seekToPosition(sessions[sessionIndex].m_sessionStartSector * 0x200);
-	uint64_t sessionStart = fHandle->tellPosition();
-	if (fHandle->readU16_BE() == 0x524D) {
-		fHandle->seekToPosition(sessionStart + 0x400);
-		uint64_t partitionTableStart = fHandle->tellPosition() / 0x200;
-
-		int partitionMapIndex = 0;
-		while (true)
-		{
-			fHandle->seekToPosition((partitionTableStart + partitionMapIndex) * 0x200);
-			uint16_t pmSig = fHandle->readU16_BE(); assert(pmSig == 0x504D); // signature 
-			fHandle->readU16_BE(); // padding
-			uint32_t pmMapBlkCnt = fHandle->readU32_BE(); /* partition blocks count */
-			uint32_t pmPyPartStart = fHandle->readU32_BE(); /* physical block start of partition */
-			uint32_t pmPartBlkCnt = fHandle->readU32_BE(); /* physical block count of partition */
-			std::string pmPartName = fHandle->readString(32); // partition name
-			std::string pmPartType = fHandle->readString(32); // partition type
-
-			if (pmPartType == "Apple_HFS") {
-				return (partitionTableStart - 1 + pmPyPartStart);
-			}
-			partitionMapIndex++;
-			if (partitionMapIndex >= pmMapBlkCnt) {
-				return -1;
-			}
+		else if (argument == "--extract") {
+			options.m_extractFiles = true;
 		}
-	}
-
-	return -1;
-}
-
-std::optional<bTree> getCatalogSession(int sessionIndex, std::vector<sSession>& sessions, tapeFile* fHandle) {
-	int64_t HFS_Start = getHFSStartSector(sessionIndex, sessions, fHandle);
-	if(HFS_Start == -1)
-		return std::optional<bTree>();
-
-	fHandle->seekToSector(HFS_Start);
-
-	// read HFS boot block
-	uint64_t bootBlockPosition = fHandle->tellPosition();
-	{
-		uint16_t bootBlockSignature = fHandle->readU16_BE();
-
-		// boot block can be null if disk is non-bootable (some tapes have been somehow set as bootable)
-		if (bootBlockSignature == 0x4C4B)
-		{
-			uint32_t bootCodeEntryPoint = fHandle->readU32_BE(); assert(bootCodeEntryPoint == 0x60000086);
-			uint16_t bootBlocksVersionNumber = fHandle->readU16_BE(); assert(bootBlocksVersionNumber == 0x4418);
-			uint16_t pageFlags = fHandle->readU16_BE();
-			std::string systemFilename = fHandle->readPascalFixedString(15);
-			std::string finderFilename = fHandle->readPascalFixedString(15);
-			std::string debugger1Filename = fHandle->readPascalFixedString(15);
-			std::string debugger2Filename = fHandle->readPascalFixedString(15);
-			std::string startupScreenFilename = fHandle->readPascalFixedString(15);
-			std::string startupProgramFilename = fHandle->readPascalFixedString(15);
-			std::string scrapFilename = fHandle->readPascalFixedString(15);
-
-			uint16_t numAllocatedFileControlBlocks = fHandle->readU16_BE();
-			uint16_t numMaxEventQueueElements = fHandle->readU16_BE();
-			uint32_t systemHeap128K = fHandle->readU32_BE();
-			uint32_t systemHeap256K = fHandle->readU32_BE();
-			uint32_t systemHeapOther = fHandle->readU32_BE();
-			fHandle->readU16_BE();
-			uint32_t systemHeapSpace = fHandle->readU32_BE();
-			uint32_t fractionHeapFree = fHandle->readU32_BE();
-		}
-	}
-	// read the MDB (Master Directory Block)
-	fHandle->seekToPosition(bootBlockPosition + 0x400);
-	{
-		uint16_t signature = fHandle->readU16_BE();
-		assert(signature == 0x4244);
-		{
-			uint32_t volumeCreationTime = fHandle->readU32_BE();
-			uint32_t volumeModificationTime = fHandle->readU32_BE();
-			uint16_t volumeAttributeFlags = fHandle->readU16_BE();
-			uint16_t numFilesInRoot = fHandle->readU16_BE();
-			uint16_t volumeBitmapBlockNumber = fHandle->readU16_BE();
-			uint16_t startOfNextAllocationSearch = fHandle->readU16_BE();
-			uint16_t numAllocationBlocks = fHandle->readU16_BE();
-			uint32_t allocationBlockSize = fHandle->readU32_BE();
-			uint32_t defaultClump = fHandle->readU32_BE();
-			uint16_t extentsStartBlockNumber = fHandle->readU16_BE();
-			uint32_t nextAvailableCatalogNodeIdentifier = fHandle->readU32_BE();
-			uint16_t numUnusedAllocationBlocks = fHandle->readU16_BE();
-			std::string volumeName = fHandle->readPascalFixedString(27);
-			uint32_t lastBackupTime = fHandle->readU32_BE();
-			uint16_t backupSequenceNumber = fHandle->readU16_BE();
-			uint32_t volumeWriteCount = fHandle->readU32_BE();
-			uint32_t clumpSizeForExtentsFile = fHandle->readU32_BE();
-			uint32_t clumpSizeForCatalogFile = fHandle->readU32_BE();
-			uint16_t numSubDirInRoot = fHandle->readU16_BE();
-			uint32_t totalNumberOfFiles = fHandle->readU32_BE();
-			uint32_t totalNumberOfFolders = fHandle->readU32_BE();
-			fHandle->skip(32); // skip the finder information
-			uint16_t embeddedVolumeSignature = fHandle->readU16_BE();
-			uint32_t embeddedVolumeDescriptor = fHandle->readU32_BE();
-			uint32_t extentsFileSize = fHandle->readU32_BE();
-			uint32_t extentsFileRecord0 = fHandle->readU32_BE();
-			uint32_t extentsFileRecord1 = fHandle->readU32_BE();
-			uint32_t extentsFileRecord2 = fHandle->readU32_BE();
-			uint32_t catalogFileSize = fHandle->readU32_BE();
-			uint32_t catalogFileRecord0 = fHandle->readU32_BE();
-			uint32_t catalogFileRecord1 = fHandle->readU32_BE();
-			uint32_t catalogFileRecord2 = fHandle->readU32_BE();
-
-			// read the volume bitmap block
-			{
-				assert(volumeBitmapBlockNumber == 3);
-				fHandle->seekToPosition(bootBlockPosition + 0x200 * volumeBitmapBlockNumber);
-
-				int numBytes = (numAllocationBlocks / 8);
-				if (numAllocationBlocks % 8) numBytes++;
-
-				std::vector<uint8_t> volumeBitmap;
-				volumeBitmap.resize(numBytes);
-
-				fHandle->readBuffer(volumeBitmap.data(), numBytes);
-
-				// For consistency
-				int numSectors = numBytes / 512;
-				if (numBytes % 512) numSectors++;
-				assert(volumeBitmapBlockNumber + numSectors == extentsStartBlockNumber);
+		else if (argument.rfind("--include=", 0) == 0) {
+			options.m_filter.addInclude(argument.substr(strlen("--include=")));
+			options.m_extractFiles = true;
+		}
+		else if (argument.rfind("--exclude=", 0) == 0) {
+			options.m_filter.addExclude(argument.substr(strlen("--exclude=")));
+			options.m_extractFiles = true;
+		}
+		else if (argument == "--merged") {
+			options.m_merged = true;
+		}
+		else if (argument == "--keep-deleted") {
+			options.m_keepDeleted = true;
+		}
+		else if (argument == "--verify") {
+			options.m_verify = true;
+		}
+		else if (argument == "--trace") {
+			options.m_trace = true;
+		}
+		else if (argument == "--keep-free-blocks") {
+			options.m_keepFreeBlocks = true;
+		}
+		else if (argument == "--direct") {
+			options.m_directIO = true;
+		}
+		else if (argument == "--uring") {
+			options.m_uring = true;
+		}
+		else if (argument == "--prefix") {
+			options.m_prefix = true;
+		}
+		else if (argument == "--verbose") {
+			options.m_verbose = true;
+		}
+		else if (argument == "--resume") {
+			options.m_resume = true;
+		}
+		else if (argument.rfind("--stats=", 0) == 0) {
+			options.m_statsFormat = argument.substr(strlen("--stats="));
+			if (options.m_statsFormat != "json") {
+				printf("Unknown stats format %s\n", options.m_statsFormat.c_str());
+				return false;
 			}
-
-			// Read extents
-			{
-				fHandle->seekToPosition(bootBlockPosition + 0x200 * extentsStartBlockNumber);
-				// skip extends
-				bTree extends;
-				//extends.read(fHandle);
-				//extends.dump(outputPath);
+		}
+		else if (argument.rfind("--list=", 0) == 0) {
+			options.m_listFormat = argument.substr(strlen("--list="));
+			catalogInventory::eFormat format;
+			if (!catalogInventory::parseFormat(options.m_listFormat, format)) {
+				printf("Unknown list format %s\n", options.m_listFormat.c_str());
+				return false;
 			}
-
-			// Read catalog
-			{
-				// Seek over extends and to catalog
-				fHandle->seekToPosition(bootBlockPosition + 0x200 * extentsStartBlockNumber);
-				assert(((extentsFileRecord0 >> 16) & 0xFFFF) == 0);
-				fHandle->skip(allocationBlockSize * (extentsFileRecord0 & 0xFFFF));
-
-				// make sure there was no extra extents records
-				assert((extentsFileRecord1 & 0xFFFF) == 0);
-				assert((extentsFileRecord2 & 0xFFFF) == 0);
-
-				bTree catalogFile;
-				catalogFile.read(fHandle);
-				//catalogFile.dump(outputPath);
-				return catalogFile;
+		}
+		else if (argument.rfind("--tar=", 0) == 0) {
+			options.m_tarPath = argument.substr(strlen("--tar="));
+			options.m_extractFiles = true;
+		}
+		else if (argument.rfind("--socket=", 0) == 0) {
+			options.m_socketPath = argument.substr(strlen("--socket="));
+		}
+		else if (argument.rfind("--jobs=", 0) == 0) {
+			options.m_numJobs = atoi(argument.substr(strlen("--jobs=")).c_str());
+			if (options.m_numJobs < 1) {
+				printf("--jobs needs a number of workers\n");
+				return false;
 			}
 		}
-
+		else if (argument.rfind("--dedup=", 0) == 0) {
+			options.m_storePath = argument.substr(strlen("--dedup="));
+			options.m_extractFiles = true;
+		}
+		else {
+			printf("Unknown option %s\n", argument.c_str());
+			return false;
+		}
+	}
+	if (!options.m_tarPath.empty() && !options.m_storePath.empty()) {
+		printf("--tar and --dedup can't be combined\n");
+		return false;
 	}
+	return true;
 }
 
 std::vector<std::filesystem::path> FindFiles(const std::filesystem::path& root, const std::string& filePattern) {
@@ -262,294 +184,821 @@ std::vector<std::filesystem::path> FindFiles(const std::filesystem::path& root,
 	return ret;
 }
 
-int main(int argc, char** argv)
-{
-	if (argc < 2) {
-		printf("Need input file or pattern");
-		return -1;
-	}
-	const std::vector<std::filesystem::path> inputFiles = FindFiles("", argv[1]);
-	for (int i = 0; i < inputFiles.size(); i++) {
-		const std::filesystem::path inputFile = inputFiles[i];
-		printf("Processing %s\n", inputFile.string().c_str());
+static void reportVolumeUsage(progressReporter& progress, int sessionIndex, const sHFSVolume& volume) {
+	progress.message("Session %d: %u of %u allocation blocks in use (%.1f of %.1f MB)\n", sessionIndex, volume.m_bitmap.countAllocated(), volume.m_bitmap.getNumBlocks(),
+		volume.getAllocatedBytes() / 1048576.0, (double)volume.m_numAllocationBlocks * volume.m_allocationBlockSize / 1048576.0);
+}
 
-		tapeFile* fHandle = nullptr;
-		if (!_stricmp(inputFile.extension().string().c_str(), ".cptp")) {
-			fHandle = new tapeFile_cptp();
-		}
-		else {
-			fHandle = new tapeFile_raw();
-		}
-		if (!fHandle->open(inputFile.string().c_str())) {
-			printf("Can't open file %s", inputFile);
+// Everything for one tape image, outputs go to outputPath
+// Everything read and written for one opened tape, processImage closes it whatever the outcome
+static int extractImage(tapeFile* fHandle, const std::filesystem::path& inputFile, const std::string& outputPath, const sOptions& options, bTree::sDumpSettings dumpSettings, progressReporter& progress) {
+	std::string filesPath = dumpSettings.m_tar ? inputFile.filename().string() : outputPath;
+
+	// Everything written for this tape is journaled, --resume skips what an interrupted run already wrote
+	extractJournal journal;
+	if (options.m_listFormat.empty()) {
+		if (!journal.open(outputPath + "/extract.journal", options.m_resume)) {
+			printf("Can't open journal in %s", outputPath.c_str());
 			return -1;
 		}
+		dumpSettings.m_journal = &journal;
+	}
 
-		std::string outputPath = "";
-		if (argc > 2) {
-			outputPath = argv[2];
-		}
-		if (outputPath.length() == 0) {
-			outputPath = std::string("output\\") + inputFile.filename().string() + "\\";
+	uint16_t deskTapeMagic = fHandle->readU16_BE();
+	if (deskTapeMagic != 0x4454) {
+		printf("Not a valid DeskTape");
+		return -1;
+	}
+	uint32_t versionMagic = fHandle->readU32_BE();
+
+	/*
+	* Actually not useful, can compute that from the session header
+	// Figure out where the data starts
+	int32_t sectorOffset = 0;
+	for (int i = 0; i < 0x20; i++) {
+		fseek(fHandle, 0x200 * i, SEEK_SET);
+		uint16_t magic = fHandle->readU16_BE();
+		if (magic != deskTapeMagic) {
+			sectorOffset = i - 0xA; // data should always start at 0x1400?
+			break;
 		}
-		std::filesystem::create_directories(outputPath);
+	}
+	*/
+
+	stageStats stats;
+	stats.open(fHandle);
 
-		uint16_t deskTapeMagic = fHandle->readU16_BE();
-		if (deskTapeMagic != 0x4454) {
-			printf("Not a valid DeskTape");
+	std::vector<sSession> sessions;
+	stats.beginStage("session_scan");
+	if (!findSessions(fHandle, sessions)) {
+		printf("Failed to find last session");
+		return -1;
+	}
+	stats.endStage();
+
+	// Inventory mode stops after the catalogs, no file data is read
+	if (!options.m_listFormat.empty()) {
+		catalogInventory inventory;
+		catalogInventory::eFormat format;
+		catalogInventory::parseFormat(options.m_listFormat, format);
+		if (!inventory.open(outputPath + "/catalog." + options.m_listFormat, format)) {
+			printf("Can't create catalog list in %s", outputPath.c_str());
 			return -1;
 		}
-		uint32_t versionMagic = fHandle->readU32_BE();
+		for (int i = 0; i < sessions.size(); i++) {
+			stats.beginStage("catalog_list", i);
+			std::optional<sHFSVolume> volume = getHFSVolume(i, sessions, fHandle);
+			if (volume.has_value()) {
+				reportVolumeUsage(progress, i, *volume);
+				if (!inventory.addSession(fHandle, volume->m_catalogPosition, i)) {
+					progress.message("Can't read the catalog of session %d\n", i);
+				}
+			}
+			stats.endStage();
+		}
+		inventory.close();
+		progress.message("Listed %llu catalog records\n", (unsigned long long)inventory.m_numEntries);
+		stats.close();
+		if (options.m_statsFormat == "json") {
+			stats.writeJSON(outputPath + "/stats.json", inputFile.string());
+		}
+		return 0;
+	}
 
-		/*
-		* Actually not useful, can compute that from the session header
-		// Figure out where the data starts
-		int32_t sectorOffset = 0;
-		for (int i = 0; i < 0x20; i++) {
-			fseek(fHandle, 0x200 * i, SEEK_SET);
-			uint16_t magic = fHandle->readU16_BE();
-			if (magic != deskTapeMagic) {
-				sectorOffset = i - 0xA; // data should always start at 0x1400?
-				break;
+	// Read every catalog up front and diff each session against the previous one
+	std::vector<std::optional<bTree>> catalogs(sessions.size());
+	catalogDelta delta;
+	delta.m_keepDeleted = options.m_keepDeleted;
+	for (int i = 0; i < sessions.size(); i++) {
+		stats.beginStage("catalog_read", i);
+		catalogs[i] = getCatalogSession(i, sessions, fHandle);
+		stats.endStage();
+		if (catalogs[i].has_value()) {
+			stats.beginStage("catalog_delta", i);
+			std::vector<catalogDelta::sChange> changes = delta.addSession(*catalogs[i], i);
+			if (i > 0) {
+				catalogDelta::writeReport(outputPath + "/" + "session_" + std::to_string(i) + "_delta.txt", changes);
 			}
+			stats.endStage();
 		}
-		*/
+	}
 
-		// Look for last session
-		uint32_t archiveSize = fHandle->getNumSectors() * 0x200;
-		int32_t numSectors = archiveSize / 0x200;
-		int32_t lastSessionSector = -1;
-		for (uint32_t sector = numSectors - 1; sector >= 0; sector--) {
-			fHandle->seekToPosition(sector * 0x200);
-			if (fHandle->readU16_BE() == 0x524D) {
-				lastSessionSector = sector;
-				break;
+	// Resolve what will be written so progress has a total
+	std::vector<std::vector<bTree::sExtractJob>> sessionJobs(sessions.size());
+	std::vector<bTree::sExtractJob> mergedJobs;
+	std::vector<std::optional<sHFSVolume>> volumes(sessions.size());
+	uint64_t imageTotal = 0;
+	for (int i = 0; i < sessions.size(); i++) {
+		volumes[i] = getHFSVolume(i, sessions, fHandle);
+		if (volumes[i].has_value()) {
+			reportVolumeUsage(progress, i, *volumes[i]);
+		}
+		if (options.m_extractFiles && catalogs[i].has_value()) {
+			stats.beginStage("path_resolution", i);
+			sessionJobs[i] = catalogs[i]->getExtractJobs(&options.m_filter);
+			stats.endStage();
+			for (int j = 0; j < sessionJobs[i].size(); j++) {
+				imageTotal += sessionJobs[i][j].m_record->m_FileRecord.m_dataForkBlockSize;
 			}
 		}
-		if (lastSessionSector == -1) {
-			printf("Failed to find last session");
-			return -1;
+		imageTotal += (uint64_t)sessions[i].m_numSystemSectors * 0x200;
+		int64_t DTDiskInfoSector;
+		uint32_t DTDiskInfoNumSectors;
+		if (findPartition(i, sessions, fHandle, "Apple_Data", DTDiskInfoSector, DTDiskInfoNumSectors)) {
+			imageTotal += (uint64_t)DTDiskInfoNumSectors * 0x200;
+		}
+	}
+	virtualDisk firstSessionDisk;
+	if (sessions.size() && firstSessionDisk.open(fHandle, sessions, 0, options.m_keepFreeBlocks)) {
+		imageTotal += firstSessionDisk.getSize();
+	}
+	if (options.m_merged) {
+		mergedJobs = delta.getMergedJobs(&options.m_filter);
+		for (int j = 0; j < mergedJobs.size(); j++) {
+			imageTotal += mergedJobs[j].m_record->m_FileRecord.m_dataForkBlockSize;
+		}
+	}
+	progress.setImageTotal(imageTotal);
+
+	// Every output is fed from a single pass over the tape, run once they are all registered. The archive and the
+	// store take one file at a time, with them each stage reads the tape itself
+	uringWriter writer;
+	tapePass pass;
+	tapePass* singlePass = (dumpSettings.m_tar || dumpSettings.m_store) ? nullptr : &pass;
+	if (singlePass && options.m_uring && writer.init()) {
+		dumpSettings.m_writer = &writer;
+	}
+	// With a single pass the output stages only register ranges, their reads and writes are all in single_pass
+	auto beginOutputStage = [&](const char* name, int sessionIndex) {
+		if (!singlePass) {
+			stats.beginStage(name, sessionIndex);
+		}
+	};
+	auto endOutputStage = [&]() {
+		if (!singlePass) {
+			stats.endStage();
 		}
+	};
+	std::vector<checksumManifest> manifests(sessions.size());
 
-		std::vector<sSession> sessions;
+	// Dump sessions
+	for (int i = 0; i < sessions.size(); i++)
+	{
+		progress.setStage("session " + std::to_string(i + 1) + "/" + std::to_string(sessions.size()));
+		sSession& session = sessions[i];
+		// Dump session data
+		if (FILE* fOutput = fopen((outputPath + "/" + "session_" + std::to_string(i) + "_info.txt").c_str(), "w+")) {
+			fprintf(fOutput, "Session %d\n", i);
+			fprintf(fOutput, "m_sessionID 0x%04X\n", session.m_sessionID);
+			fprintf(fOutput, "m_sessionID2 0x%04X\n", session.m_sessionID2);
+			fprintf(fOutput, "m_unk6 0x%04X\n", session.m_unk6);
+			fprintf(fOutput, "m_unk8 0x%04X\n", session.m_unk8);
+			fprintf(fOutput, "m_numSpans 0x%04X\n", session.m_numSpans);
+			fprintf(fOutput, "m_unkC 0x%08X\n", session.m_unkC);
+			fprintf(fOutput, "m_unk10 0x%08X\n", session.m_unk10);
+			fprintf(fOutput, "m_unk14 0x%08X\n", session.m_unk14);
+			fprintf(fOutput, "m_unk18 0x%04X\n", session.m_unk18);
+			fprintf(fOutput, "m_unk1A 0x%04X\n", session.m_unk1A);
+			fprintf(fOutput, "m_unk1C 0x%08X\n", session.m_unk1C);
+			fprintf(fOutput, "m_TDVersionName "); for (int i = 0; i < 8; i++) { fprintf(fOutput, "%c", session.m_TDVersionName[i]); } fprintf(fOutput, "\n");
+			fprintf(fOutput, "m_previousSession 0x%08X\n", session.m_previousSession);
+			fprintf(fOutput, "m_currentSession 0x%08X\n", session.m_currentSession);
+			fprintf(fOutput, "m_numSystemSectors 0x%08X\n", session.m_numSystemSectors);
+			fprintf(fOutput, "m_unk34 0x%08X\n", session.m_unk34);
+			assert(session.m_numSpans == session.m_spans.size());
+			for (int j = 0; j < session.m_numSpans; j++) {
+				fprintf(fOutput, "Span %d 0x%08X 0x%08X\n", j, session.m_spans[j].m0, session.m_spans[j].m4);
+			}
+			if (volumes[i].has_value()) {
+				fprintf(fOutput, "Allocation blocks in use %u/%u (0x%X bytes each)\n", volumes[i]->m_bitmap.countAllocated(), volumes[i]->m_bitmap.getNumBlocks(), volumes[i]->m_allocationBlockSize);
+				std::vector<volumeBitmap::sRun> runs = volumes[i]->m_bitmap.getAllocatedRuns();
+				for (int j = 0; j < runs.size(); j++) {
+					fprintf(fOutput, "Allocated run 0x%04X 0x%04X\n", runs[j].m_firstBlock, runs[j].m_numBlocks);
+				}
+			}
+			fclose(fOutput);
+		}
 
-		// Find all sessions
-		uint32_t currentSessionSector = lastSessionSector;
-		while (true) {
-			fHandle->seekToPosition(currentSessionSector * 0x200);
-			sSession newSession;
-			newSession.m_sessionStartSector = currentSessionSector;
-
-			newSession.m_magic = fHandle->readU16_BE();
-			if (newSession.m_magic != 0x524D)
-				break;
-			newSession.m_sessionID = fHandle->readU16_BE();
-			newSession.m_sessionID2 = fHandle->readU16_BE();
-			newSession.m_unk6 = fHandle->readU16_BE();
-			newSession.m_unk8 = fHandle->readU16_BE(); // 1 in last session?
-			newSession.m_numSpans = fHandle->readU16_BE();
-			newSession.m_unkC = fHandle->readU32_BE(); // some sector number to something, looks more or less like the end of current session
-			newSession.m_unk10 = fHandle->readU32_BE(); // the offset to remap file system sectors
-			newSession.m_unk14 = fHandle->readU32_BE();
-			newSession.m_unk18 = fHandle->readU16_BE();
-			newSession.m_unk1A = fHandle->readU16_BE();
-			newSession.m_unk1C = fHandle->readU32_BE();
-			for (int i = 0; i < 8; i++) {
-				newSession.m_TDVersionName[i] = fHandle->readU8();
+		checksumManifest& manifest = manifests[i];
+		manifest.open(outputPath + "/" + "session_" + std::to_string(i) + "_manifest.txt", outputPath);
+		dumpSettings.m_manifest = &manifest;
+
+		std::optional<bTree>& catalogFileSession = catalogs[i];
+		if (catalogFileSession.has_value()) {
+			catalogFileSession->dumpLeafNodes(outputPath + "/" + "session_" + std::to_string(i) + "_nodes.txt");
+			if (options.m_extractFiles) {
+				beginOutputStage("extraction", i);
+				bTree::extractJobs(fHandle, filesPath + "/" + "session_" + std::to_string(i) + "_files/", sessionJobs[i], dumpSettings, singlePass);
+				endOutputStage();
 			}
-			newSession.m_previousSession = fHandle->readU32_BE();
-			newSession.m_currentSession = fHandle->readU32_BE();
-			newSession.m_numSystemSectors = fHandle->readU32_BE(); // directory size required for mounting
-			newSession.m_unk34 = fHandle->readU32_BE();
-			for (int i = 0; i < newSession.m_numSpans; i++) {
-				auto& newSpan = newSession.m_spans.emplace_back();
-				newSpan.m0 = fHandle->readU32_BE(); // in-disk offset (-0x60)
-				newSpan.m4 = fHandle->readU32_BE(); // size in sectors
+			//std::optional<bTree> catalogFileSessionNext = getCatalogSession(i+1, sessions, fHandle);
+		}
+
+		// Dump system sectors
+		if (true) {
+			std::string outputSessionSystemSectorsFileName = outputPath + "/" + "session_" + std::to_string(i) + "_system_sectors.bin";
+			beginOutputStage("system_sectors", i);
+			if (singlePass) {
+				int sinkIndex = pass.addSink(std::make_unique<tapePassFile>(outputSessionSystemSectorsFileName, (uint64_t)session.m_numSystemSectors * 0x200, &progress, nullptr, dumpSettings.m_writer));
+				addSystemSectorsToPass(session, pass, sinkIndex);
 			}
-			sessions.insert(sessions.begin(), newSession);
+			else {
+				dumpSystemSectors(session, fHandle, outputSessionSystemSectorsFileName);
+				progress.addBytes((uint64_t)session.m_numSystemSectors * 0x200);
+			}
+			endOutputStage();
+		}
 
-			if (newSession.m_previousSession == 0) {
-				break;
+		// Dump the DT disk info partition
+		int64_t DTDiskInfoSector;
+		uint32_t DTDiskInfoNumSectors;
+		beginOutputStage("disk_info", i);
+		if (findPartition(i, sessions, fHandle, "Apple_Data", DTDiskInfoSector, DTDiskInfoNumSectors)) {
+			std::string outputDTDiskInfoFileName = outputPath + "/" + "session_" + std::to_string(i) + "_DT_diskInfo.bin";
+			if (singlePass) {
+				int sinkIndex = pass.addSink(std::make_unique<tapePassFile>(outputDTDiskInfoFileName, (uint64_t)DTDiskInfoNumSectors * 0x200, &progress, nullptr, dumpSettings.m_writer));
+				pass.addRange(sinkIndex, 0, DTDiskInfoSector * 0x200, (uint64_t)DTDiskInfoNumSectors * 0x200);
+			}
+			else {
+				if (FILE* fOutput = fopen(outputDTDiskInfoFileName.c_str(), "wb+")) {
+					copySectors(fHandle, DTDiskInfoSector, DTDiskInfoNumSectors, fOutput);
+					fclose(fOutput);
+				}
+				progress.addBytes((uint64_t)DTDiskInfoNumSectors * 0x200);
 			}
-			currentSessionSector = newSession.m_previousSession - (newSession.m_currentSession - newSession.m_sessionStartSector);
 		}
+		endOutputStage();
 
-		// Dump sessions
-		for (int i = 0; i < sessions.size(); i++)
+		// Dump the session as a .DSK
+		if (i == 0)
 		{
-			printf("Session %i/%i\n", i, sessions.size());
-			sSession& session = sessions[i];
-			// Dump session data
-			if (FILE* fOutput = fopen(std::format("{}/session_{}_info.txt", outputPath.c_str(), i).c_str(), "w+")) {
-				fprintf(fOutput, "Session %d\n", i);
-				fprintf(fOutput, "m_sessionID 0x%04X\n", session.m_sessionID);
-				fprintf(fOutput, "m_sessionID2 0x%04X\n", session.m_sessionID2);
-				fprintf(fOutput, "m_unk6 0x%04X\n", session.m_unk6);
-				fprintf(fOutput, "m_unk8 0x%04X\n", session.m_unk8);
-				fprintf(fOutput, "m_numSpans 0x%04X\n", session.m_numSpans);
-				fprintf(fOutput, "m_unkC 0x%08X\n", session.m_unkC);
-				fprintf(fOutput, "m_unk10 0x%08X\n", session.m_unk10);
-				fprintf(fOutput, "m_unk14 0x%08X\n", session.m_unk14);
-				fprintf(fOutput, "m_unk18 0x%04X\n", session.m_unk18);
-				fprintf(fOutput, "m_unk1A 0x%04X\n", session.m_unk1A);
-				fprintf(fOutput, "m_unk1C 0x%08X\n", session.m_unk1C);
-				fprintf(fOutput, "m_TDVersionName "); for (int i = 0; i < 8; i++) { fprintf(fOutput, "%c", session.m_TDVersionName[i]); } fprintf(fOutput, "\n");
-				fprintf(fOutput, "m_previousSession 0x%08X\n", session.m_previousSession);
-				fprintf(fOutput, "m_currentSession 0x%08X\n", session.m_currentSession);
-				fprintf(fOutput, "m_numSystemSectors 0x%08X\n", session.m_numSystemSectors);
-				fprintf(fOutput, "m_unk34 0x%08X\n", session.m_unk34);
-				assert(session.m_numSpans == session.m_spans.size());
-				for (int j = 0; j < session.m_numSpans; j++) {
-					fprintf(fOutput, "Span %d 0x%08X 0x%08X\n", j, session.m_spans[j].m0, session.m_spans[j].m4);
+			beginOutputStage("dsk_build", i);
+			virtualDisk& disk = firstSessionDisk;
+			if (disk.getSize()) {
+				std::string outputSessionFileName = outputPath + "/" + "session_" + std::to_string(i) + ".dsk";
+				if (const extractJournal::sEntry* journaled = journal.findDone(outputSessionFileName)) {
+					journal.m_numSkipped++;
+					manifest.addEntry(outputSessionFileName, journaled->m_size, journaled->m_checksums);
+					progress.addBytes(disk.getSize());
+				}
+				else if (singlePass) {
+					uint64_t diskSize = disk.getSize();
+					int sinkIndex = pass.addSink(std::make_unique<tapePassFile>(outputSessionFileName, diskSize, &progress, [&journal, &manifest, outputSessionFileName, diskSize](const sChecksums& checksums) {
+						journal.addEntry(0, extractJournal::FORK_IMAGE, diskSize, checksums, outputSessionFileName);
+						manifest.addEntry(outputSessionFileName, diskSize, checksums);
+					}, dumpSettings.m_writer));
+					disk.addToPass(pass, sinkIndex);
+				}
+				else {
+					sChecksums checksums;
+					if (disk.writeImage(outputSessionFileName, &checksums, &progress)) {
+						journal.addEntry(0, extractJournal::FORK_IMAGE, disk.getSize(), checksums, outputSessionFileName);
+						manifest.addEntry(outputSessionFileName, disk.getSize(), checksums);
+					}
 				}
-				fclose(fOutput);
 			}
+			endOutputStage();
+		}
 
-			std::optional<bTree> catalogFileSession = getCatalogSession(i, sessions, fHandle);
-			if (catalogFileSession.has_value()) {
-				catalogFileSession->dumpLeafNodes(std::format("{}/session_{}_nodes.txt", outputPath.c_str(), i));
-				//std::optional<bTree> catalogFileSessionNext = getCatalogSession(i+1, sessions, fHandle);
-			}
+		// Checkpoint the sweep at each session boundary, a single pass does once it ran
+		if (!singlePass) {
+			journal.flush();
+			manifest.close();
+		}
+		dumpSettings.m_manifest = nullptr;
 
-			std::vector<uint8_t> systemSectors;
-			systemSectors.resize(session.m_numSystemSectors * 0x200);
+		/*
 
-			int currentSector = session.m_sessionStartSector + 2;
-			fHandle->seekToSector(currentSector);
-			std::vector<uint8_t>::iterator systemSectorDestination = systemSectors.begin();
-			/*
-			for (int k = 0; k < session.m_numSystemSectors; k++) {
-				std::array<uint8_t, 0x200> buffer;
-				fHandle->readBuffer(&systemSectorDestination[0], 0x200);
-				systemSectorDestination += 0x200;
-			}
-			*/
+		fHandle->seekToPosition(session.m_sessionStartSector * 0x200 + 0x400);
+		std::filesystem::create_directories(outputPath);
+		std::string outputSession = outputPath + "/" + "session_" + std::to_string(i) + "_system_sectors.bin";
+		if (FILE* fOutputSession = fopen(outputSession.c_str(), "wb+")) {
+			// write the system sectors
+			fHandle->seekToSector(session.m_sessionStartSector + 2);
 			for (int j = 0; j < session.m_spans.size(); j++) {
-				std::vector<uint8_t>::iterator systemSectorDestination = systemSectors.begin() + session.m_spans[j].m0 * 0x200;
+				fseek(fOutputSession, session.m_spans[j].m0 * 0x200, SEEK_SET);
 				for (int k = 0; k < session.m_spans[j].m4; k++) {
 					std::array<uint8_t, 0x200> buffer;
-					fHandle->readSector(currentSector++, buffer);
-					memcpy(&(*systemSectorDestination), buffer.data(), 0x200);
-					systemSectorDestination += 0x200;
+					fHandle->readBuffer(buffer.data(), 0x200);
+					fwrite(buffer.data(), 1, 0x200, fOutputSession);
 				}
 			}
+			fclose(fOutputSession);
+		}
+		*/
+	}
 
-			// Dump system sectors
-			if (true) {
-				std::string outputSessionSystemSectorsFileName = outputPath + "/" + "session_" + std::to_string(i) + "_system_sectors.bin";
-				if (FILE* fOutputSessionSystemSectors = fopen(outputSessionSystemSectorsFileName.c_str(), "wb+")) {
-					fwrite(systemSectors.data(), 1, systemSectors.size(), fOutputSessionSystemSectors);
-					fclose(fOutputSessionSystemSectors);
-				}
-			}
 
-			std::vector<uint8_t> DTDiskInfo = getDTDiskInfo(i, sessions, fHandle);
-			uint32_t startOfData = _byteswap_ulong(*(uint32_t*)(DTDiskInfo.data() + 0x36)) + 0xA;
+	// Final state of the tape, every file read once from the newest session holding it
+	checksumManifest mergedManifest;
+	if (options.m_merged) {
+		mergedManifest.open(outputPath + "/merged_manifest.txt", outputPath);
+		dumpSettings.m_manifest = &mergedManifest;
+		progress.setStage("merged view");
+		progress.message("Merged view: %d files from %d sessions\n", (int)mergedJobs.size(), (int)sessions.size());
+		beginOutputStage("merged_extraction", -1);
+		bTree::extractJobs(fHandle, filesPath + "/merged_files/", mergedJobs, dumpSettings, singlePass);
+		endOutputStage();
+		dumpSettings.m_manifest = nullptr;
+	}
 
-			// Dump the DT disk info partition
-			if (FILE* fOutput = fopen(std::format("{}/session_{}_DT_diskInfo.bin", outputPath.c_str(), i).c_str(), "wb+")) {
-				fwrite(DTDiskInfo.data(), 1, DTDiskInfo.size(), fOutput);
-				fclose(fOutput);
-			}
+	if (singlePass) {
+		progress.setStage("single pass");
+		stats.beginStage("single_pass");
+		pass.run(fHandle);
+		// the last files are journaled once written
+		writer.finish();
+		stats.endStage();
+		journal.flush();
+		for (int i = 0; i < manifests.size(); i++) {
+			manifests[i].close();
+		}
+	}
+	mergedManifest.close();
 
-			// Dump the session as a .DSK
-			if (i == 0)
-			{
-				int64_t HFSStartSector = getHFSStartSector(i, sessions, fHandle);
-				if (HFSStartSector != -1) {
-					HFSStartSector -= session.m_sessionStartSector + 2;
-					std::string outputSessionFileName = outputPath + "/" + "session_" + std::to_string(i) + ".dsk";
-					if (FILE* fOutputSession = fopen(outputSessionFileName.c_str(), "wb+")) {
-						fwrite(systemSectors.data() + HFSStartSector * 0x200, 1, 0x100800, fOutputSession);
-
-						int startOfDataSectors = startOfData;
-						/*
-						if (catalogFileSession.has_value()) {
-							std::vector<bTree::sSortedEntry> sortedNodes = catalogFileSession->getSortedNodes();
-							int firstFileSector = ((sortedNodes[0].m_startSector * 0x9800) + (1*0x9800)) / 0x200;
-							startOfDataSectors = firstFileSector;
-						}
-						*/
-
-						if (ftell(fOutputSession) / 0x200 <= startOfDataSectors) {
-							while (ftell(fOutputSession) / 0x200 != startOfDataSectors) {
-								std::array<uint8_t, 0x200> buffer;
-								buffer.fill(0);
-								fwrite(buffer.data(), 1, 0x200, fOutputSession);
-							}
-
-							std::array<uint8_t, 0x200> buffer;
-							int startSector = (0xA - (session.m_currentSession - session.m_sessionStartSector));
-							int endSector = startSector + session.m_currentSession;
-							for (int k = startSector; k < endSector; k++) {
-								fHandle->readSector(k, buffer);
-								fwrite(buffer.data(), 1, 0x200, fOutputSession);
-							}
-						}
-
-						fclose(fOutputSession);
-					}
+	if (journal.m_numSkipped) {
+		progress.message("Resumed: %llu outputs already written\n", (unsigned long long)journal.m_numSkipped);
+	}
+	journal.close();
+	dumpSettings.m_journal = nullptr;
+	stats.close();
+
+	if (options.m_statsFormat == "json") {
+		stats.writeJSON(outputPath + "/stats.json", inputFile.string());
+	}
+
+#if 0
+	// Dump session as a HFS file
+	for (int i = 0; i < 1; i++)
+	{
+		sSession& session = sessions[i];
+		fHandle->seekToPosition(session.m_sessionStartSector * 0x200 + 0x400);
+		std::filesystem::create_directories(outputPath);
+		std::string outputSession = outputPath + "/" + "session_" + std::to_string(i) + ".HFS";
+		if (FILE* fOutputSession = fopen(outputSession.c_str(), "wb+")) {
+			// write the system sectors
+			fHandle->seekToSector(session.m_sessionStartSector + 2);
+			for (int j = 0; j < session.m_spans.size(); j++) {
+				fseek(fOutputSession, session.m_spans[j].m0 * 0x200, SEEK_SET);
+				for (int k = 0; k < session.m_spans[j].m4; k++) {
+					std::array<uint8_t, 0x200> buffer;
+					fHandle->readBuffer(buffer.data(), 0x200);
+					fwrite(buffer.data(), 1, 0x200, fOutputSession);
 				}
 			}
 
 			/*
-
-			fHandle->seekToPosition(session.m_sessionStartSector * 0x200 + 0x400);
-			std::filesystem::create_directories(outputPath);
-			std::string outputSession = outputPath + "/" + "session_" + std::to_string(i) + "_system_sectors.bin";
-			if (FILE* fOutputSession = fopen(outputSession.c_str(), "wb+")) {
-				// write the system sectors
-				fHandle->seekToSector(session.m_sessionStartSector + 2);
-				for (int j = 0; j < session.m_spans.size(); j++) {
-					fseek(fOutputSession, session.m_spans[j].m0 * 0x200, SEEK_SET);
-					for (int k = 0; k < session.m_spans[j].m4; k++) {
-						std::array<uint8_t, 0x200> buffer;
-						fHandle->readBuffer(buffer.data(), 0x200);
-						fwrite(buffer.data(), 1, 0x200, fOutputSession);
-					}
-				}
-				fclose(fOutputSession);
+			// Go to beginning of data
+			fHandle->seekToPosition((0xA - (session.m_currentSession - session.m_sessionStartSector)) * 0x200);
+			fseek(fOutputSession, 0xBB2 * 0x200, SEEK_SET);
+			for (int k = 0; k < session.m_currentSession; k++) {
+				std::array<uint8_t, 0x200> buffer;
+				fHandle->readBuffer(buffer.data(), 0x200);
+				fwrite(buffer.data(), 1, 0x200, fOutputSession);
 			}
 			*/
+
+
+			fclose(fOutputSession);
 		}
+	}
+#endif
 
+	return 0;
+}
 
-#if 0
-		// Dump session as a HFS file
-		for (int i = 0; i < 1; i++)
-		{
-			sSession& session = sessions[i];
-			fHandle->seekToPosition(session.m_sessionStartSector * 0x200 + 0x400);
-			std::filesystem::create_directories(outputPath);
-			std::string outputSession = outputPath + "/" + "session_" + std::to_string(i) + ".HFS";
-			if (FILE* fOutputSession = fopen(outputSession.c_str(), "wb+")) {
-				// write the system sectors
-				fHandle->seekToSector(session.m_sessionStartSector + 2);
-				for (int j = 0; j < session.m_spans.size(); j++) {
-					fseek(fOutputSession, session.m_spans[j].m0 * 0x200, SEEK_SET);
-					for (int k = 0; k < session.m_spans[j].m4; k++) {
-						std::array<uint8_t, 0x200> buffer;
-						fHandle->readBuffer(buffer.data(), 0x200);
-						fwrite(buffer.data(), 1, 0x200, fOutputSession);
-					}
-				}
+static int processImage(const std::filesystem::path& inputFile, const std::string& outputPath, const sOptions& options, bTree::sDumpSettings dumpSettings, progressReporter& progress) {
+	progress.message("Processing %s\n", inputFile.string().c_str());
+	// Listing reads no file data, its progress is the count of records listed it prints
+	bool reportBytes = options.m_listFormat.empty();
+	if (reportBytes) {
+		progress.beginImage(inputFile.filename().string(), std::filesystem::file_size(inputFile));
+	}
 
-				/*
-				// Go to beginning of data
-				fHandle->seekToPosition((0xA - (session.m_currentSession - session.m_sessionStartSector)) * 0x200);
-				fseek(fOutputSession, 0xBB2 * 0x200, SEEK_SET);
-				for (int k = 0; k < session.m_currentSession; k++) {
-					std::array<uint8_t, 0x200> buffer;
-					fHandle->readBuffer(buffer.data(), 0x200);
-					fwrite(buffer.data(), 1, 0x200, fOutputSession);
-				}
-				*/
+	// The daemon goes through many images, every outcome closes the tape and ends the image
+	std::unique_ptr<tapeFile> fHandle(openTape(inputFile, options.m_directIO, options.m_uring));
+	int result = -1;
+	if (fHandle) {
+		std::filesystem::create_directories(outputPath);
+
+		// Record every tape access of this image
+		bool traced = true;
+		if (options.m_trace) {
+			tapeFile_trace* trace = new tapeFile_trace(fHandle.release());
+			fHandle.reset(trace);
+			traced = trace->openTrace(outputPath + "/io.trace");
+			if (!traced) {
+				printf("Can't create trace in %s", outputPath.c_str());
+			}
+		}
+		if (traced) {
+			result = extractImage(fHandle.get(), inputFile, outputPath, options, dumpSettings, progress);
+		}
+	}
+	if (reportBytes) {
+		progress.endImage();
+	}
+	return result;
+}
 
+// openTape asserts on an image that isn't whole sectors, one still being copied mustn't take the daemon down
+static bool hasWholeSectors(const std::filesystem::path& inputFile) {
+	std::error_code error;
+	uint64_t size = std::filesystem::file_size(inputFile, error);
+	if (error || size == 0) {
+		return false;
+	}
+	if (!_stricmp(inputFile.extension().string().c_str(), ".cptp")) {
+		return size >= 0x12 && (size - 0x12) % 0x211 == 0;
+	}
+	return size % 0x200 == 0;
+}
+
+// daemon <watch folder|-> <output root> [--socket=path] [--jobs=N], every image goes to <output root>/<image name>
+int runDaemon(const sOptions& options) {
+	if (options.m_positional.size() < 3 || (options.m_positional[1] == "-" && options.m_socketPath.empty())) {
+		printf("Usage: daemon <watch folder|-> <output root> [--socket=path] [--jobs=N]");
+		return -1;
+	}
+	if (!options.m_tarPath.empty() || !options.m_listFormat.empty()) {
+		printf("--tar and --list can't be used by the daemon");
+		return -1;
+	}
+	int numWorkers = options.m_numJobs ? options.m_numJobs : std::max<int>(1, std::thread::hardware_concurrency() / 2);
+	// CPU time and peak heap are process wide, concurrent jobs would count each other's
+	if (!options.m_statsFormat.empty() && numWorkers > 1) {
+		printf("Stage statistics are process wide, running one job at a time\n");
+		numWorkers = 1;
+	}
 
-				fclose(fOutputSession);
+	// Kept open for the daemon's lifetime, its index stays in memory between jobs
+	contentStore store;
+	if (!options.m_storePath.empty()) {
+		if (!store.open(options.m_storePath)) {
+			printf("Can't open content store %s", options.m_storePath.c_str());
+			return -1;
+		}
+		if (numWorkers > 1) {
+			printf("The content store isn't shared between workers, running one job at a time\n");
+			numWorkers = 1;
+		}
+	}
+
+	// A restarted daemon skips whatever an earlier one already wrote
+	sOptions jobOptions = options;
+	jobOptions.m_resume = true;
+
+	std::vector<std::unique_ptr<progressReporter>> progress(numWorkers);
+	for (int i = 0; i < numWorkers; i++) {
+		progress[i] = std::make_unique<progressReporter>();
+		progress[i]->m_lineMode = true;
+		progress[i]->beginBatch(1, 0);
+	}
+
+	extractDaemon daemon(options.m_positional[2]);
+	if (options.m_positional[1] != "-" && !daemon.watchFolder(options.m_positional[1])) {
+		return -1;
+	}
+	if (!options.m_socketPath.empty() && !daemon.listen(options.m_socketPath)) {
+		return -1;
+	}
+	daemon.run(numWorkers, [&](int workerIndex, const std::string& imagePath, const std::string& outputPath) {
+		if (!hasWholeSectors(imagePath)) {
+			printf("%s isn't a whole number of sectors\n", imagePath.c_str());
+			return false;
+		}
+		bTree::sDumpSettings dumpSettings;
+		dumpSettings.m_filter = &jobOptions.m_filter;
+		dumpSettings.m_store = options.m_storePath.empty() ? nullptr : &store;
+		dumpSettings.m_progress = progress[workerIndex].get();
+		dumpSettings.m_verbose = jobOptions.m_verbose;
+		return processImage(imagePath, outputPath, jobOptions, dumpSettings, *progress[workerIndex]) == 0;
+	});
+	for (int i = 0; i < numWorkers; i++) {
+		progress[i]->endBatch();
+	}
+	return 0;
+}
+
+// index <image pattern> <index file>
+int runIndex(const sOptions& options) {
+	if (options.m_positional.size() < 3) {
+		printf("Usage: index <image pattern> <index file>");
+		return -1;
+	}
+	const std::vector<std::filesystem::path> inputFiles = FindFiles("", options.m_positional[1]);
+	nameIndexWriter index;
+	for (int i = 0; i < inputFiles.size(); i++) {
+		tapeFile* fHandle = openTape(inputFiles[i], options.m_directIO, options.m_uring);
+		if (fHandle == nullptr) {
+			printf(", skipping it\n");
+			continue;
+		}
+		std::vector<sSession> sessions;
+		if (fHandle->readU16_BE() != 0x4454 || !findSessions(fHandle, sessions)) {
+			printf("Skipping %s, not a valid DeskTape\n", inputFiles[i].string().c_str());
+			delete fHandle;
+			continue;
+		}
+		index.beginTape(inputFiles[i].filename().string());
+		for (int j = 0; j < sessions.size(); j++) {
+			std::optional<sHFSVolume> volume = getHFSVolume(j, sessions, fHandle);
+			if (!volume.has_value() || !index.addSession(fHandle, volume->m_catalogPosition, j)) {
+				printf("Can't read the catalog of session %d of %s\n", j, inputFiles[i].string().c_str());
 			}
 		}
-#endif
+		printf("Indexed %s, %llu entries so far\n", inputFiles[i].string().c_str(), (unsigned long long)index.getNumEntries());
+		delete fHandle;
+	}
+	if (!index.write(options.m_positional[2])) {
+		printf("Can't write %s\n", options.m_positional[2].c_str());
+		return -1;
+	}
+	return 0;
+}
+
+// query <index file> <text> [--prefix], tab separated: tape, session, kind, size, modified, path
+int runQuery(const sOptions& options) {
+	static const size_t MAX_RESULTS = 1000;
+	if (options.m_positional.size() < 3) {
+		printf("Usage: query <index file> <text> [--prefix]");
+		return -1;
+	}
+	nameIndex index;
+	if (!index.open(options.m_positional[1])) {
+		printf("Can't open index %s\n", options.m_positional[1].c_str());
+		return -1;
+	}
+	auto start = std::chrono::steady_clock::now();
+	const std::string& text = options.m_positional[2];
+	std::vector<uint32_t> results = options.m_prefix ? index.findPrefix(text, MAX_RESULTS + 1) : index.findSubstring(text, MAX_RESULTS + 1);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	for (size_t i = 0; i < std::min(results.size(), MAX_RESULTS); i++) {
+		const sNameIndexEntry& entry = index.getEntry(results[i]);
+		printf("%s\t%u\t%s\t%llu\t%s\t%s\n", index.getTapeName(entry.m_tapeIndex), entry.m_sessionIndex, entry.m_type == 1 ? "folder" : "file",
+			(unsigned long long)entry.m_size, formatHFSTime(entry.m_modificationTime).c_str(), index.getPath(entry));
+	}
+	fprintf(stderr, "%s%d matches in %.2f ms\n", results.size() > MAX_RESULTS ? "More than " : "", (int)std::min(results.size(), MAX_RESULTS), milliseconds);
+	return 0;
+}
+
+// export <tape> <session> <output.dsk> / serve <tape> <session> [port]
+int runVirtualDisk(const sOptions& options) {
+	const std::string& command = options.m_positional[0];
+	if (options.m_positional.size() < 3 || (command == "export" && options.m_positional.size() < 4)) {
+		printf("Usage: %s <tape> <session> %s", command.c_str(), command == "export" ? "<output.dsk>" : "[port]");
+		return -1;
+	}
+	std::unique_ptr<tapeFile> fHandle(openTape(options.m_positional[1]));
+	if (fHandle == nullptr) {
+		return -1;
+	}
+	if (fHandle->readU16_BE() != 0x4454) {
+		printf("Not a valid DeskTape");
+		return -1;
+	}
+	std::vector<sSession> sessions;
+	if (!findSessions(fHandle.get(), sessions)) {
+		printf("Failed to find last session");
+		return -1;
+	}
+	int sessionIndex = atoi(options.m_positional[2].c_str());
+	virtualDisk disk;
+	if (sessionIndex < 0 || sessionIndex >= sessions.size() || !disk.open(fHandle.get(), sessions, sessionIndex, options.m_keepFreeBlocks)) {
+		printf("Session %d has no HFS volume", sessionIndex);
+		return -1;
+	}
+
+	bool success;
+	if (command == "export") {
+		success = disk.writeImage(options.m_positional[3]);
+	}
+	else {
+		int port = options.m_positional.size() > 3 ? atoi(options.m_positional[3].c_str()) : 10809;
+		success = serveNBD(disk, port);
+	}
+	return success ? 0 : -1;
+}
+
+// recover <tape> [output folder], scans every sector instead of following the session chain
+int runRecover(const sOptions& options) {
+	if (options.m_positional.size() < 2) {
+		printf("Usage: recover <tape> [output folder] [--extract]");
+		return -1;
+	}
+	const std::string& inputFileName = options.m_positional[1];
+	std::string outputPath = options.m_positional.size() > 2 ? options.m_positional[2] : std::string("output\\") + std::filesystem::path(inputFileName).filename().string() + "_recovered\\";
+	std::filesystem::create_directories(outputPath);
+
+	recoveryScan recovery;
+	int numThreads = std::max<int>(1, std::thread::hardware_concurrency());
+	if (!recovery.scan(inputFileName, numThreads)) {
+		return -1;
+	}
+	recovery.rebuildCatalog();
+	if (!recovery.writeReport(outputPath + "/recovery_report.txt") || !recovery.writeCatalog(outputPath + "/recovered_catalog.txt")) {
+		printf("Can't write the recovery report in %s", outputPath.c_str());
+		return -1;
+	}
+	printf("Recovered %d files\n", (int)recovery.m_files.size());
+
+	if (options.m_extractFiles) {
+		// Damaged tapes are often cut short, the files kept are those whose data is inside the last whole sector
+		if (!recovery.isImageComplete()) {
+			printf("%s is truncated, extracting the files inside it\n", inputFileName.c_str());
+		}
+		tapeFile* fHandle = openTape(inputFileName, options.m_directIO, options.m_uring, true);
+		if (fHandle == nullptr) {
+			return -1;
+		}
+		bTree::sDumpSettings dumpSettings;
+		dumpSettings.m_filter = &options.m_filter;
+		dumpSettings.m_verbose = options.m_verbose;
+		std::vector<bTree::sExtractJob> jobs = recovery.getExtractJobs(&options.m_filter);
+		bTree::extractJobs(fHandle, outputPath + "/recovered_files/", jobs, dumpSettings);
+		// files without a data fork aren't written
+		int numWritten = (int)std::count_if(jobs.begin(), jobs.end(), [](const bTree::sExtractJob& job) { return job.m_record->m_FileRecord.m_dataForkBlockAllocatedSize != 0; });
+		printf("Extracted %d files with their data inside the image\n", numWritten);
+		delete fHandle;
+	}
+	return 0;
+}
+
+// convert <input.cptp> <output.bin> [trailers.bin]
+int runConvert(const sOptions& options) {
+	if (options.m_positional.size() < 3) {
+		printf("Usage: convert <input.cptp> <output.bin> [trailers.bin]");
+		return -1;
+	}
+	std::string trailerFileName = options.m_positional.size() > 3 ? options.m_positional[3] : "";
+	int numThreads = std::max<int>(1, std::thread::hardware_concurrency());
+	return convertCptpToRaw(options.m_positional[1], options.m_positional[2], trailerFileName, numThreads) ? 0 : -1;
+}
+
+// generate <output.bin|output.cptp> [sessions] [files per session] [seed]
+int runGenerate(const sOptions& options) {
+	if (options.m_positional.size() < 2) {
+		printf("Usage: generate <output.bin|output.cptp> [sessions] [files per session] [seed]");
+		return -1;
+	}
+	sGeneratorSettings settings;
+	const std::string& outputFileName = options.m_positional[1];
+	settings.m_cptp = !_stricmp(std::filesystem::path(outputFileName).extension().string().c_str(), ".cptp");
+	if (options.m_positional.size() > 2) {
+		settings.m_numSessions = atoi(options.m_positional[2].c_str());
+	}
+	if (options.m_positional.size() > 3) {
+		settings.m_numFilesPerSession = atoi(options.m_positional[3].c_str());
+	}
+	if (options.m_positional.size() > 4) {
+		settings.m_seed = atoi(options.m_positional[4].c_str());
+	}
+	std::vector<sGeneratedFile> files;
+	if (settings.m_numSessions < 1 || !generateImage(outputFileName, settings, &files)) {
+		return -1;
+	}
+	printf("Wrote %s: %d sessions, %d files in the last one\n", outputFileName.c_str(), settings.m_numSessions, (int)files.size());
+	return 0;
+}
+
+// bench [work folder] [sessions files]...
+int runBench(const sOptions& options) {
+	std::string workPath = options.m_positional.size() > 1 ? options.m_positional[1] : "bench";
+	std::vector<sBenchmarkConfig> configs;
+	for (int i = 2; i + 1 < options.m_positional.size(); i += 2) {
+		configs.push_back({ atoi(options.m_positional[i].c_str()), atoi(options.m_positional[i + 1].c_str()) });
+	}
+	if (configs.empty()) {
+		configs = { { 1, 100 }, { 2, 500 }, { 4, 1000 } };
+	}
+	return runBenchmark(workPath, configs);
+}
+
+// Comma separated sizes, in units of unitSize
+static std::vector<uint64_t> parseSizeList(const std::string& list, uint64_t unitSize) {
+	std::vector<uint64_t> sizes;
+	size_t start = 0;
+	while (start < list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos) {
+			end = list.size();
+		}
+		sizes.push_back(strtoull(list.substr(start, end - start).c_str(), nullptr, 10) * unitSize);
+		start = end + 1;
+	}
+	return sizes;
+}
+
+// replay <trace> [image] [cache MB,...] [read-ahead KB,...]
+int runReplayCommand(const sOptions& options) {
+	if (options.m_positional.size() < 2) {
+		printf("Usage: replay <trace> [image] [cache MB,...] [read-ahead KB,...]");
+		return -1;
+	}
+	std::string imageFileName = options.m_positional.size() > 2 ? options.m_positional[2] : "";
+	std::vector<uint64_t> cacheSizes = parseSizeList(options.m_positional.size() > 3 ? options.m_positional[3] : "0,16,256", 1024 * 1024);
+	std::vector<uint64_t> readAheadSizes = parseSizeList(options.m_positional.size() > 4 ? options.m_positional[4] : "0,256,4096", 1024);
+	return runReplay(options.m_positional[1], imageFileName, cacheSizes, readAheadSizes);
+}
+
+int main(int argc, char** argv)
+{
+	sOptions options;
+	if (!parseOptions(argc, argv, options)) {
+		return -1;
+	}
+	if (options.m_positional.size() < 1) {
+		printf("Need input file or pattern");
+		return -1;
+	}
+	if (options.m_positional[0] == "export" || options.m_positional[0] == "serve") {
+		return runVirtualDisk(options);
+	}
+	if (options.m_positional[0] == "index") {
+		return runIndex(options);
+	}
+	if (options.m_positional[0] == "query") {
+		return runQuery(options);
+	}
+	if (options.m_positional[0] == "daemon") {
+		return runDaemon(options);
+	}
+	if (options.m_positional[0] == "recover") {
+		return runRecover(options);
+	}
+	if (options.m_positional[0] == "convert") {
+		return runConvert(options);
+	}
+	if (options.m_positional[0] == "generate") {
+		return runGenerate(options);
+	}
+	if (options.m_positional[0] == "bench") {
+		return runBench(options);
+	}
+	if (options.m_positional[0] == "replay") {
+		return runReplayCommand(options);
+	}
+	if (options.m_verify) {
+		// Check a previous output folder against its manifests
+		int numThreads = std::max<int>(1, std::thread::hardware_concurrency());
+		return checksumManifest::verify(options.m_positional[0], numThreads) ? -1 : 0;
+	}
+	const std::vector<std::filesystem::path> inputFiles = FindFiles("", options.m_positional[0]);
+
+	// One store for every tape of this run so identical files are only kept once
+	contentStore store;
+	bTree::sDumpSettings dumpSettings;
+	dumpSettings.m_filter = &options.m_filter;
+	if (!options.m_storePath.empty()) {
+		if (!store.open(options.m_storePath)) {
+			printf("Can't open content store %s", options.m_storePath.c_str());
+			return -1;
+		}
+		dumpSettings.m_store = &store;
+	}
+
+	// One archive for every tape of this run, entries are prefixed with the tape name
+	tarWriter tar;
+	if (!options.m_tarPath.empty()) {
+		if (!tar.open(options.m_tarPath)) {
+			printf("Can't create archive %s", options.m_tarPath.c_str());
+			return -1;
+		}
+		dumpSettings.m_tar = &tar;
+	}
+
+	progressReporter progress;
+	uint64_t batchTapeBytes = 0;
+	for (int i = 0; i < inputFiles.size(); i++) {
+		batchTapeBytes += std::filesystem::file_size(inputFiles[i]);
+	}
+	progress.beginBatch(inputFiles.size(), batchTapeBytes);
+	dumpSettings.m_progress = &progress;
+	dumpSettings.m_verbose = options.m_verbose;
+
+	for (int i = 0; i < inputFiles.size(); i++) {
+		std::string outputPath = "";
+		if (options.m_positional.size() > 1) {
+			outputPath = options.m_positional[1];
+		}
+		if (outputPath.length() == 0) {
+			outputPath = std::string("output\\") + inputFiles[i].filename().string() + "\\";
+		}
+		if (processImage(inputFiles[i], outputPath, options, dumpSettings, progress) != 0) {
+			return -1;
+		}
+	}
+
+	progress.endBatch();
+
+	if (dumpSettings.m_tar && !tar.close()) {
+		printf("Failed to write archive %s\n", options.m_tarPath.c_str());
+		return -1;
+	}
+
+	if (dumpSettings.m_store) {
+		printf("Content store: %llu forks deduplicated, %llu known forks linked without a write\n", (unsigned long long)store.m_numDeduplicated, (unsigned long long)store.m_numSkippedWrites);
 	}
 
 	return 0;
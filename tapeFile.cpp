@@ -1,4 +1,6 @@
 #include "tapeFile.h"
+#include "tapeFileDirect.h"
+#include "tapeFileUring.h"
 
 uint16_t tapeFile::readU16_BE() {
 	union {
@@ -74,4 +76,38 @@ std::string tapeFile::readString(int size) {
 		}
 	}
 	return string;
-}
\ No newline at end of file
+}
+
+tapeFile* openTape(const std::filesystem::path& inputFile, bool directIO, bool uring, bool truncated) {
+	tapeFile* fHandle = nullptr;
+	bool cptp = !_stricmp(inputFile.extension().string().c_str(), ".cptp");
+	if (uring) {
+		fHandle = new tapeFile_uring(cptp, directIO);
+		if (truncated) {
+			fHandle->allowTruncation();
+		}
+		if (fHandle->open(inputFile.string().c_str())) {
+			return fHandle;
+		}
+		delete fHandle;
+		printf("io_uring not available, reading %s synchronously\n", inputFile.string().c_str());
+	}
+	if (directIO) {
+		fHandle = new tapeFile_direct(cptp);
+	}
+	else if (cptp) {
+		fHandle = new tapeFile_cptp();
+	}
+	else {
+		fHandle = new tapeFile_raw();
+	}
+	if (truncated) {
+		fHandle->allowTruncation();
+	}
+	if (!fHandle->open(inputFile.string().c_str())) {
+		printf("Can't open file %s", inputFile.string().c_str());
+		delete fHandle;
+		return nullptr;
+	}
+	return fHandle;
+}
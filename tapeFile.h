@@ -4,6 +4,21 @@
 #include <string>
 #include <assert.h>
 #include <array>
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <filesystem>
+
+#include "platform.h"
+
+// Counted by the backends on every call that reaches the underlying file
+struct sIOStats {
+	uint64_t m_bytesRead = 0;
+	uint64_t m_readCalls = 0;
+	uint64_t m_seeks = 0;
+	uint64_t m_seekDistance = 0; // in bytes of the underlying file
+};
 
 class tapeFile {
 public:
@@ -32,9 +47,40 @@ public:
 	virtual std::string readString(int size);
 
 	virtual void readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) = 0;
+	// Reads numSectors consecutive sectors, backends override this with a single large read
+	virtual void readSectors(int64_t firstSector, int numSectors, uint8_t* output) {
+		for (int i = 0; i < numSectors; i++) {
+			std::array<uint8_t, 0x200> buffer;
+			readSector(firstSector + i, buffer);
+			memcpy(output + i * 0x200, buffer.data(), 0x200);
+		}
+	}
+
+	virtual const sIOStats& getIOStats() const {
+		return m_ioStats;
+	}
+	// Before open(), an image not ending on a whole sector (a truncated dump) is read up to its last whole sector
+	void allowTruncation() {
+		m_allowTruncation = true;
+	}
+	// Name of the pipeline stage issuing the next accesses, for backends that record them
+	virtual void setStage(const char* name) {}
 
 protected:
+	void countRead(uint64_t size) {
+		m_ioStats.m_bytesRead += size;
+		m_ioStats.m_readCalls++;
+	}
+	void countSeek(int64_t from, int64_t to) {
+		if (from != to) {
+			m_ioStats.m_seeks++;
+			m_ioStats.m_seekDistance += from < to ? to - from : from - to;
+		}
+	}
+
 	uint32_t m_numSectors = 0;
+	bool m_allowTruncation = false;
+	sIOStats m_ioStats;
 };
 
 class tapeFile_raw : public tapeFile {
@@ -47,34 +93,53 @@ public:
 		if (m_file == nullptr) {
 			return false;
 		}
-		fseek(m_file, 0, SEEK_END);
-		int size = ftell(m_file);
-		fseek(m_file, 0, SEEK_SET);
-		m_numSectors = size / 0x200;
-		assert(m_numSectors * 0x200 == size);
+		_fseeki64(m_file, 0, SEEK_END);
+		int64_t size = _ftelli64(m_file);
+		_fseeki64(m_file, 0, SEEK_SET);
+		m_numSectors = (uint32_t)(size / 0x200);
+		assert(m_allowTruncation || (int64_t)m_numSectors * 0x200 == size);
 		return true;
 	}
 	virtual uint64_t tellPosition() override {
-		return _ftelli64(m_file);
+		return m_currentPosition;
 	}
 	virtual void seekToPosition(uint64_t position) override {
+		countSeek(m_currentPosition, position);
 		_fseeki64(m_file, position, SEEK_SET);
+		m_currentPosition = position;
 	}
 	virtual void seekToSector(int sector) override {
-		fseek(m_file, sector * 0x200, SEEK_SET);
+		seekToPosition((uint64_t)sector * 0x200);
 	}
 	virtual uint8_t readU8() override {
 		uint8_t value;
 		size_t numByteRead = fread(&value, 1, 1, m_file);
 		assert(numByteRead == 1);
+		countRead(1);
+		m_currentPosition += numByteRead;
 		return value;
 	}
 	virtual void readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) override {
 		seekToSector(sectorIndex);
-		fread(output.data(), 1, 0x200, m_file);
+		m_currentPosition += fread(output.data(), 1, 0x200, m_file);
+		countRead(0x200);
+	}
+	virtual void readBuffer(uint8_t* output, int size) override {
+		size_t numByteRead = fread(output, 1, size, m_file);
+		assert(numByteRead == size);
+		countRead(size);
+		m_currentPosition += numByteRead;
+	}
+	virtual void readSectors(int64_t firstSector, int numSectors, uint8_t* output) override {
+		seekToPosition(firstSector * 0x200);
+		size_t numByteRead = fread(output, 1, (size_t)numSectors * 0x200, m_file);
+		countRead((size_t)numSectors * 0x200);
+		m_currentPosition += numByteRead;
+		memset(output + numByteRead, 0, (size_t)numSectors * 0x200 - numByteRead);
 	}
 private:
 	FILE* m_file = nullptr;
+	int64_t m_currentPosition = 0;
 };
 
 class tapeFile_cptp : public tapeFile {
@@ -90,8 +155,8 @@ public:
 		fseek(m_file, 0, SEEK_END);
 		int64_t size = _ftelli64(m_file);
 		fseek(m_file, 0, SEEK_SET);
-		m_numSectors = size / 0x211;
-		assert(m_numSectors * 0x211 + 0x12 == size);
+		m_numSectors = (uint32_t)(std::max<int64_t>(size - 0x10, 0) / 0x211);
+		assert(m_allowTruncation || (int64_t)m_numSectors * 0x211 + 0x12 == size);
 		m_currentPosition = 0;
 		seekToSector(0);
 		return true;
@@ -110,22 +175,26 @@ public:
 		int64_t filePosition = 0x10;
 		filePosition += sector * 0x211;
 		filePosition += positionInSector;
+		countSeek(m_currentPosition, filePosition);
 		_fseeki64(m_file, filePosition, SEEK_SET);
 		m_currentPosition = filePosition;
 	}
 	virtual void seekToSector(int sector) {
 		assert(_ftelli64(m_file) == m_currentPosition);
+		countSeek(m_currentPosition, (uint64_t)sector * 0x211 + 0x10);
 		_fseeki64(m_file, (uint64_t)sector * 0x211 + 0x10, SEEK_SET);
 		m_currentPosition = (uint64_t)sector * 0x211 + 0x10;
 	}
 	virtual uint8_t readU8() {
 		if (distanceToEndOfSector() == 0) {
 			assert(_ftelli64(m_file) == m_currentPosition);
+			countSeek(m_currentPosition, m_currentPosition + 0x11);
 			fseek(m_file, 0x11, SEEK_CUR); // skip over inter-sector data
 			m_currentPosition += 0x11;
 		}
 		uint8_t value;
 		size_t numByteRead = fread(&value, 1, 1, m_file);
+		countRead(1);
 		m_currentPosition++;
 		assert(numByteRead == 1);
 		return value;
@@ -136,8 +205,42 @@ public:
 		seekToSector(sectorIndex);
 		assert(_ftelli64(m_file) == m_currentPosition);
 		fread(output.data(), 1, 0x200, m_file);
+		countRead(0x200);
 		m_currentPosition += 0x200;
 	}
+	virtual void readBuffer(uint8_t* output, int size) override {
+		while (size > 0) {
+			if (distanceToEndOfSector() == 0) {
+				countSeek(m_currentPosition, m_currentPosition + 0x11);
+				fseek(m_file, 0x11, SEEK_CUR); // skip over inter-sector data
+				m_currentPosition += 0x11;
+			}
+			int chunkSize = (int)std::min<int64_t>(size, distanceToEndOfSector());
+			size_t numByteRead = fread(output, 1, chunkSize, m_file);
+			assert(numByteRead == chunkSize);
+			countRead(chunkSize);
+			m_currentPosition += chunkSize;
+			output += chunkSize;
+			size -= chunkSize;
+		}
+	}
+	virtual void readSectors(int64_t firstSector, int numSectors, uint8_t* output) override {
+		if (numSectors <= 0) {
+			return;
+		}
+		// One read covering the sectors and their trailers, then compact
+		size_t rawSize = (size_t)numSectors * 0x211 - 0x11;
+		m_readScratch.resize(rawSize);
+		countSeek(m_currentPosition, (uint64_t)firstSector * 0x211 + 0x10);
+		_fseeki64(m_file, (uint64_t)firstSector * 0x211 + 0x10, SEEK_SET);
+		size_t numByteRead = fread(m_readScratch.data(), 1, rawSize, m_file);
+		countRead(rawSize);
+		m_currentPosition = (uint64_t)firstSector * 0x211 + 0x10 + numByteRead;
+		memset(m_readScratch.data() + numByteRead, 0, rawSize - numByteRead);
+		for (int i = 0; i < numSectors; i++) {
+			memcpy(output + i * 0x200, m_readScratch.data() + i * 0x211, 0x200);
+		}
+	}
 private:
 	int64_t distanceToEndOfSector() {
 		assert(_ftelli64(m_file) == m_currentPosition);
@@ -150,4 +253,53 @@ private:
 	}
 	FILE* m_file = nullptr;
 	int64_t m_currentPosition = 0;
-};
\ No newline at end of file
+	std::vector<uint8_t> m_readScratch;
+};
+
+// Tape bytes already in memory (a node or a chunk read by someone else), reads past the end return zeros
+class tapeFile_memory : public tapeFile {
+public:
+	void assign(const uint8_t* data, uint64_t size) {
+		m_data = data;
+		m_size = size;
+		m_numSectors = (uint32_t)(size / 0x200);
+		m_position = 0;
+	}
+	bool open(const char*) override {
+		return false; // not backed by a file, see assign
+	}
+	virtual uint64_t tellPosition() override {
+		return m_position;
+	}
+	virtual void seekToPosition(uint64_t position) override {
+		m_position = position;
+	}
+	virtual void seekToSector(int sector) override {
+		m_position = (uint64_t)sector * 0x200;
+	}
+	virtual uint8_t readU8() override {
+		uint8_t value = m_position < m_size ? m_data[m_position] : 0;
+		m_position++;
+		return value;
+	}
+	virtual void readBuffer(uint8_t* output, int size) override {
+		uint64_t available = m_position < m_size ? std::min<uint64_t>(size, m_size - m_position) : 0;
+		if (available) {
+			memcpy(output, m_data + m_position, available);
+		}
+		memset(output + available, 0, size - available);
+		m_position += size;
+	}
+	virtual void readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) override {
+		seekToSector(sectorIndex);
+		readBuffer(output.data(), 0x200);
+	}
+private:
+	const uint8_t* m_data = nullptr;
+	uint64_t m_size = 0;
+	uint64_t m_position = 0;
+};
+
+// Opens a raw or .cptp (by extension) tape image, nullptr on failure. directIO reads it outside of the page cache (tapeFile_direct),
+// uring reads ahead through io_uring (tapeFile_uring) where available, truncated accepts an image cut in a sector (allowTruncation)
+tapeFile* openTape(const std::filesystem::path& inputFile, bool directIO = false, bool uring = false, bool truncated = false);
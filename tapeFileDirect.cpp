@@ -0,0 +1,150 @@
+#include "tapeFileDirect.h"
+
+#include <new>
+#include <algorithm>
+
+// 0x13000 is the smallest multiple of both 0x9800 and DIRECT_IO_ALIGNMENT
+static_assert(tapeFile_direct::WINDOW_SIZE % 0x200 == 0 && tapeFile_direct::WINDOW_SIZE % 0x9800 == 0 && tapeFile_direct::WINDOW_SIZE % DIRECT_IO_ALIGNMENT == 0, "windows must stay aligned");
+
+tapeFile_direct::tapeFile_direct(bool cptp, bool direct, int numWindows) : m_cptp(cptp), m_useDirect(direct), m_numWindows(numWindows) {
+}
+
+tapeFile_direct::~tapeFile_direct() {
+	if (m_pool) {
+		::operator delete(m_pool, std::align_val_t(DIRECT_IO_ALIGNMENT));
+	}
+}
+
+bool tapeFile_direct::open(const char* path) {
+	m_direct = m_useDirect && m_file.openDirect(path);
+	if (!m_direct && !m_file.open(path, false)) {
+		return false;
+	}
+	m_fileSize = m_file.getSize();
+	if (m_fileSize < 0) {
+		return false;
+	}
+	if (m_cptp) {
+		m_numSectors = (uint32_t)(std::max<int64_t>(m_fileSize - 0x10, 0) / 0x211);
+		assert(m_allowTruncation || (int64_t)m_numSectors * 0x211 + 0x12 == m_fileSize);
+	}
+	else {
+		m_numSectors = (uint32_t)(m_fileSize / 0x200);
+		assert(m_allowTruncation || (int64_t)m_numSectors * 0x200 == m_fileSize);
+	}
+
+	m_pool = (uint8_t*)::operator new(WINDOW_SIZE * m_numWindows, std::align_val_t(DIRECT_IO_ALIGNMENT));
+	m_windows.resize(m_numWindows);
+	for (int i = 0; i < m_numWindows; i++) {
+		m_windows[i].m_data = m_pool + i * WINDOW_SIZE;
+	}
+
+	// Some file systems accept O_DIRECT on open but not on read
+	if (m_direct && m_fileSize > 0) {
+		m_windows[0].m_size = m_file.readAt(0, m_windows[0].m_data, WINDOW_SIZE);
+		if (m_windows[0].m_size > 0) {
+			m_windows[0].m_fileOffset = 0;
+			countRead(m_windows[0].m_size);
+			m_lastReadEnd = m_windows[0].m_size;
+		}
+		else {
+			m_direct = false;
+			if (!m_file.open(path, false)) {
+				return false;
+			}
+		}
+	}
+	if (!m_direct) {
+		if (m_useDirect) {
+			printf("Direct I/O not supported for %s, reading through the page cache\n", path);
+		}
+		m_file.adviseSequential();
+	}
+	m_position = 0;
+	return true;
+}
+
+int64_t tapeFile_direct::getFileBytes(int64_t fileOffset, const uint8_t*& data) {
+	int64_t windowOffset = fileOffset - fileOffset % WINDOW_SIZE;
+
+	// Most accesses are in the window used last
+	sWindow* window = &m_windows[m_lastWindow];
+	if (window->m_fileOffset != windowOffset) {
+		window = nullptr;
+		int leastRecentlyUsed = 0;
+		for (int i = 0; i < m_windows.size(); i++) {
+			if (m_windows[i].m_fileOffset == windowOffset) {
+				window = &m_windows[i];
+				m_lastWindow = i;
+				break;
+			}
+			if (m_windows[i].m_lastUse < m_windows[leastRecentlyUsed].m_lastUse) {
+				leastRecentlyUsed = i;
+			}
+		}
+		if (window == nullptr) {
+			window = &m_windows[leastRecentlyUsed];
+			m_lastWindow = leastRecentlyUsed;
+			countSeek(m_lastReadEnd, windowOffset);
+			window->m_fileOffset = windowOffset;
+			window->m_size = std::max<int64_t>(m_file.readAt(windowOffset, window->m_data, WINDOW_SIZE), 0);
+			countRead(window->m_size);
+			m_lastReadEnd = windowOffset + window->m_size;
+			if (m_useDirect && !m_direct) {
+				m_file.adviseDontNeed(windowOffset, window->m_size);
+			}
+		}
+	}
+	window->m_lastUse = ++m_useCounter;
+
+	int64_t offsetInWindow = fileOffset - windowOffset;
+	data = window->m_data + offsetInWindow;
+	return std::max<int64_t>(window->m_size - offsetInWindow, 0);
+}
+
+void tapeFile_direct::readTape(uint64_t position, uint8_t* output, uint64_t size) {
+	while (size > 0) {
+		int64_t fileOffset = position;
+		uint64_t chunkSize = size;
+		if (m_cptp) {
+			// Sector data is contiguous in the file, the 0x11 byte trailers are not part of the tape
+			fileOffset = 0x10 + (int64_t)(position / 0x200) * 0x211 + position % 0x200;
+			chunkSize = std::min<uint64_t>(size, 0x200 - position % 0x200);
+		}
+		const uint8_t* data;
+		int64_t available = getFileBytes(fileOffset, data);
+		if (available == 0) {
+			// Past the end of the image
+			memset(output, 0, size);
+			return;
+		}
+		chunkSize = std::min<uint64_t>(chunkSize, available);
+		memcpy(output, data, chunkSize);
+		output += chunkSize;
+		position += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+uint8_t tapeFile_direct::readU8() {
+	uint8_t value;
+	readTape(m_position, &value, 1);
+	m_position++;
+	return value;
+}
+
+void tapeFile_direct::readBuffer(uint8_t* output, int size) {
+	readTape(m_position, output, size);
+	m_position += size;
+}
+
+void tapeFile_direct::readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) {
+	m_position = (uint64_t)sectorIndex * 0x200;
+	readBuffer(output.data(), 0x200);
+}
+
+void tapeFile_direct::readSectors(int64_t firstSector, int numSectors, uint8_t* output) {
+	m_position = (uint64_t)firstSector * 0x200;
+	readTape(m_position, output, (uint64_t)numSectors * 0x200);
+	m_position += (uint64_t)numSectors * 0x200;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "tapeFile.h"
+#include "fileAccess.h"
+
+// Raw or .cptp image read with direct I/O into a small pool of aligned windows, so a batch over many images
+// doesn't push everything else out of the page cache. Windows are multiples of the sector (0x200), the
+// allocation block (0x9800) and the direct I/O alignment. Where the file system refuses direct I/O, the image
+// is read through the page cache and every window is dropped from it once copied (posix_fadvise).
+class tapeFile_direct : public tapeFile {
+public:
+	// Without direct, the image is read through the page cache and left in it
+	tapeFile_direct(bool cptp, bool direct = true, int numWindows = 4);
+	virtual ~tapeFile_direct();
+	bool open(const char* path) override;
+	bool isDirect() const {
+		return m_direct;
+	}
+	static const int64_t WINDOW_SIZE = 0x13000 * 16;
+
+	virtual uint64_t tellPosition() override {
+		return m_position;
+	}
+	virtual void seekToPosition(uint64_t position) override {
+		m_position = position;
+	}
+	virtual void seekToSector(int sector) override {
+		m_position = (uint64_t)sector * 0x200;
+	}
+	virtual uint8_t readU8() override;
+	virtual void readBuffer(uint8_t* output, int size) override;
+	virtual void readSector(int sectorIndex, std::array<uint8_t, 0x200>& output) override;
+	virtual void readSectors(int64_t firstSector, int numSectors, uint8_t* output) override;
+
+protected:
+	struct sWindow {
+		uint8_t* m_data = nullptr;
+		int64_t m_fileOffset = -1;
+		int64_t m_size = 0;
+		uint64_t m_lastUse = 0;
+	};
+	// Copies tape bytes (skipping the .cptp header and trailers), zero filled past the end of the image
+	void readTape(uint64_t position, uint8_t* output, uint64_t size);
+	// Bytes of the file at fileOffset held by a window, reading it if needed. Returns how many follow in that window
+	virtual int64_t getFileBytes(int64_t fileOffset, const uint8_t*& data);
+
+	bool m_cptp;
+	bool m_useDirect;
+	bool m_direct = false;
+	positionalFile m_file;
+	int64_t m_fileSize = 0;
+	uint64_t m_position = 0;
+	int64_t m_lastReadEnd = 0;
+
+	uint8_t* m_pool = nullptr;
+	int m_numWindows;
+	std::vector<sWindow> m_windows;
+	int m_lastWindow = 0;
+	uint64_t m_useCounter = 0;
+};
@@ -0,0 +1,161 @@
+#include "tapeFileUring.h"
+
+#include <algorithm>
+
+// Windows in the pool, all but the current one can be read ahead
+static const int NUM_URING_WINDOWS = 8;
+
+tapeFile_uring::tapeFile_uring(bool cptp, bool direct) : tapeFile_direct(cptp, direct, NUM_URING_WINDOWS) {
+}
+
+tapeFile_uring::~tapeFile_uring() {
+	// The kernel still writes into the windows until their reads complete
+	for (int i = 0; i < m_inFlight.size(); i++) {
+		if (m_inFlight[i]) {
+			waitForWindow(i);
+		}
+	}
+}
+
+bool tapeFile_uring::open(const char* path) {
+#ifdef HAS_IO_URING
+	if (!tapeFile_direct::open(path) || !m_ring.init(m_numWindows * 2)) {
+		return false;
+	}
+	std::vector<uint8_t*> buffers;
+	for (int i = 0; i < m_windows.size(); i++) {
+		buffers.push_back(m_windows[i].m_data);
+	}
+	m_ring.registerBuffers(buffers.data(), WINDOW_SIZE, (int)buffers.size());
+	m_inFlight.assign(m_windows.size(), false);
+	return true;
+#else
+	return false;
+#endif
+}
+
+int tapeFile_uring::queueWindow(int64_t windowOffset, int keepWindow) {
+	int leastRecentlyUsed = -1;
+	for (int i = 0; i < m_windows.size(); i++) {
+		if (m_inFlight[i] || i == keepWindow) {
+			continue;
+		}
+		if (leastRecentlyUsed == -1 || m_windows[i].m_lastUse < m_windows[leastRecentlyUsed].m_lastUse) {
+			leastRecentlyUsed = i;
+		}
+	}
+	if (leastRecentlyUsed == -1) {
+		return -1;
+	}
+	sWindow& window = m_windows[leastRecentlyUsed];
+	window.m_fileOffset = windowOffset;
+	window.m_size = 0;
+	// read ahead windows are newer than the ones already used
+	window.m_lastUse = ++m_useCounter;
+#ifdef HAS_IO_URING
+	if (m_ring.queueRead(m_file.getDescriptor(), window.m_data, (uint32_t)WINDOW_SIZE, windowOffset, leastRecentlyUsed, leastRecentlyUsed)) {
+		m_inFlight[leastRecentlyUsed] = true;
+		return leastRecentlyUsed;
+	}
+#endif
+	window.m_size = std::max<int64_t>(m_file.readAt(windowOffset, window.m_data, WINDOW_SIZE), 0);
+	countRead(window.m_size);
+	return leastRecentlyUsed;
+}
+
+void tapeFile_uring::reapCompletion(uint64_t windowIndex, int result) {
+	sWindow& window = m_windows[windowIndex];
+	m_inFlight[windowIndex] = false;
+	if (result < 0) {
+		// retried without the ring
+		result = (int)std::max<int64_t>(m_file.readAt(window.m_fileOffset, window.m_data, WINDOW_SIZE), 0);
+	}
+	window.m_size = result;
+	countRead(window.m_size);
+	if (m_useDirect && !m_direct) {
+		m_file.adviseDontNeed(window.m_fileOffset, window.m_size);
+	}
+}
+
+void tapeFile_uring::waitForWindow(int windowIndex) {
+	while (m_inFlight[windowIndex]) {
+		uint64_t completedWindow;
+		int result;
+		if (m_ring.getCompletion(completedWindow, result)) {
+			reapCompletion(completedWindow, result);
+		}
+		else if (!m_ring.submit(1)) {
+			// the ring is unusable, read the windows still expected synchronously
+			for (int i = 0; i < m_inFlight.size(); i++) {
+				if (m_inFlight[i]) {
+					reapCompletion(i, -1);
+				}
+			}
+		}
+	}
+}
+
+int64_t tapeFile_uring::getFileBytes(int64_t fileOffset, const uint8_t*& data) {
+	int64_t windowOffset = fileOffset - fileOffset % WINDOW_SIZE;
+
+	int windowIndex = -1;
+	if (m_windows[m_lastWindow].m_fileOffset == windowOffset) {
+		windowIndex = m_lastWindow;
+	}
+	else {
+		for (int i = 0; i < m_windows.size(); i++) {
+			if (m_windows[i].m_fileOffset == windowOffset) {
+				windowIndex = i;
+				break;
+			}
+		}
+	}
+
+	bool forward = windowOffset == m_previousWindowOffset + WINDOW_SIZE;
+	m_previousWindowOffset = windowOffset;
+	if (windowIndex == -1 || forward) {
+		if (windowIndex == -1) {
+			countSeek(m_lastReadEnd, windowOffset);
+			windowIndex = queueWindow(windowOffset, -1);
+			if (windowIndex == -1) {
+				// every window in flight, wait for the oldest
+				int oldest = 0;
+				for (int i = 1; i < m_windows.size(); i++) {
+					if (m_windows[i].m_lastUse < m_windows[oldest].m_lastUse) {
+						oldest = i;
+					}
+				}
+				waitForWindow(oldest);
+				windowIndex = queueWindow(windowOffset, -1);
+			}
+		}
+		// Reading forward, keep the next windows coming
+		if (forward) {
+			for (int i = 1; i < m_windows.size(); i++) {
+				int64_t nextOffset = windowOffset + i * WINDOW_SIZE;
+				if (nextOffset >= m_fileSize) {
+					break;
+				}
+				bool known = false;
+				for (int j = 0; j < m_windows.size(); j++) {
+					known |= m_windows[j].m_fileOffset == nextOffset;
+				}
+				if (!known && queueWindow(nextOffset, windowIndex) == -1) {
+					break;
+				}
+			}
+		}
+		if (m_ring.getNumQueued()) {
+			m_ring.submit();
+		}
+		m_lastReadEnd = windowOffset + WINDOW_SIZE;
+	}
+	waitForWindow(windowIndex);
+	m_lastWindow = windowIndex;
+	sWindow* window = &m_windows[windowIndex];
+	window->m_lastUse = ++m_useCounter;
+
+	int64_t offsetInWindow = fileOffset - windowOffset;
+	data = window->m_data + offsetInWindow;
+	return std::max<int64_t>(window->m_size - offsetInWindow, 0);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "tapeFileDirect.h"
+#include "ioUring.h"
+
+// tapeFile_direct with its windows read through io_uring into registered buffers. When the tape is read forward,
+// the windows after the one being used are queued together and submitted with a single system call, so they are
+// read while the current one is consumed. open() fails where io_uring isn't available.
+class tapeFile_uring : public tapeFile_direct {
+public:
+	tapeFile_uring(bool cptp, bool direct);
+	virtual ~tapeFile_uring();
+	bool open(const char* path) override;
+
+protected:
+	int64_t getFileBytes(int64_t fileOffset, const uint8_t*& data) override;
+
+private:
+	// Queues the read of a window into the least recently used one not in flight, returns its index
+	int queueWindow(int64_t windowOffset, int keepWindow);
+	void waitForWindow(int windowIndex);
+	void reapCompletion(uint64_t windowIndex, int result);
+
+	ioUring m_ring;
+	std::vector<bool> m_inFlight;
+	int64_t m_previousWindowOffset = -1;
+};
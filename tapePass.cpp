@@ -0,0 +1,215 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "tapePass.h"
+#include "platform.h"
+#include "progress.h"
+#include "uringWriter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+static const uint64_t WINDOW_SIZE = 0x100000;
+
+void tapePassSink::writeZeros(uint64_t offset, uint64_t size) {
+	static const uint8_t zeros[0x10000] = {};
+	while (size) {
+		uint64_t chunkSize = std::min<uint64_t>(size, sizeof(zeros));
+		write(offset, zeros, chunkSize);
+		offset += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+tapePassFile::tapePassFile(const std::string& fileName, uint64_t size, progressReporter* progress, std::function<void(const sChecksums&)> onWritten, uringWriter* writer)
+	: m_size(size), m_progress(progress), m_onWritten(onWritten), m_writer(writer) {
+	m_file = fopen(fileName.c_str(), "wb+");
+}
+
+tapePassFile::~tapePassFile() {
+	if (m_file) {
+		if (m_writer) {
+			m_writer->flush(m_file);
+		}
+		fclose(m_file);
+	}
+}
+
+void tapePassFile::write(uint64_t offset, const uint8_t* data, uint64_t size) {
+	if (m_file && m_writer) {
+		m_writer->write(m_file, offset, data, size);
+	}
+	else if (m_file) {
+		_fseeki64(m_file, offset, SEEK_SET);
+		fwrite(data, 1, size, m_file);
+	}
+	if (m_progress) {
+		m_progress->addBytes(size);
+	}
+	m_numReported += size;
+}
+
+void tapePassFile::writeZeros(uint64_t, uint64_t size) {
+	if (m_progress) {
+		m_progress->addBytes(size);
+	}
+	m_numReported += size;
+}
+
+void tapePassFile::finish() {
+	// holes not covered by any range still count
+	if (m_progress && m_numReported < m_size) {
+		m_progress->addBytes(m_size - m_numReported);
+	}
+	if (m_file == nullptr) {
+		return;
+	}
+	// the size and the read back below see every write
+	if (m_writer) {
+		m_writer->flush(m_file);
+	}
+	// holes up to the end read as zeros
+	if (m_size) {
+		_fseeki64(m_file, 0, SEEK_END);
+		if ((uint64_t)_ftelli64(m_file) < m_size) {
+			_fseeki64(m_file, m_size - 1, SEEK_SET);
+			fputc(0, m_file);
+		}
+	}
+	if (m_onWritten) {
+		checksumStream checksum;
+		std::vector<uint8_t> buffer(WINDOW_SIZE);
+		fflush(m_file);
+		_fseeki64(m_file, 0, SEEK_SET);
+		while (size_t numRead = fread(buffer.data(), 1, buffer.size(), m_file)) {
+			checksum.update(buffer.data(), numRead);
+		}
+		m_onWritten(checksum.digest());
+	}
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+int tapePass::addSink(std::unique_ptr<tapePassSink> sink) {
+	sSinkState& state = m_sinks.emplace_back();
+	state.m_sink = std::move(sink);
+	return (int)m_sinks.size() - 1;
+}
+
+void tapePass::addRange(int sinkIndex, uint64_t offset, int64_t tapeOffset, uint64_t size) {
+	if (size == 0) {
+		return;
+	}
+	sSinkState& state = m_sinks[sinkIndex];
+	state.m_bytesLeft += size;
+	if (tapeOffset == -1) {
+		state.m_pending[offset] = { size, {} };
+		return;
+	}
+	m_ranges.push_back({ sinkIndex, offset, (uint64_t)tapeOffset, size });
+}
+
+void tapePass::finishIfDone(sSinkState& state) {
+	if (state.m_bytesLeft == 0 && !state.m_finished) {
+		state.m_finished = true;
+		state.m_sink->finish();
+	}
+}
+
+void tapePass::drain(sSinkState& state) {
+	while (!state.m_pending.empty() && state.m_pending.begin()->first == state.m_position) {
+		sPending& pending = state.m_pending.begin()->second;
+		if (pending.m_data.empty()) {
+			state.m_sink->writeZeros(state.m_position, pending.m_size);
+		}
+		else {
+			state.m_sink->write(state.m_position, pending.m_data.data(), pending.m_size);
+		}
+		state.m_position += pending.m_size;
+		state.m_bytesLeft -= pending.m_size;
+		state.m_pending.erase(state.m_pending.begin());
+	}
+	finishIfDone(state);
+}
+
+void tapePass::deliver(int sinkIndex, uint64_t offset, const uint8_t* data, uint64_t size) {
+	sSinkState& state = m_sinks[sinkIndex];
+	if (state.m_sink->isPositional() || offset == state.m_position) {
+		state.m_sink->write(offset, data, size);
+		state.m_bytesLeft -= size;
+		if (!state.m_sink->isPositional()) {
+			state.m_position += size;
+			drain(state);
+		}
+		finishIfDone(state);
+		return;
+	}
+	// ahead of the sink, kept until the bytes before it arrive
+	assert(offset > state.m_position);
+	state.m_pending[offset] = { size, std::vector<uint8_t>(data, data + size) };
+}
+
+void tapePass::run(tapeFile* fHandle) {
+	// Zeros first, positional sinks take all of them, ordered ones those at their start
+	for (int i = 0; i < m_sinks.size(); i++) {
+		sSinkState& state = m_sinks[i];
+		if (state.m_sink->isPositional()) {
+			for (auto& pending : state.m_pending) {
+				state.m_sink->writeZeros(pending.first, pending.second.m_size);
+				state.m_bytesLeft -= pending.second.m_size;
+			}
+			state.m_pending.clear();
+			finishIfDone(state);
+		}
+		else {
+			drain(state);
+		}
+	}
+
+	// Same tape order as registration order for ranges starting together, so later positional writes still win
+	std::stable_sort(m_ranges.begin(), m_ranges.end(), [](const sRange& a, const sRange& b) { return a.m_tapeOffset < b.m_tapeOffset; });
+	const uint64_t tapeSize = (uint64_t)fHandle->getNumSectors() * 0x200;
+	std::vector<uint8_t> window(WINDOW_SIZE);
+	std::vector<size_t> active;
+	size_t nextRange = 0;
+	uint64_t position = 0;
+	while (nextRange < m_ranges.size() || !active.empty()) {
+		if (active.empty()) {
+			// skip the gap up to the next range
+			position = std::max(position, m_ranges[nextRange].m_tapeOffset);
+		}
+		uint64_t windowEnd = position + WINDOW_SIZE;
+		while (nextRange < m_ranges.size() && m_ranges[nextRange].m_tapeOffset < windowEnd) {
+			active.push_back(nextRange++);
+		}
+		uint64_t readEnd = position;
+		for (int i = 0; i < active.size(); i++) {
+			const sRange& range = m_ranges[active[i]];
+			readEnd = std::max(readEnd, range.m_tapeOffset + range.m_size);
+		}
+		readEnd = std::min(readEnd, windowEnd);
+
+		// past the end of the tape reads as zeros
+		uint64_t tapeEnd = std::clamp(tapeSize, position, readEnd);
+		if (tapeEnd > position) {
+			fHandle->seekToPosition(position);
+			fHandle->readBuffer(window.data(), (int)(tapeEnd - position));
+		}
+		memset(window.data() + (tapeEnd - position), 0, readEnd - tapeEnd);
+
+		for (int i = 0; i < active.size(); i++) {
+			const sRange& range = m_ranges[active[i]];
+			uint64_t first = std::max(range.m_tapeOffset, position);
+			uint64_t last = std::min(range.m_tapeOffset + range.m_size, readEnd);
+			if (first < last) {
+				deliver(range.m_sinkIndex, range.m_offset + (first - range.m_tapeOffset), window.data() + (first - position), last - first);
+			}
+		}
+		active.erase(std::remove_if(active.begin(), active.end(), [&](size_t index) { return m_ranges[index].m_tapeOffset + m_ranges[index].m_size <= readEnd; }), active.end());
+		position = readEnd;
+	}
+
+	for (int i = 0; i < m_sinks.size(); i++) {
+		assert(m_sinks[i].m_finished);
+	}
+}
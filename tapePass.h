@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+
+#include "tapeFile.h"
+#include "hash.h"
+
+class progressReporter;
+class uringWriter;
+
+// Receives the bytes of the tape ranges registered for it in a tapePass
+class tapePassSink {
+public:
+	virtual ~tapePassSink() {}
+	// size bytes at offset in the sink output, in increasing offsets unless isPositional()
+	virtual void write(uint64_t offset, const uint8_t* data, uint64_t size) = 0;
+	// Ranges with no tape data
+	virtual void writeZeros(uint64_t offset, uint64_t size);
+	// Every registered byte was written
+	virtual void finish() = 0;
+	// Positional sinks take their bytes in tape order, the others in output order
+	virtual bool isPositional() const {
+		return false;
+	}
+};
+
+// Writes its ranges at their offset in a file of a fixed size, zeros are left as holes.
+// When onWritten is set, the finished file is read back to checksum it. With a writer, the ranges go through io_uring.
+class tapePassFile : public tapePassSink {
+public:
+	tapePassFile(const std::string& fileName, uint64_t size, progressReporter* progress = nullptr, std::function<void(const sChecksums&)> onWritten = nullptr, uringWriter* writer = nullptr);
+	~tapePassFile();
+	bool isOpen() const {
+		return m_file != nullptr;
+	}
+
+	void write(uint64_t offset, const uint8_t* data, uint64_t size) override;
+	void writeZeros(uint64_t offset, uint64_t size) override;
+	void finish() override;
+	bool isPositional() const override {
+		return true;
+	}
+
+private:
+	FILE* m_file = nullptr;
+	uint64_t m_size;
+	uint64_t m_numReported = 0; // progress
+	progressReporter* m_progress;
+	std::function<void(const sChecksums&)> m_onWritten;
+	uringWriter* m_writer;
+};
+
+// A single sequential pass over a tape feeding every output of a run: each sink registers the tape ranges it needs,
+// run() reads their union once, in tape order through a 1MB window, and hands every byte to each range holding it.
+// Bytes reaching an ordered sink ahead of its position (a fork whose extents go backwards on the tape) are held
+// in memory until the gap is filled.
+class tapePass {
+public:
+	// Returns the sink index for addRange, the pass owns the sink
+	int addSink(std::unique_ptr<tapePassSink> sink);
+	// size bytes of the tape at tapeOffset (-1 for zeros) go to offset in the sink output
+	void addRange(int sinkIndex, uint64_t offset, int64_t tapeOffset, uint64_t size);
+	// Every sink is finished when it returns, sinks without ranges first
+	void run(tapeFile* fHandle);
+
+private:
+	struct sPending {
+		uint64_t m_size;
+		std::vector<uint8_t> m_data; // empty for zeros
+	};
+	struct sSinkState {
+		std::unique_ptr<tapePassSink> m_sink;
+		uint64_t m_position = 0; // next offset of an ordered sink
+		uint64_t m_bytesLeft = 0;
+		std::map<uint64_t, sPending> m_pending;
+		bool m_finished = false;
+	};
+	struct sRange {
+		int m_sinkIndex;
+		uint64_t m_offset;
+		uint64_t m_tapeOffset;
+		uint64_t m_size;
+	};
+	void deliver(int sinkIndex, uint64_t offset, const uint8_t* data, uint64_t size);
+	void drain(sSinkState& state);
+	void finishIfDone(sSinkState& state);
+
+	std::vector<sSinkState> m_sinks;
+	std::vector<sRange> m_ranges;
+};
@@ -0,0 +1,171 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "tarWriter.h"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+static const size_t TAR_BLOCK_SIZE = 512;
+static const size_t OUTPUT_BUFFER_SIZE = 4 * 1024 * 1024;
+static const int64_t USTAR_MAX_TIME = 077777777777;
+
+// "<length> <key>=<value>\n", the length counting its own digits
+static void addPaxRecord(std::string& records, const std::string& key, const std::string& value) {
+	size_t length = key.size() + value.size() + 3;
+	size_t numDigits = std::to_string(length).size();
+	while (std::to_string(length + numDigits).size() != numDigits) {
+		numDigits++;
+	}
+	records += std::to_string(length + numDigits) + " " + key + "=" + value + "\n";
+}
+
+tarWriter::~tarWriter() {
+	close();
+}
+
+bool tarWriter::open(const std::string& outputFileName) {
+	close();
+	m_failed = false;
+	m_numFiles = 0;
+	if (outputFileName == "-") {
+		fflush(stdout);
+		int archiveDescriptor = dup(fileno(stdout));
+		if (archiveDescriptor < 0) {
+			return false;
+		}
+#ifdef _WIN32
+		_setmode(archiveDescriptor, _O_BINARY);
+#endif
+		dup2(fileno(stderr), fileno(stdout));
+		m_file = fdopen(archiveDescriptor, "wb");
+	}
+	else {
+		m_file = fopen(outputFileName.c_str(), "wb");
+	}
+	m_buffer.resize(OUTPUT_BUFFER_SIZE);
+	m_bufferUsed = 0;
+	return m_file != nullptr;
+}
+
+bool tarWriter::close() {
+	if (m_file == nullptr) {
+		return false;
+	}
+	// End of archive: two zero blocks
+	writeZeros(2 * TAR_BLOCK_SIZE);
+	flush();
+	if (fclose(m_file) != 0) {
+		m_failed = true;
+	}
+	m_file = nullptr;
+	return !m_failed;
+}
+
+void tarWriter::beginFile(const std::string& path, uint64_t size, int64_t modificationTime, std::optional<int64_t> creationTime) {
+	std::string records;
+	bool isASCII = std::all_of(path.begin(), path.end(), [](char character) { return (uint8_t)character < 0x80; });
+	if (path.size() > 100 || !isASCII) {
+		addPaxRecord(records, "path", path);
+	}
+	if (modificationTime < 0 || modificationTime > USTAR_MAX_TIME) {
+		addPaxRecord(records, "mtime", std::to_string(modificationTime));
+	}
+	if (creationTime.has_value()) {
+		addPaxRecord(records, "LIBARCHIVE.creationtime", std::to_string(*creationTime));
+	}
+	if (!records.empty()) {
+		size_t nameStart = path.find_last_of('/');
+		std::string name = "PaxHeaders/" + path.substr(nameStart == std::string::npos ? 0 : nameStart + 1);
+		writeHeader(name, records.size(), std::clamp<int64_t>(modificationTime, 0, USTAR_MAX_TIME), 'x');
+		writeRaw(records.data(), records.size());
+		writeZeros((TAR_BLOCK_SIZE - records.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+	}
+
+	writeHeader(path, size, std::clamp<int64_t>(modificationTime, 0, USTAR_MAX_TIME), '0');
+	m_fileSize = size;
+	m_fileWritten = 0;
+}
+
+void tarWriter::write(const void* data, size_t size) {
+	// Never past the size already written in the header
+	size = (size_t)std::min<uint64_t>(size, m_fileSize - m_fileWritten);
+	writeRaw(data, size);
+	m_fileWritten += size;
+}
+
+void tarWriter::endFile() {
+	writeZeros(m_fileSize - m_fileWritten);
+	writeZeros((TAR_BLOCK_SIZE - m_fileSize % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+	m_fileSize = 0;
+	m_fileWritten = 0;
+	m_numFiles++;
+}
+
+void tarWriter::writeHeader(const std::string& name, uint64_t size, int64_t modificationTime, char type) {
+	// ustar header, longer names were already given in a pax header
+	uint8_t header[TAR_BLOCK_SIZE] = {};
+	memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+	snprintf((char*)header + 100, 8, "%07o", 0644);
+	snprintf((char*)header + 108, 8, "%07o", 0);
+	snprintf((char*)header + 116, 8, "%07o", 0);
+	snprintf((char*)header + 124, 12, "%011llo", (unsigned long long)size);
+	snprintf((char*)header + 136, 12, "%011llo", (unsigned long long)modificationTime);
+	header[156] = type;
+	memcpy(header + 257, "ustar", 6);
+	memcpy(header + 263, "00", 2);
+
+	// The checksum is computed with its own field filled with spaces
+	memset(header + 148, ' ', 8);
+	uint32_t checksum = 0;
+	for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+		checksum += header[i];
+	}
+	snprintf((char*)header + 148, 8, "%06o", checksum);
+	header[155] = ' ';
+
+	writeRaw(header, sizeof(header));
+}
+
+void tarWriter::writeRaw(const void* data, size_t size) {
+	if (m_file == nullptr) {
+		return;
+	}
+	if (m_bufferUsed + size > m_buffer.size()) {
+		flush();
+	}
+	if (size >= m_buffer.size()) {
+		if (fwrite(data, 1, size, m_file) != size) {
+			m_failed = true;
+		}
+		return;
+	}
+	memcpy(m_buffer.data() + m_bufferUsed, data, size);
+	m_bufferUsed += size;
+}
+
+void tarWriter::writeZeros(size_t size) {
+	static const uint8_t zeros[TAR_BLOCK_SIZE] = {};
+	while (size > 0) {
+		size_t chunkSize = std::min(size, sizeof(zeros));
+		writeRaw(zeros, chunkSize);
+		size -= chunkSize;
+	}
+}
+
+void tarWriter::flush() {
+	if (m_bufferUsed && fwrite(m_buffer.data(), 1, m_bufferUsed, m_file) != m_bufferUsed) {
+		m_failed = true;
+	}
+	m_bufferUsed = 0;
+}
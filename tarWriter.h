@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <optional>
+
+// Streams files into a POSIX (pax) tar archive through one large buffer.
+// A pax extended header carries what ustar can't: long or non-ASCII paths, dates before 1970, and the creation date (LIBARCHIVE.creationtime).
+class tarWriter {
+public:
+	~tarWriter();
+	// "-" writes to stdout, which is then pointed at stderr so messages don't end up in the archive
+	bool open(const std::string& outputFileName);
+	// Writes the end of archive marker
+	bool close();
+
+	// Exactly size bytes must then go through write(), endFile() zero fills any shortfall
+	void beginFile(const std::string& path, uint64_t size, int64_t modificationTime, std::optional<int64_t> creationTime);
+	void write(const void* data, size_t size);
+	void endFile();
+
+	uint64_t m_numFiles = 0;
+
+private:
+	void writeHeader(const std::string& name, uint64_t size, int64_t modificationTime, char type);
+	void writeRaw(const void* data, size_t size);
+	void writeZeros(size_t size);
+	void flush();
+
+	FILE* m_file = nullptr;
+	bool m_failed = false;
+	std::vector<uint8_t> m_buffer;
+	size_t m_bufferUsed = 0;
+	uint64_t m_fileSize = 0;
+	uint64_t m_fileWritten = 0;
+};
@@ -0,0 +1,208 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "traceReplay.h"
+#include "ioTrace.h"
+#include "fileAccess.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+static const uint64_t CACHE_BLOCK_SIZE = 0x10000;
+
+struct sAccessStats {
+	uint64_t m_numReads = 0;
+	uint64_t m_bytes = 0;
+	uint64_t m_seeks = 0;
+	uint64_t m_seekDistance = 0;
+	uint64_t m_sequentialReads = 0;
+	uint64_t m_reReadBytes = 0;
+};
+
+// Tracks head movement and what was already read, at sector granularity
+class accessTracker {
+public:
+	void addRead(sAccessStats& stats, uint64_t offset, uint64_t length) {
+		stats.m_numReads++;
+		stats.m_bytes += length;
+		if (offset == m_position) {
+			stats.m_sequentialReads++;
+		}
+		else {
+			stats.m_seeks++;
+			stats.m_seekDistance += offset > m_position ? offset - m_position : m_position - offset;
+		}
+		m_position = offset + length;
+
+		uint64_t lastSector = (offset + length + 0x1FF) / 0x200;
+		if (m_readSectors.size() < lastSector) {
+			m_readSectors.resize(lastSector);
+		}
+		for (uint64_t sector = offset / 0x200; sector < lastSector; sector++) {
+			if (m_readSectors[sector]) {
+				stats.m_reReadBytes += 0x200;
+			}
+			m_readSectors[sector] = true;
+		}
+	}
+private:
+	uint64_t m_position = 0;
+	std::vector<bool> m_readSectors;
+};
+
+static void addAccessStats(sAccessStats& total, const sAccessStats& stats) {
+	total.m_numReads += stats.m_numReads;
+	total.m_bytes += stats.m_bytes;
+	total.m_seeks += stats.m_seeks;
+	total.m_seekDistance += stats.m_seekDistance;
+	total.m_sequentialReads += stats.m_sequentialReads;
+	total.m_reReadBytes += stats.m_reReadBytes;
+}
+
+static void printAccessStats(const char* name, const sAccessStats& stats) {
+	printf("%-28s %10llu %12.2f %10llu %14.2f %12.2f %8.1f%%\n", name, (unsigned long long)stats.m_numReads, stats.m_bytes / 1048576.0, (unsigned long long)stats.m_seeks,
+		stats.m_seekDistance / 1048576.0, stats.m_reReadBytes / 1048576.0, stats.m_numReads ? stats.m_sequentialReads * 100.0 / stats.m_numReads : 0.0);
+}
+
+class blockCache {
+public:
+	blockCache(uint64_t capacity) : m_capacity(capacity) {}
+	bool lookup(uint64_t block) {
+		auto entry = m_blocks.find(block);
+		if (entry == m_blocks.end()) {
+			return false;
+		}
+		m_lru.splice(m_lru.begin(), m_lru, entry->second);
+		return true;
+	}
+	void insert(uint64_t block) {
+		if (m_capacity == 0 || lookup(block)) {
+			return;
+		}
+		m_lru.push_front(block);
+		m_blocks[block] = m_lru.begin();
+		if (m_blocks.size() > m_capacity) {
+			m_blocks.erase(m_lru.back());
+			m_lru.pop_back();
+		}
+	}
+private:
+	uint64_t m_capacity;
+	std::list<uint64_t> m_lru;
+	std::unordered_map<uint64_t, std::list<uint64_t>::iterator> m_blocks;
+};
+
+// Tape offset to image file offset
+static uint64_t getImageOffset(uint64_t tapeOffset, bool cptp) {
+	if (!cptp) {
+		return tapeOffset;
+	}
+	return 0x10 + (tapeOffset / 0x200) * 0x211 + tapeOffset % 0x200;
+}
+
+int runReplay(const std::string& traceFileName, const std::string& imageFileName, const std::vector<uint64_t>& cacheSizes, const std::vector<uint64_t>& readAheadSizes) {
+	std::vector<sTraceEvent> events;
+	std::vector<std::string> stages;
+	if (!readTrace(traceFileName, events, stages)) {
+		printf("Can't read trace %s\n", traceFileName.c_str());
+		return -1;
+	}
+
+	// What the extractor asked for
+	std::vector<sAccessStats> stageStats(stages.size());
+	sAccessStats totalStats;
+	accessTracker tracker;
+	for (int i = 0; i < events.size(); i++) {
+		if (events[i].m_type == TRACE_SEEK) {
+			continue;
+		}
+		sAccessStats read;
+		tracker.addRead(read, events[i].m_offset, events[i].m_length);
+		addAccessStats(stageStats[events[i].m_stage], read);
+		addAccessStats(totalStats, read);
+	}
+	printf("%-28s %10s %12s %10s %14s %12s %9s\n", "stage", "reads", "MB", "seeks", "seek dist MB", "re-read MB", "seq");
+	for (int i = 0; i < stages.size(); i++) {
+		if (stageStats[i].m_numReads) {
+			printAccessStats(stages[i].empty() ? "(none)" : stages[i].c_str(), stageStats[i]);
+		}
+	}
+	printAccessStats("total", totalStats);
+	printf("\n");
+
+	positionalFile image;
+	bool cptp = false;
+	if (!imageFileName.empty()) {
+		if (!image.open(imageFileName, false)) {
+			printf("Can't open %s\n", imageFileName.c_str());
+			return -1;
+		}
+		cptp = std::filesystem::path(imageFileName).extension() == ".cptp" || std::filesystem::path(imageFileName).extension() == ".CPTP";
+	}
+
+	// What a device behind a block cache with read-ahead would see
+	printf("%8s %12s %10s %12s %10s %14s %12s %9s %9s %10s\n", "cache MB", "readahead KB", "reads", "MB", "seeks", "seek dist MB", "re-read MB", "seq", "hits", "replay ms");
+	std::vector<uint8_t> buffer;
+	for (int cacheIndex = 0; cacheIndex < cacheSizes.size(); cacheIndex++) {
+		for (int readAheadIndex = 0; readAheadIndex < readAheadSizes.size(); readAheadIndex++) {
+			blockCache cache(cacheSizes[cacheIndex] / CACHE_BLOCK_SIZE);
+			uint64_t readAheadBlocks = std::max<uint64_t>(1, readAheadSizes[readAheadIndex] / CACHE_BLOCK_SIZE);
+			accessTracker deviceTracker;
+			sAccessStats deviceStats;
+			uint64_t requestedBytes = 0;
+			uint64_t hitBytes = 0;
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < events.size(); i++) {
+				const sTraceEvent& event = events[i];
+				if (event.m_type == TRACE_SEEK || event.m_length == 0) {
+					continue;
+				}
+				requestedBytes += event.m_length;
+				uint64_t firstBlock = event.m_offset / CACHE_BLOCK_SIZE;
+				uint64_t lastBlock = (event.m_offset + event.m_length - 1) / CACHE_BLOCK_SIZE;
+				uint64_t block = firstBlock;
+				while (block <= lastBlock) {
+					uint64_t blockStart = std::max(block * CACHE_BLOCK_SIZE, event.m_offset);
+					uint64_t blockEnd = std::min((block + 1) * CACHE_BLOCK_SIZE, event.m_offset + event.m_length);
+					if (cache.lookup(block)) {
+						hitBytes += blockEnd - blockStart;
+						block++;
+						continue;
+					}
+					// One device read for the missing run, extended to the read-ahead
+					uint64_t numBlocks = 1;
+					while (block + numBlocks <= lastBlock && !cache.lookup(block + numBlocks)) {
+						numBlocks++;
+					}
+					numBlocks = std::max(numBlocks, readAheadBlocks);
+					deviceTracker.addRead(deviceStats, block * CACHE_BLOCK_SIZE, numBlocks * CACHE_BLOCK_SIZE);
+					if (!imageFileName.empty()) {
+						uint64_t imageStart = getImageOffset(block * CACHE_BLOCK_SIZE, cptp);
+						uint64_t imageEnd = getImageOffset((block + numBlocks) * CACHE_BLOCK_SIZE, cptp);
+						buffer.resize(imageEnd - imageStart);
+						image.readAt(imageStart, buffer.data(), buffer.size());
+					}
+					for (uint64_t i = 0; i < numBlocks; i++) {
+						cache.insert(block + i);
+					}
+					block += std::min(numBlocks, lastBlock - block + 1);
+				}
+			}
+			double replayTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			char replayTimeString[32] = "-";
+			if (!imageFileName.empty()) {
+				snprintf(replayTimeString, sizeof(replayTimeString), "%.2f", replayTime);
+			}
+			printf("%8llu %12llu %10llu %12.2f %10llu %14.2f %12.2f %8.1f%% %8.1f%% %10s\n", (unsigned long long)(cacheSizes[cacheIndex] / 1048576), (unsigned long long)(readAheadSizes[readAheadIndex] / 1024),
+				(unsigned long long)deviceStats.m_numReads, deviceStats.m_bytes / 1048576.0, (unsigned long long)deviceStats.m_seeks, deviceStats.m_seekDistance / 1048576.0, deviceStats.m_reReadBytes / 1048576.0,
+				deviceStats.m_numReads ? deviceStats.m_sequentialReads * 100.0 / deviceStats.m_numReads : 0.0, requestedBytes ? hitBytes * 100.0 / requestedBytes : 0.0, replayTimeString);
+		}
+	}
+	return 0;
+}
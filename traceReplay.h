@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Summarises a trace recorded with --trace (per stage: seeks, seek distance, re-reads, sequential ratio),
+// then replays it through a simulated block cache for every cache size / read-ahead pair.
+// When an image is given the resulting device reads are issued against it and timed.
+int runReplay(const std::string& traceFileName, const std::string& imageFileName, const std::vector<uint64_t>& cacheSizes, const std::vector<uint64_t>& readAheadSizes);
@@ -0,0 +1,216 @@
+#include "uringWriter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef HAS_IO_URING
+
+#include <unistd.h>
+
+static const uint32_t BUFFER_SIZE = 0x40000;
+static const int NUM_BUFFERS = 16;
+// Full buffers wait for a few more before being submitted together
+static const unsigned SUBMIT_BATCH = 4;
+
+uringWriter::~uringWriter() {
+	finish();
+}
+
+bool uringWriter::init() {
+	if (!m_ring.init(NUM_BUFFERS)) {
+		return false;
+	}
+	m_pool.resize((size_t)BUFFER_SIZE * NUM_BUFFERS);
+	m_buffers.resize(NUM_BUFFERS);
+	std::vector<uint8_t*> buffers;
+	for (int i = 0; i < NUM_BUFFERS; i++) {
+		m_buffers[i].m_data = m_pool.data() + (size_t)i * BUFFER_SIZE;
+		buffers.push_back(m_buffers[i].m_data);
+	}
+	m_ring.registerBuffers(buffers.data(), BUFFER_SIZE, NUM_BUFFERS);
+	return true;
+}
+
+void uringWriter::write(FILE* file, uint64_t offset, const uint8_t* data, uint64_t size) {
+	int fd = fileno(file);
+	// io_uring doesn't keep the order of the writes in flight, a later write over the same bytes must land last
+	if (m_current != -1 && (m_buffers[m_current].m_fd != fd || m_buffers[m_current].m_fileOffset + m_buffers[m_current].m_size != offset)) {
+		queueCurrent();
+	}
+	waitForOverlaps(fd, offset, size);
+	while (size) {
+		if (m_current != -1) {
+			const sBuffer& current = m_buffers[m_current];
+			if (current.m_fd != fd || current.m_fileOffset + current.m_size != offset || current.m_size == BUFFER_SIZE) {
+				queueCurrent();
+			}
+		}
+		if (m_current == -1) {
+			m_current = getFreeBuffer();
+			sBuffer& buffer = m_buffers[m_current];
+			buffer.m_fd = fd;
+			buffer.m_fileOffset = offset;
+			buffer.m_size = 0;
+			buffer.m_busy = true;
+			m_numBusy[fd]++;
+		}
+		sBuffer& buffer = m_buffers[m_current];
+		uint32_t chunkSize = (uint32_t)std::min<uint64_t>(size, BUFFER_SIZE - buffer.m_size);
+		memcpy(buffer.m_data + buffer.m_size, data, chunkSize);
+		buffer.m_size += chunkSize;
+		offset += chunkSize;
+		data += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+void uringWriter::queueCurrent() {
+	const sBuffer& buffer = m_buffers[m_current];
+	int bufferIndex = m_current;
+	m_current = -1;
+	// the ring has an entry per buffer
+	bool queued = m_ring.isOpen() && m_ring.queueWrite(buffer.m_fd, buffer.m_data, buffer.m_size, buffer.m_fileOffset, bufferIndex, bufferIndex);
+	if (!queued) {
+		complete(bufferIndex, -1);
+		return;
+	}
+	if (m_ring.getNumQueued() >= SUBMIT_BATCH && !m_ring.submit()) {
+		waitForCompletion();
+	}
+}
+
+void uringWriter::waitForOverlaps(int fd, uint64_t offset, uint64_t size) {
+	while (true) {
+		bool overlaps = false;
+		for (int i = 0; i < m_buffers.size() && !overlaps; i++) {
+			const sBuffer& buffer = m_buffers[i];
+			overlaps = buffer.m_busy && i != m_current && buffer.m_fd == fd && buffer.m_fileOffset < offset + size && offset < buffer.m_fileOffset + buffer.m_size;
+		}
+		if (!overlaps) {
+			return;
+		}
+		waitForCompletion();
+	}
+}
+
+int uringWriter::getFreeBuffer() {
+	while (true) {
+		for (int i = 0; i < m_buffers.size(); i++) {
+			if (!m_buffers[i].m_busy) {
+				return i;
+			}
+		}
+		waitForCompletion();
+	}
+}
+
+void uringWriter::waitForCompletion() {
+	uint64_t bufferIndex;
+	int result;
+	while (!m_ring.isOpen() || !m_ring.getCompletion(bufferIndex, result)) {
+		if (!m_ring.isOpen() || !m_ring.submit(1)) {
+			// the ring is unusable, what it still holds is written synchronously
+			m_ring.close();
+			for (int i = 0; i < m_buffers.size(); i++) {
+				if (m_buffers[i].m_busy && i != m_current) {
+					complete(i, -1);
+				}
+			}
+			return;
+		}
+	}
+	complete((int)bufferIndex, result);
+}
+
+void uringWriter::complete(int bufferIndex, int result) {
+	sBuffer& buffer = m_buffers[bufferIndex];
+	// what the ring didn't write
+	uint32_t done = (uint32_t)std::max(result, 0);
+	while (done < buffer.m_size) {
+		ssize_t numWritten = pwrite(buffer.m_fd, buffer.m_data + done, buffer.m_size - done, buffer.m_fileOffset + done);
+		if (numWritten <= 0) {
+			printf("Can't write %u bytes at %llu\n", buffer.m_size - done, (unsigned long long)(buffer.m_fileOffset + done));
+			break;
+		}
+		done += (uint32_t)numWritten;
+	}
+	buffer.m_busy = false;
+	int fd = buffer.m_fd;
+	if (--m_numBusy[fd] == 0) {
+		m_numBusy.erase(fd);
+		runCloses(fd);
+	}
+}
+
+void uringWriter::runCloses(int fd) {
+	for (int i = 0; i < m_closes.size(); i++) {
+		if (fileno(m_closes[i].m_file) == fd) {
+			sClose close = std::move(m_closes[i]);
+			m_closes.erase(m_closes.begin() + i);
+			fclose(close.m_file);
+			if (close.m_onClosed) {
+				close.m_onClosed();
+			}
+			return;
+		}
+	}
+}
+
+void uringWriter::flush(FILE* file) {
+	int fd = fileno(file);
+	if (m_current != -1 && m_buffers[m_current].m_fd == fd) {
+		queueCurrent();
+	}
+	while (m_numBusy.count(fd)) {
+		waitForCompletion();
+	}
+}
+
+void uringWriter::close(FILE* file, std::function<void()> onClosed) {
+	int fd = fileno(file);
+	if (m_current != -1 && m_buffers[m_current].m_fd == fd) {
+		queueCurrent();
+	}
+	m_closes.push_back({ file, onClosed });
+	if (m_numBusy.count(fd) == 0) {
+		runCloses(fd);
+	}
+}
+
+void uringWriter::finish() {
+	if (m_current != -1) {
+		queueCurrent();
+	}
+	while (!m_numBusy.empty()) {
+		waitForCompletion();
+	}
+}
+
+#else
+
+uringWriter::~uringWriter() {
+}
+
+bool uringWriter::init() {
+	return false;
+}
+
+void uringWriter::write(FILE* file, uint64_t offset, const uint8_t* data, uint64_t size) {
+	assert(false);
+}
+
+void uringWriter::flush(FILE* file) {
+}
+
+void uringWriter::close(FILE* file, std::function<void()> onClosed) {
+	fclose(file);
+	if (onClosed) {
+		onClosed();
+	}
+}
+
+void uringWriter::finish() {
+}
+
+#endif
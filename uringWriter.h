@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include "ioUring.h"
+
+// Batched asynchronous output writes through io_uring: write() copies into one of a few registered buffers, consecutive
+// writes to a file are coalesced and full buffers are submitted a few at a time, so many writes are in flight while
+// the tape is read. A write over bytes still in flight waits for them, so the last write of a range wins as with stdio.
+// Short or failed writes are completed with pwrite. init() fails without io_uring, callers then write with stdio as
+// usual. The files are written by descriptor, nothing goes through their stdio buffer.
+class uringWriter {
+public:
+	~uringWriter();
+	bool init();
+
+	// size bytes at offset in file
+	void write(FILE* file, uint64_t offset, const uint8_t* data, uint64_t size);
+	// Returns once every write to file is done
+	void flush(FILE* file);
+	// Closes file, then calls onClosed, once its writes are done
+	void close(FILE* file, std::function<void()> onClosed = nullptr);
+	// Every write done and every file closed
+	void finish();
+
+private:
+	struct sBuffer {
+		uint8_t* m_data = nullptr;
+		int m_fd = -1;
+		uint64_t m_fileOffset = 0;
+		uint32_t m_size = 0;
+		bool m_busy = false; // filling, queued or in flight
+	};
+	struct sClose {
+		FILE* m_file;
+		std::function<void()> m_onClosed;
+	};
+
+	void queueCurrent();
+	// Waits for the busy buffers holding bytes of fd in [offset, offset + size)
+	void waitForOverlaps(int fd, uint64_t offset, uint64_t size);
+	int getFreeBuffer();
+	void waitForCompletion();
+	void complete(int bufferIndex, int result);
+	void runCloses(int fd);
+
+	ioUring m_ring;
+	std::vector<uint8_t> m_pool;
+	std::vector<sBuffer> m_buffers;
+	int m_current = -1; // buffer being filled
+	std::map<int, int> m_numBusy; // busy buffers per descriptor
+	std::vector<sClose> m_closes;
+};
@@ -0,0 +1,145 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "virtualDisk.h"
+#include "progress.h"
+#include "tapePass.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+void virtualDisk::addRange(uint64_t size, int64_t tapeOffset) {
+	if (size == 0) {
+		return;
+	}
+	if (!m_ranges.empty()) {
+		// coalesce contiguous ranges
+		sRange& lastRange = m_ranges.back();
+		bool bothZero = lastRange.m_tapeOffset == -1 && tapeOffset == -1;
+		bool contiguous = lastRange.m_tapeOffset != -1 && tapeOffset == lastRange.m_tapeOffset + (int64_t)lastRange.m_size;
+		if (bothZero || contiguous) {
+			lastRange.m_size += size;
+			m_size += size;
+			return;
+		}
+	}
+	sRange& newRange = m_ranges.emplace_back();
+	newRange.m_diskOffset = m_size;
+	newRange.m_size = size;
+	newRange.m_tapeOffset = tapeOffset;
+	m_size += size;
+}
+
+void virtualDisk::addAllocatedRange(uint64_t size, int64_t tapeOffset) {
+	if (!m_volume.has_value()) {
+		addRange(size, tapeOffset);
+		return;
+	}
+	// The disk starts with the HFS partition, so allocation blocks are at the same offsets as in the volume
+	uint64_t firstBlockOffset = (uint64_t)m_volume->m_firstAllocationBlockSector * 0x200;
+	uint64_t blockSize = m_volume->m_allocationBlockSize;
+	while (size) {
+		uint64_t diskOffset = m_size;
+		uint64_t chunkSize = size;
+		bool allocated = true;
+		if (diskOffset < firstBlockOffset) {
+			chunkSize = std::min(size, firstBlockOffset - diskOffset);
+		}
+		else {
+			uint32_t block = (uint32_t)std::min<uint64_t>((diskOffset - firstBlockOffset) / blockSize, m_volume->m_bitmap.getNumBlocks());
+			if (block < m_volume->m_bitmap.getNumBlocks()) {
+				allocated = m_volume->m_bitmap.isAllocated(block);
+				uint64_t runEndOffset = firstBlockOffset + (uint64_t)m_volume->m_bitmap.getRunEnd(block) * blockSize;
+				chunkSize = std::min(size, runEndOffset - diskOffset);
+			}
+		}
+		addRange(chunkSize, allocated ? tapeOffset : -1);
+		size -= chunkSize;
+		if (tapeOffset != -1) {
+			tapeOffset += chunkSize;
+		}
+	}
+}
+
+bool virtualDisk::open(tapeFile* fHandle, std::vector<sSession>& sessions, int sessionIndex, bool keepFreeBlocks) {
+	m_fHandle = fHandle;
+	m_ranges.clear();
+	m_size = 0;
+	m_volume.reset();
+
+	std::optional<sHFSVolume> volume = getHFSVolume(sessionIndex, sessions, fHandle);
+	sessionAddressMap addressMap;
+	if (!volume.has_value() || !addressMap.build(fHandle, sessions, sessionIndex, *volume)) {
+		return false;
+	}
+	if (!keepFreeBlocks) {
+		m_volume = volume;
+	}
+
+	// The disk is the session volume, free allocation blocks of the data region only read as zeros
+	const std::vector<sessionAddressMap::sRange>& ranges = addressMap.getRanges();
+	for (int i = 0; i < ranges.size(); i++) {
+		if (ranges[i].m_tapeOffset != -1 && ranges[i].m_volumeOffset >= addressMap.getDataOffset()) {
+			addAllocatedRange(ranges[i].m_size, ranges[i].m_tapeOffset);
+		}
+		else {
+			addRange(ranges[i].m_size, ranges[i].m_tapeOffset);
+		}
+	}
+
+	return true;
+}
+
+uint64_t virtualDisk::read(uint64_t offset, uint8_t* output, uint64_t size) {
+	if (offset >= m_size) {
+		return 0;
+	}
+	size = std::min(size, m_size - offset);
+
+	auto range = std::upper_bound(m_ranges.begin(), m_ranges.end(), offset, [](uint64_t offset, const sRange& range) { return offset < range.m_diskOffset; }) - 1;
+	uint64_t amountLeft = size;
+	while (amountLeft) {
+		uint64_t offsetInRange = offset - range->m_diskOffset;
+		uint64_t chunkSize = std::min(amountLeft, range->m_size - offsetInRange);
+		if (range->m_tapeOffset == -1) {
+			memset(output, 0, chunkSize);
+		}
+		else {
+			m_fHandle->seekToPosition(range->m_tapeOffset + offsetInRange);
+			m_fHandle->readBuffer(output, (int)chunkSize);
+		}
+		output += chunkSize;
+		offset += chunkSize;
+		amountLeft -= chunkSize;
+		range++;
+	}
+	return size;
+}
+
+bool virtualDisk::writeImage(const std::string& outputFileName, sChecksums* checksums, progressReporter* progress) {
+	FILE* fOutput = fopen(outputFileName.c_str(), "wb+");
+	if (fOutput == nullptr) {
+		return false;
+	}
+	checksumStream checksum;
+	std::vector<uint8_t> buffer(0x100000);
+	for (uint64_t offset = 0; offset < m_size; offset += buffer.size()) {
+		uint64_t numRead = read(offset, buffer.data(), buffer.size());
+		fwrite(buffer.data(), 1, numRead, fOutput);
+		checksum.update(buffer.data(), numRead);
+		if (progress) {
+			progress->addBytes(numRead);
+		}
+	}
+	fclose(fOutput);
+	if (checksums) {
+		*checksums = checksum.digest();
+	}
+	return true;
+}
+
+void virtualDisk::addToPass(tapePass& pass, int sinkIndex) const {
+	for (int i = 0; i < m_ranges.size(); i++) {
+		pass.addRange(sinkIndex, m_ranges[i].m_diskOffset, m_ranges[i].m_tapeOffset, m_ranges[i].m_size);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "session.h"
+#include "sessionAddressMap.h"
+#include "hash.h"
+
+class progressReporter;
+class tapePass;
+
+// The session_N.dsk image of a session, without materialising it.
+// Every .dsk byte range maps to a tape range through the session address map, or to zeros.
+class virtualDisk {
+public:
+	// Allocation blocks free in the volume bitmap read as zeros (and are never read from the tape) unless keepFreeBlocks
+	bool open(tapeFile* fHandle, std::vector<sSession>& sessions, int sessionIndex, bool keepFreeBlocks = false);
+	uint64_t getSize() const {
+		return m_size;
+	}
+
+	// Returns the number of bytes read, short only at the end of the disk
+	uint64_t read(uint64_t offset, uint8_t* output, uint64_t size);
+
+	// Writes the whole image, optionally checksumming it and reporting progress on the way
+	bool writeImage(const std::string& outputFileName, sChecksums* checksums = nullptr, progressReporter* progress = nullptr);
+	// Registers every byte of the disk, at its disk offset, to a sink of a pass instead
+	void addToPass(tapePass& pass, int sinkIndex) const;
+
+private:
+	struct sRange {
+		uint64_t m_diskOffset;
+		uint64_t m_size;
+		int64_t m_tapeOffset; // -1 for zeros
+	};
+	void addRange(uint64_t size, int64_t tapeOffset);
+	// addRange, with the free allocation blocks of m_volume as zeros
+	void addAllocatedRange(uint64_t size, int64_t tapeOffset);
+
+	tapeFile* m_fHandle = nullptr;
+	std::vector<sRange> m_ranges;
+	uint64_t m_size = 0;
+	std::optional<sHFSVolume> m_volume;
+};
@@ -0,0 +1,72 @@
+#include "volumeBitmap.h"
+
+#include <string.h>
+#include <algorithm>
+#include <bit>
+
+void volumeBitmap::assign(const std::vector<uint8_t>& bits, uint32_t numBlocks) {
+	m_numBlocks = std::min<uint32_t>(numBlocks, (uint32_t)bits.size() * 8);
+	m_bits.assign(bits.begin(), bits.begin() + (m_numBlocks + 7) / 8);
+	// Bits past the last block are not blocks
+	if (m_numBlocks % 8) {
+		m_bits.back() &= (uint8_t)(0xFF00 >> (m_numBlocks % 8));
+	}
+}
+
+uint32_t volumeBitmap::countAllocated(uint32_t firstBlock, uint32_t numBlocks) const {
+	uint32_t endBlock = std::min(firstBlock + numBlocks, m_numBlocks);
+	uint32_t count = 0;
+	uint32_t block = firstBlock;
+	// Single bits up to a byte boundary, whole words, then single bits again
+	while (block < endBlock && block % 8) {
+		count += isAllocated(block++);
+	}
+	while (block + 64 <= endBlock) {
+		uint64_t word;
+		memcpy(&word, &m_bits[block / 8], sizeof(word));
+		count += std::popcount(word);
+		block += 64;
+	}
+	while (block + 8 <= endBlock) {
+		count += std::popcount(m_bits[block / 8]);
+		block += 8;
+	}
+	while (block < endBlock) {
+		count += isAllocated(block++);
+	}
+	return count;
+}
+
+uint32_t volumeBitmap::getRunEnd(uint32_t block) const {
+	if (block >= m_numBlocks) {
+		return m_numBlocks;
+	}
+	bool allocated = isAllocated(block);
+	uint8_t runByte = allocated ? 0xFF : 0x00;
+	block++;
+	while (block < m_numBlocks) {
+		// Skip whole bytes of the same state
+		if (block % 8 == 0 && m_bits[block / 8] == runByte) {
+			block += 8;
+			continue;
+		}
+		if (isAllocated(block) != allocated) {
+			break;
+		}
+		block++;
+	}
+	return std::min(block, m_numBlocks);
+}
+
+std::vector<volumeBitmap::sRun> volumeBitmap::getAllocatedRuns() const {
+	std::vector<sRun> runs;
+	uint32_t block = 0;
+	while (block < m_numBlocks) {
+		uint32_t runEnd = getRunEnd(block);
+		if (isAllocated(block)) {
+			runs.push_back({ block, runEnd - block });
+		}
+		block = runEnd;
+	}
+	return runs;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// HFS volume bitmap: one bit per allocation block, set when allocated, most significant bit first
+class volumeBitmap {
+public:
+	void assign(const std::vector<uint8_t>& bits, uint32_t numBlocks);
+	uint32_t getNumBlocks() const {
+		return m_numBlocks;
+	}
+
+	bool isAllocated(uint32_t block) const {
+		return block < m_numBlocks && (m_bits[block / 8] & (0x80 >> (block % 8)));
+	}
+	// Allocated blocks in [firstBlock, firstBlock + numBlocks)
+	uint32_t countAllocated(uint32_t firstBlock, uint32_t numBlocks) const;
+	uint32_t countAllocated() const {
+		return countAllocated(0, m_numBlocks);
+	}
+	// First block from block on whose state differs from block's, getNumBlocks() at the end
+	uint32_t getRunEnd(uint32_t block) const;
+
+	struct sRun {
+		uint32_t m_firstBlock;
+		uint32_t m_numBlocks;
+	};
+	std::vector<sRun> getAllocatedRuns() const;
+
+private:
+	std::vector<uint8_t> m_bits;
+	uint32_t m_numBlocks = 0;
+};